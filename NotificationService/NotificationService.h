@@ -0,0 +1,12 @@
+#import <UserNotifications/UserNotifications.h>
+
+/**
+ * The Notification Service Extension of the chat: each chat message pushed by the MigratoryData FCM plugin is stored
+ * in the MessageStore of the app group and shown as the room and the chat text, before the notification is displayed.
+ */
+@interface NotificationService : UNNotificationServiceExtension {
+    void (^contentHandler)(UNNotificationContent *contentToDeliver);
+    UNMutableNotificationContent *content;
+}
+
+@end
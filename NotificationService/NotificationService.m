@@ -0,0 +1,44 @@
+#import "NotificationService.h"
+#import "ChatPush.h"
+
+@implementation NotificationService
+
+- (void) didReceiveNotificationRequest: (UNNotificationRequest *)request withContentHandler: (void (^)(UNNotificationContent *))handler {
+    contentHandler = [handler copy];
+    content = [request.content mutableCopy];
+
+    ChatPush *push = [[[ChatPush alloc] initWithPayload: request.content.userInfo] autorelease];
+    MessageStore *store = [MessageStore sharedStore];
+    if (push == nil || store == nil) {
+        [self serviceExtensionTimeWillExpire];
+        return;
+    }
+
+    [push applyToContent: content];
+    // Shown once stored, so the room opened from the notification already has the message
+    [push storeIn: store completion: ^(BOOL stored) {
+        [self serviceExtensionTimeWillExpire];
+    }];
+}
+
+// Called when the store is done, or by the system when the time given to the extension is over; delivers once.
+- (void) serviceExtensionTimeWillExpire {
+    void (^handler)(UNNotificationContent *);
+    @synchronized (self) {
+        handler = contentHandler;
+        contentHandler = nil;
+    }
+    if (handler != nil) {
+        handler(content);
+        [handler release];
+    }
+}
+
+- (void) dealloc {
+    [contentHandler release];
+    [content release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,329 @@
+// For clock_gettime
+#define _POSIX_C_SOURCE 200112L
+
+#include "JSONScanner.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Compare picking the user and text of a chat message with JSONScanner against parsing the whole message into a tree,
+ * as JSONFieldExtractorTests does with NSJSONSerialization on iOS. The fields found by both are checked to be equal,
+ * so the benchmark fails on a scanner that goes wrong.
+ */
+
+// Iterations per message, overridden by the first argument
+#define ITERATIONS 100000
+
+typedef enum { NODE_NULL, NODE_BOOL, NODE_NUMBER, NODE_STRING, NODE_ARRAY, NODE_OBJECT } NodeType;
+
+// A parsed value; strings are unescaped copies, the members of an object keep their keys in keys.
+typedef struct Node {
+    NodeType type;
+    double number;
+    char *string;
+    size_t count;
+    char **keys;
+    struct Node **children;
+} Node;
+
+typedef struct {
+    const char *json;
+    size_t length;
+    size_t i;
+} Parser;
+
+static void FreeNode(Node *node) {
+    if (node == NULL) {
+        return;
+    }
+    for (size_t k = 0; k < node->count; k++) {
+        if (node->keys != NULL) {
+            free(node->keys[k]);
+        }
+        FreeNode(node->children[k]);
+    }
+    free(node->keys);
+    free(node->children);
+    free(node->string);
+    free(node);
+}
+
+static void SkipSpace(Parser *p) {
+    while (p->i < p->length && (p->json[p->i] == ' ' || p->json[p->i] == '\t' || p->json[p->i] == '\n' || p->json[p->i] == '\r')) {
+        p->i++;
+    }
+}
+
+static void AppendUTF8(char *out, size_t *n, unsigned code) {
+    if (code < 0x80) {
+        out[(*n)++] = (char)code;
+    } else if (code < 0x800) {
+        out[(*n)++] = (char)(0xC0 | (code >> 6));
+        out[(*n)++] = (char)(0x80 | (code & 0x3F));
+    } else {
+        out[(*n)++] = (char)(0xE0 | (code >> 12));
+        out[(*n)++] = (char)(0x80 | ((code >> 6) & 0x3F));
+        out[(*n)++] = (char)(0x80 | (code & 0x3F));
+    }
+}
+
+// Unescape the raw bytes of a string, or return NULL if an escape is malformed. Surrogate pairs are not combined.
+static char *Unescape(const char *raw, size_t length) {
+    char *out = malloc(length + 1);
+    size_t n = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (raw[i] != '\\') {
+            out[n++] = raw[i];
+            continue;
+        }
+        if (++i >= length) {
+            free(out);
+            return NULL;
+        }
+        switch (raw[i]) {
+            case 'b': out[n++] = '\b'; break;
+            case 'f': out[n++] = '\f'; break;
+            case 'n': out[n++] = '\n'; break;
+            case 'r': out[n++] = '\r'; break;
+            case 't': out[n++] = '\t'; break;
+            case 'u': {
+                unsigned code = 0;
+                if (i + 4 >= length) {
+                    free(out);
+                    return NULL;
+                }
+                for (int d = 1; d <= 4; d++) {
+                    char c = raw[i + d];
+                    code = code * 16 + (unsigned)(c >= 'a' ? c - 'a' + 10 : c >= 'A' ? c - 'A' + 10 : c - '0');
+                }
+                AppendUTF8(out, &n, code);
+                i += 4;
+                break;
+            }
+            default: out[n++] = raw[i]; break;
+        }
+    }
+    out[n] = 0;
+    return out;
+}
+
+// The string starting with the quote at the parser position, unescaped, or NULL if it is malformed.
+static char *ParseString(Parser *p) {
+    size_t start = ++p->i;
+    while (p->i < p->length && p->json[p->i] != '"') {
+        p->i += p->json[p->i] == '\\' ? 2 : 1;
+    }
+    if (p->i >= p->length) {
+        return NULL;
+    }
+    return Unescape(p->json + start, p->i++ - start);
+}
+
+static Node *ParseValue(Parser *p);
+
+// The members of an object or the elements of an array, the parser being past the opening bracket.
+static Node *ParseContainer(Parser *p, NodeType type, char close) {
+    Node *node = calloc(1, sizeof(Node));
+    size_t capacity = 0;
+    node->type = type;
+
+    SkipSpace(p);
+    if (p->i < p->length && p->json[p->i] == close) {
+        p->i++;
+        return node;
+    }
+
+    for (;;) {
+        char *key = NULL;
+        SkipSpace(p);
+        if (type == NODE_OBJECT) {
+            if (p->i >= p->length || p->json[p->i] != '"' || (key = ParseString(p)) == NULL) {
+                break;
+            }
+            SkipSpace(p);
+            if (p->i >= p->length || p->json[p->i++] != ':') {
+                free(key);
+                break;
+            }
+        }
+
+        Node *child = ParseValue(p);
+        if (child == NULL) {
+            free(key);
+            break;
+        }
+        if (node->count == capacity) {
+            capacity = capacity == 0 ? 8 : 2 * capacity;
+            node->children = realloc(node->children, capacity * sizeof(Node *));
+            if (type == NODE_OBJECT) {
+                node->keys = realloc(node->keys, capacity * sizeof(char *));
+            }
+        }
+        if (type == NODE_OBJECT) {
+            node->keys[node->count] = key;
+        }
+        node->children[node->count++] = child;
+
+        SkipSpace(p);
+        if (p->i < p->length && p->json[p->i] == ',') {
+            p->i++;
+        } else if (p->i < p->length && p->json[p->i] == close) {
+            p->i++;
+            return node;
+        } else {
+            break;
+        }
+    }
+
+    FreeNode(node);
+    return NULL;
+}
+
+static Node *ParseValue(Parser *p) {
+    SkipSpace(p);
+    if (p->i >= p->length) {
+        return NULL;
+    }
+
+    char c = p->json[p->i];
+    if (c == '{') {
+        p->i++;
+        return ParseContainer(p, NODE_OBJECT, '}');
+    }
+    if (c == '[') {
+        p->i++;
+        return ParseContainer(p, NODE_ARRAY, ']');
+    }
+
+    Node *node = calloc(1, sizeof(Node));
+    if (c == '"') {
+        node->type = NODE_STRING;
+        if ((node->string = ParseString(p)) == NULL) {
+            FreeNode(node);
+            return NULL;
+        }
+    } else if (strncmp(p->json + p->i, "true", 4) == 0 || strncmp(p->json + p->i, "null", 4) == 0) {
+        node->type = c == 't' ? NODE_BOOL : NODE_NULL;
+        node->number = c == 't';
+        p->i += 4;
+    } else if (strncmp(p->json + p->i, "false", 5) == 0) {
+        node->type = NODE_BOOL;
+        p->i += 5;
+    } else {
+        char *end;
+        node->type = NODE_NUMBER;
+        node->number = strtod(p->json + p->i, &end);
+        if (end == p->json + p->i) {
+            FreeNode(node);
+            return NULL;
+        }
+        p->i = (size_t)(end - p->json);
+    }
+    return node;
+}
+
+static const Node *Member(const Node *object, const char *key) {
+    for (size_t k = 0; object != NULL && object->type == NODE_OBJECT && k < object->count; k++) {
+        if (strcmp(object->keys[k], key) == 0) {
+            return object->children[k];
+        }
+    }
+    return NULL;
+}
+
+static double Now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *ChatMessage(void) {
+    return "{\"id\":\"8c1f2e\",\"room\":\"/chat/general\",\"meta\":{\"client\":\"ios\",\"text\":\"nested\"},"
+        "\"user\":\"Zo\\u00eb\",\"text\":\"See you at the \\\"usual\\\" place, around 7 \\u2014 don't be late!\",\"ts\":1729281748}";
+}
+
+// A message with a long history of edits before the fields shown.
+static char *LargeMessage(void) {
+    size_t capacity = 8192, n = 0;
+    char *json = malloc(capacity);
+    n += (size_t)snprintf(json + n, capacity - n, "{\"edits\":[");
+    for (int i = 0; i < 50; i++) {
+        n += (size_t)snprintf(json + n, capacity - n, "%s{\"at\":%d,\"text\":\"revision %d of a rather long message body\"}", i > 0 ? "," : "", i, i);
+    }
+    snprintf(json + n, capacity - n, "],\"user\":\"alice\",\"text\":\"final text\"}");
+    return json;
+}
+
+// Check that the scanner finds the same strings as the full parse, then time both. Returns 0 on success.
+static int Benchmark(const char *json, const char *name, long iterations) {
+    const char *const keys[] = { "user", "text", "ts", "missing" };
+    const size_t length = strlen(json);
+    JSONValueView values[4];
+    volatile size_t matches = 0;
+
+    Parser check = { json, length, 0 };
+    Node *root = ParseValue(&check);
+    JSONExtractFields(json, length, keys, 4, values);
+    if (root == NULL || values[0].data == NULL || values[1].data == NULL || values[3].data != NULL) {
+        fprintf(stderr, "%s: fields not found\n", name);
+        FreeNode(root);
+        return 1;
+    }
+    for (int k = 0; k < 2; k++) {
+        char *scanned = Unescape(values[k].data, values[k].length);
+        const Node *parsed = Member(root, keys[k]);
+        int equal = scanned != NULL && parsed != NULL && parsed->type == NODE_STRING && strcmp(scanned, parsed->string) == 0;
+        free(scanned);
+        if (!equal) {
+            fprintf(stderr, "%s: the scanner and the parser disagree on %s\n", name, keys[k]);
+            FreeNode(root);
+            return 1;
+        }
+    }
+    FreeNode(root);
+
+    double start = Now();
+    for (long i = 0; i < iterations; i++) {
+        Parser p = { json, length, 0 };
+        Node *object = ParseValue(&p);
+        if (Member(object, "user") != NULL && Member(object, "text") != NULL) {
+            matches++;
+        }
+        FreeNode(object);
+    }
+    double parse = (Now() - start) / iterations;
+
+    start = Now();
+    for (long i = 0; i < iterations; i++) {
+        if (JSONExtractFields(json, length, keys, 2, values) == 2) {
+            matches++;
+        }
+    }
+    double extract = (Now() - start) / iterations;
+
+    printf("%s message of %zu bytes: full parse %.2fus, field extraction %.2fus, %.1fx\n", name, length,
+        parse * 1e6, extract * 1e6, parse / extract);
+    return matches == 2 * (size_t)iterations ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : ITERATIONS;
+    char *large = LargeMessage();
+    int failed = 0;
+
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 2;
+    }
+
+    failed |= Benchmark(ChatMessage(), "chat", iterations);
+    failed |= Benchmark(large, "large", iterations);
+    failed |= JSONExtractField("{\"user\":\"bob", 12, "user", &(JSONValueView){ 0 });
+    failed |= JSONExtractField("[\"user\",\"bob\"]", 14, "user", &(JSONValueView){ 0 });
+
+    free(large);
+    return failed;
+}
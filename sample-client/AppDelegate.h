@@ -3,6 +3,26 @@
 
 #import "MigratoryDataClient.h"
 #import "SampleListener.h"
+#import "HistoryPager.h"
+#import "PriorityDispatcher.h"
+#import "ConflationListener.h"
+#import "InboundBuffer.h"
+#import "ServerAddressCache.h"
+#import "DuplicateFilter.h"
+#import "ReorderBuffer.h"
+#import "SubscriptionCache.h"
+#import "RequestReply.h"
+#import "ConnectionProbe.h"
+#import "PublishCoalescer.h"
+#import "DeltaListener.h"
+#import "LoopbackClient.h"
+#import "SessionRecorder.h"
+#import "ClientMetrics.h"
+#import "StallWatchdog.h"
+#import "MessageStore.h"
+#import "ChatPush.h"
+#import "ChatTimelineController.h"
+#import "RoomSummaryIndex.h"
 
 @interface AppDelegate : NSObject <UIApplicationDelegate> {
     
@@ -13,9 +33,29 @@
     
     MigratoryDataClient *client;
     SampleListener *listener;
+    HistoryPager *historyPager;
+    PriorityDispatcher *priorityDispatcher;
+    ConflationListener *conflationListener;
+    InboundBuffer *inboundBuffer;
+    ServerAddressCache *addressCache;
+    DuplicateFilter *duplicateFilter;
+    ReorderBuffer *reorderBuffer;
+    SubscriptionCache *subscriptionCache;
+    RequestReply *requestReply;
+    ConnectionProbe *connectionProbe;
+    PublishCoalescer *publishCoalescer;
+    DeltaListener *deltaListener;
+    SessionRecorder *sessionRecorder;
+    ClientMetrics *clientMetrics;
+    StallWatchdog *stallWatchdog;
+    MessageStore *messageStore;
+    MessageStoreListener *storeListener;
+    ChatTimelineController *timeline;
+    RoomSummaryIndex *roomSummaries;
     
     NSMutableArray *subjectList;
     NSMutableArray *serverList;
+    BOOL notificationsConfigured;
 }
 
 @property (nonatomic, retain) IBOutlet UIWindow *window;
@@ -4,6 +4,11 @@
 @import UIKit;
 @import UserNotifications;
 
+#include <sys/sysctl.h>
+
+// Time to wait for the first message before configuring Firebase, in seconds
+#define FIREBASE_DELAY 3.0
+
 // Implement UNUserNotificationCenterDelegate to receive display notification via APNS for devices
 // running iOS 10 and above.
 @interface AppDelegate () <UNUserNotificationCenterDelegate>
@@ -16,9 +21,192 @@
 @synthesize liveStatus;
 @synthesize liveMessage;
 
+// The launch time of the process, to measure the time to the first message from the real start of the app
+static NSTimeInterval ProcessStartTime(void) {
+    struct kinfo_proc info;
+    size_t size = sizeof(info);
+    int mib[] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, getpid() };
+    if (sysctl(mib, 4, &info, &size, NULL, 0) != 0) {
+        return [NSDate timeIntervalSinceReferenceDate];
+    }
+    struct timeval start = info.kp_proc.p_starttime;
+    return start.tv_sec + start.tv_usec / 1e6 - NSTimeIntervalSince1970;
+}
+
+// Connect at launch without waiting for the FCM token, which is attached to the client when it arrives
+- (void)startClient {
+    // MigratoryData client initialization
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:@"LoopbackClient"]) {
+        // Run against an in-process server, without a network, e.g. when launched with -LoopbackClient YES
+        LoopbackServer *loopbackServer = [[[LoopbackServer alloc] initWithMaxCachedMessages: 1000] autorelease];
+        client = [[LoopbackClient alloc] initWithServer: loopbackServer];
+        
+        // Keep one message in the room, so that the launch benchmark gets a first message without a network
+        MigratoryDataMessage *welcome = [[[MigratoryDataMessage alloc] init:@"/rooms/demoRoom" content:@"{\"user\":\"loopback\",\"text\":\"Welcome\"}" closure:nil qos:GUARANTEED retained:YES] autorelease];
+        [loopbackServer publish:welcome from:nil];
+    } else {
+        client = [MigratoryDataClient new];
+    }
+    
+    [client setLogLevel: LOG_INFO];
+    
+    [client setEncryption: YES];
+    
+    listener = [[SampleListener alloc] initWithMessageField:liveMessage statusField:liveStatus];
+    
+    // Share the subscriptions among the screens, replaying the retained message of the rooms already subscribed
+    subscriptionCache = [SubscriptionCache new];
+    
+    // Deliver the visible room first, rooms in background are batched or counted
+    priorityDispatcher = [[PriorityDispatcher alloc] initWithListener:subscriptionCache flushInterval:0.5];
+    
+    // Limit the delivery rate of high-rate subjects, see setConflation:forSubjects:merge:
+    conflationListener = [[ConflationListener alloc] initWithListener:priorityDispatcher];
+    
+    // Keep the state of room state subjects published as patches, see setDelta:forSubjects:
+    deltaListener = [[DeltaListener alloc] initWithListener:conflationListener];
+    
+    // Keep the chat messages in the store shared with the Notification Service Extension
+    messageStore = [[MessageStore sharedStore] retain];
+    if (messageStore == nil) {
+        // Without the app group, the store is private to the app
+        NSString *support = [NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES) firstObject];
+        messageStore = [[MessageStore alloc] initWithDirectory:[support stringByAppendingPathComponent:@"Messages"]];
+    }
+    // Count the unread messages and keep the last one of each room from the store, for a room list
+    roomSummaries = [[RoomSummaryIndex alloc] initWithStore:messageStore];
+    
+    storeListener = [[MessageStoreListener alloc] initWithListener:deltaListener store:messageStore];
+    
+    // Deliver the chat rooms in seq order while recovered and live messages interleave; the stages before it only
+    // drop exact duplicates, so late messages reach it
+    reorderBuffer = [[ReorderBuffer alloc] initWithListener:storeListener gapTimeout:2.0 maxHeld:500];
+    
+    // Drop the messages received twice, e.g. live and recovered after a failover
+    duplicateFilter = [[DuplicateFilter alloc] initWithListener:reorderBuffer];
+    
+    // Fetch only the latest page of history on subscribe, older pages are loaded on demand
+    historyPager = [[HistoryPager alloc] initWithClient:client listener:duplicateFilter pageSize:20 maxHistory:1000 pageTimeout:5.0];
+    [subscriptionCache setSubscriber: historyPager];
+    
+    // Send requests and wait for their replies, see request:timeout:completion:
+    requestReply = [[RequestReply alloc] initWithClient:client subscriptions:subscriptionCache];
+    
+    // Report the listener callbacks which block the delivery; the buffer keeps pausing while the listener is slow, as
+    // conflating or dropping would lose chat lines, which guaranteed delivery recovers after a pause
+    stallWatchdog = [[StallWatchdog alloc] initWithListener:historyPager slowThreshold:0.05 stallThreshold:1.0];
+    
+    // Count the traffic, the reconnects and the time spent in the listeners, see metricsSnapshot; placed after the
+    // inbound buffer, it times the callbacks made by its delivery queue
+    clientMetrics = [[ClientMetrics alloc] initWithListener:stallWatchdog];
+    [clientMetrics setStartTime:ProcessStartTime()];
+    
+    // Bound the messages waiting for the listener, pause the client when the listener falls behind
+    inboundBuffer = [[InboundBuffer alloc] initWithClient:client listener:clientMetrics maxMessages:5000 maxBytes:4 * 1024 * 1024 policy:OVERFLOW_PAUSE];
+    
+    // Publish through the coalescer to acknowledge guaranteed messages in batches
+    publishCoalescer = [[PublishCoalescer alloc] initWithClient:client listener:inboundBuffer maxMessages:32 maxDelay:0.02];
+    [publishCoalescer setMetrics:clientMetrics];
+    
+    // Not retained by the gauges, the buffer retains the metrics as its listener; the gauges are removed in dealloc
+    __block InboundBuffer *buffer = inboundBuffer;
+    [clientMetrics setGauge:^unsigned long long { return [buffer bufferedMessages]; } forName:@"inboundMessages"];
+    [clientMetrics setGauge:^unsigned long long { return [buffer bufferedBytes]; } forName:@"inboundBytes"];
+    [clientMetrics setGauge:^unsigned long long { return [buffer droppedCount]; } forName:@"inboundDropped"];
+    __block ConflationListener *conflation = conflationListener;
+    [clientMetrics setGauge:^unsigned long long { return [conflation conflatedCount]; } forName:@"conflated"];
+    __block DuplicateFilter *duplicates = duplicateFilter;
+    [clientMetrics setGauge:^unsigned long long { return [duplicates duplicateCount]; } forName:@"duplicates"];
+    __block ReorderBuffer *reorder = reorderBuffer;
+    [clientMetrics setGauge:^unsigned long long { return [reorder lateDroppedCount]; } forName:@"lateDropped"];
+    __block StallWatchdog *watchdog = stallWatchdog;
+    [clientMetrics setGauge:^unsigned long long { return [watchdog slowCount]; } forName:@"slowCallbacks"];
+    
+    // Probe the connection when it is idle in foreground, to detect a dead connection quickly; the server entitles
+    // publishes on the probe subject, which has no subscribers
+    connectionProbe = [[ConnectionProbe alloc] initWithClient:client listener:publishCoalescer subject:@"/probe" interval:[self probeInterval] timeout:5];
+    
+    // Record what the client receives when the RecordSession setting is on, to replay it with SessionReplayer
+    NSString *caches = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) firstObject];
+    sessionRecorder = [[SessionRecorder alloc] initWithListener:connectionProbe path:[caches stringByAppendingPathComponent:@"session.trace"] maxFileSize:4 * 1024 * 1024 maxFiles:4];
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:@"RecordSession"]) {
+        [sessionRecorder startRecording];
+    }
+    [client setListener: sessionRecorder];
+    
+    [client setServers: serverList];
+    
+    subjectList = [NSMutableArray new];
+    [subjectList addObject: @"/rooms/demoRoom"];
+    [priorityDispatcher setPriority: PRIORITY_FOREGROUND forSubjects: subjectList];
+    [reorderBuffer setReorderingForSubjects: subjectList];
+    [storeListener setStoredSubjects: subjectList];
+    [roomSummaries setSummarizedSubjects: subjectList];
+    [subscriptionCache addSubscriber: listener forSubjects: subjectList];
+    
+    // Show the history of the room from the store, the new messages are added as they are stored
+    timeline = [[ChatTimelineController alloc] initWithStore:messageStore subject:[subjectList objectAtIndex:0]];
+    
+    [client connect];
+    
+    [connectionProbe start];
+}
+
 - (BOOL)application:(UIApplication *)application didFinishLaunchingWithOptions:(NSDictionary *)launchOptions {
     NSLog(@"#### didFinishLaunchingWithOptions");
     
+    serverList = [NSMutableArray new];
+    [serverList addObject: @"demo.migratorydata.com:443"];
+    
+    // Resolve the cluster servers in background while the app starts, so DNS is not on the connect path
+    addressCache = [[ServerAddressCache alloc] initWithTTL:300];
+    [addressCache prefetchServers: serverList];
+    
+    // The notification delegate must be set before launch finishes, to receive the response which launched the app
+    if ([UNUserNotificationCenter class] != nil) {
+        [UNUserNotificationCenter currentNotificationCenter].delegate = self;
+    }
+    
+    // Found by the launch benchmark, which waits for the first message to be shown
+    liveMessage.accessibilityIdentifier = @"liveMessage";
+    
+    [self startClient];
+    
+    window.rootViewController = [[UIViewController alloc]initWithNibName:nil bundle:nil];;
+    
+    // The timeline fills the window below the status and message fields
+    UIView *rootView = window.rootViewController.view;
+    [window.rootViewController addChildViewController:timeline];
+    CGFloat top = CGRectGetMaxY(liveMessage.frame) + 16;
+    timeline.view.frame = CGRectMake(0, top, rootView.bounds.size.width, rootView.bounds.size.height - top);
+    timeline.view.autoresizingMask = UIViewAutoresizingFlexibleWidth | UIViewAutoresizingFlexibleHeight;
+    [rootView addSubview:timeline.view];
+    [timeline didMoveToParentViewController:window.rootViewController];
+    
+    [window makeKeyAndVisible];
+    
+    // Firebase must be configured on the main thread, where it would delay the first message shown: it is configured
+    // once that message is shown, or after FIREBASE_DELAY seconds without one. The client connects without the FCM
+    // token, see startClient
+    [listener setFirstMessageHandler:^{
+        [self configureNotificationsOnce];
+    }];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(FIREBASE_DELAY * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        [self configureNotificationsOnce];
+    });
+    
+    return YES;
+}
+
+// Called on the main thread.
+- (void)configureNotificationsOnce {
+    if (!notificationsConfigured) {
+        notificationsConfigured = YES;
+        [self configureNotifications:[UIApplication sharedApplication]];
+    }
+}
+
+- (void)configureNotifications:(UIApplication *)application {
     // [START configure_firebase]
     [FIRApp configure];
     // [END configure_firebase]
@@ -32,8 +220,7 @@
     // [START register_for_notifications]
     if ([UNUserNotificationCenter class] != nil) {
         // iOS 10 or later
-        // For iOS 10 display notification (sent via APNS)
-        [UNUserNotificationCenter currentNotificationCenter].delegate = self;
+        // For iOS 10 display notification (sent via APNS), the delegate is set in didFinishLaunchingWithOptions
         UNAuthorizationOptions authOptions = UNAuthorizationOptionAlert |
         UNAuthorizationOptionSound | UNAuthorizationOptionBadge;
         [[UNUserNotificationCenter currentNotificationCenter]
@@ -52,21 +239,38 @@
     
     [application registerForRemoteNotifications];
     // [END register_for_notifications]
-    
-    
-    window.rootViewController = [[UIViewController alloc]initWithNibName:nil bundle:nil];;
-    [window makeKeyAndVisible];
-    
-    return YES;
 }
 
 
+// The heartbeat of the connection probe: the ProbeInterval setting, 30 seconds by default, four times longer in Low
+// Power Mode.
+- (NSTimeInterval)probeInterval {
+    NSTimeInterval interval = [[NSUserDefaults standardUserDefaults] doubleForKey:@"ProbeInterval"];
+    if (interval <= 0) {
+        interval = 30;
+    }
+    return [[NSProcessInfo processInfo] isLowPowerModeEnabled] ? 4 * interval : interval;
+}
+
 - (void)applicationWillEnterForeground:(UIApplication *)application {
     NSLog(@"#### applicationWillEnterForeground");
 
+    // Refresh the expired DNS entries before reconnecting
+    [addressCache prefetchServers: serverList];
+    
+    // Count the messages stored by the Notification Service Extension while suspended
+    [roomSummaries refresh];
+    
     if (client != nil)
     {
-        [client resume];
+        [inboundBuffer resumeClient];
+        // Low Power Mode may have changed while in background
+        [connectionProbe setInterval:[self probeInterval] timeout:5];
+        [connectionProbe start];
+    }
+    
+    if ([[NSUserDefaults standardUserDefaults] boolForKey:@"RecordSession"]) {
+        [sessionRecorder startRecording];
     }
 }
 
@@ -75,22 +279,119 @@
 
     if (client != nil)
     {
-        [client pause];
+        [connectionProbe stop];
+        [inboundBuffer pauseClient];
     }
+    
+    [roomSummaries save];
+    
+    // Write the buffered records, the app may be suspended or killed from now on
+    [sessionRecorder stopRecording];
 }
 
 - (void)applicationWillTerminate:(UIApplication *)application {
     NSLog(@"#### applicationWillTerminate");
+    
+    [sessionRecorder stopRecording];
 }
 
 - (void)dealloc {
     NSLog(@"#### dealloc");
     
+    // The gauges sample the stages released below
+    [clientMetrics removeGauges];
+    
     if (listener != nil) {
         [listener release];
         listener = nil;
     }
     
+    if (timeline != nil) {
+        [timeline release];
+        timeline = nil;
+    }
+    
+    if (requestReply != nil) {
+        [requestReply close];
+        [requestReply release];
+        requestReply = nil;
+    }
+    
+    if (subscriptionCache != nil) {
+        [subscriptionCache release];
+        subscriptionCache = nil;
+    }
+    
+    if (priorityDispatcher != nil) {
+        [priorityDispatcher release];
+        priorityDispatcher = nil;
+    }
+    
+    if (sessionRecorder != nil) {
+        [sessionRecorder release];
+        sessionRecorder = nil;
+    }
+    
+    if (connectionProbe != nil) {
+        [connectionProbe release];
+        connectionProbe = nil;
+    }
+    
+    if (clientMetrics != nil) {
+        [clientMetrics release];
+        clientMetrics = nil;
+    }
+    
+    if (publishCoalescer != nil) {
+        [publishCoalescer release];
+        publishCoalescer = nil;
+    }
+    
+    if (inboundBuffer != nil) {
+        [inboundBuffer release];
+        inboundBuffer = nil;
+    }
+    
+    if (stallWatchdog != nil) {
+        [stallWatchdog release];
+        stallWatchdog = nil;
+    }
+    
+    if (duplicateFilter != nil) {
+        [duplicateFilter release];
+        duplicateFilter = nil;
+    }
+    
+    if (reorderBuffer != nil) {
+        [reorderBuffer release];
+        reorderBuffer = nil;
+    }
+    
+    if (roomSummaries != nil) {
+        [roomSummaries release];
+        roomSummaries = nil;
+    }
+    
+    if (storeListener != nil) {
+        [storeListener release];
+        storeListener = nil;
+    }
+    
+    if (deltaListener != nil) {
+        [deltaListener release];
+        deltaListener = nil;
+    }
+    
+    if (conflationListener != nil) {
+        [conflationListener release];
+        conflationListener = nil;
+    }
+    
+    if (historyPager != nil) {
+        [historyPager release];
+        historyPager = nil;
+    }
+    
     if (client != nil) {
         [client dispose];
         [client release];
@@ -101,6 +402,10 @@
 
     [serverList release];
     
+    [addressCache release];
+    
+    [messageStore release];
+    
     [liveMessage release];
     
     [liveStatus release];
@@ -110,6 +415,17 @@
     [super dealloc];
 }
 
+// A chat message pushed through FCM can also be received by the client, the plugin adds its subject, seq and epoch
+// to the push data
+- (BOOL)isDuplicatePush:(NSDictionary *)userInfo {
+    NSString *subject = userInfo[@"subject"];
+    if (duplicateFilter == nil || subject == nil || userInfo[@"seq"] == nil || userInfo[@"epoch"] == nil) {
+        return NO;
+    }
+    
+    return [duplicateFilter checkDuplicatePushSubject:subject seq:[userInfo[@"seq"] intValue] epoch:[userInfo[@"epoch"] intValue]];
+}
+
 // [START receive_message]
 - (void)application:(UIApplication *)application didReceiveRemoteNotification:(NSDictionary *)userInfo {
     // If you are receiving a notification message while your app is in the background,
@@ -124,6 +440,14 @@
     //    NSLog(@"Message ID: %@", userInfo[kGCMMessageIDKey]);
     //}
     
+    if ([self isDuplicatePush:userInfo]) {
+        NSLog(@"Duplicate push ignored: %@", userInfo);
+        return;
+    }
+    
+    // Store the chat message when the extension did not, so it is local when the room is opened
+    [[[[ChatPush alloc] initWithPayload:userInfo] autorelease] storeIn:messageStore completion:nil];
+    
     // Print full message.
     NSLog(@"%@", userInfo);
 }
@@ -142,10 +466,25 @@ fetchCompletionHandler:(void (^)(UIBackgroundFetchResult))completionHandler {
     //    NSLog(@"Message ID: %@", userInfo[kGCMMessageIDKey]);
     //}
     
+    if ([self isDuplicatePush:userInfo]) {
+        NSLog(@"Duplicate push ignored: %@", userInfo);
+        completionHandler(UIBackgroundFetchResultNoData);
+        return;
+    }
+    
     // Print full message.
     NSLog(@"%@", userInfo);
     
-    completionHandler(UIBackgroundFetchResultNewData);
+    // Store the chat message when the extension did not, so it is local when the room is opened; the app may be
+    // suspended once the handler is called
+    ChatPush *push = [[[ChatPush alloc] initWithPayload:userInfo] autorelease];
+    if (push == nil) {
+        completionHandler(UIBackgroundFetchResultNoData);
+        return;
+    }
+    [push storeIn:messageStore completion:^(BOOL stored) {
+        completionHandler(stored ? UIBackgroundFetchResultNewData : UIBackgroundFetchResultNoData);
+    }];
 }
 // [END receive_message]
 
@@ -199,29 +538,8 @@ didReceiveNotificationResponse:(UNNotificationResponse *)response
     // TODO: If necessary send token to application server.
     // Note: This callback is fired at each app startup and whenever a new token is generated.
     
-    
-    
-    // MigratoryData client initialization
-    client = [MigratoryDataClient new];
-    
-    [client setLogLevel: LOG_INFO];
-    
+    // Attach the token to the client already connected at launch
     [client setExternalToken: fcmToken];
-    
-    [client setEncryption: YES];
-    
-    listener = [[SampleListener alloc] initWithMessageField:liveMessage statusField:liveStatus];
-    [client setListener: listener];
-    
-    serverList = [NSMutableArray new];
-    [serverList addObject: @"demo.migratorydata.com:443"];
-    [client setServers: serverList];
-    
-    subjectList = [NSMutableArray new];
-    [subjectList addObject: @"/rooms/demoRoom"];
-    [client subscribe: subjectList];
-    
-    [client connect];
 }
 // [END refresh_token]
 
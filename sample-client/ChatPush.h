@@ -0,0 +1,53 @@
+#import <Foundation/Foundation.h>
+#import <UserNotifications/UserNotifications.h>
+
+#import "MessageStore.h"
+
+/**
+ * A chat message received as the data of a push notification sent by the MigratoryData FCM plugin.
+ *
+ * Decoding needs only Foundation and the MessageStore, without starting a client, so it fits the memory and time
+ * limits of a Notification Service Extension. In didReceiveNotificationRequest:withContentHandler: the extension
+ * decodes the payload, stores the message in the shared store and shows it in the notification, as NotificationService
+ * does:
+ *
+ *     ChatPush *push = [[[ChatPush alloc] initWithPayload: request.content.userInfo] autorelease];
+ *     UNMutableNotificationContent *content = [[request.content mutableCopy] autorelease];
+ *     [push applyToContent: content];
+ *     [push storeIn: [MessageStore sharedStore] completion: ^(BOOL stored) {
+ *         contentHandler(content);
+ *     }];
+ *
+ * When the app opens, the messages received by push are already in the store.
+ */
+@interface ChatPush : NSObject {
+    NSString *subject;
+    NSString *content;
+    int seq;
+    int epoch;
+}
+
+/**
+ * Decode the payload of a push notification.
+ *
+ * @return nil if the payload does not carry a chat message, i.e. a subject, a seq, an epoch and a content
+ */
+- (id) initWithPayload: (NSDictionary *)userInfo;
+
+- (NSString *) subject;
+- (NSString *) content;
+- (int) seq;
+- (int) epoch;
+
+/**
+ * Append the message to the store on a background queue, unless it is already stored, and post
+ * MESSAGE_STORE_DID_APPEND if it was written. The completion, which may be nil, is called on the main queue.
+ */
+- (void) storeIn: (MessageStore *)store completion: (void (^)(BOOL stored))completion;
+
+/**
+ * Show the room as the title and the chat text as the body of the notification.
+ */
+- (void) applyToContent: (UNMutableNotificationContent *)notificationContent;
+
+@end
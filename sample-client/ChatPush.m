@@ -0,0 +1,90 @@
+#import "ChatPush.h"
+#import "JSONFieldExtractor.h"
+
+@implementation ChatPush
+
+- (id) initWithPayload: (NSDictionary *)userInfo {
+
+    // FCM data values are strings, the seq and epoch are parsed from them
+    id subjectValue = userInfo[@"subject"];
+    id contentValue = userInfo[@"content"];
+    id seqValue = userInfo[@"seq"];
+    id epochValue = userInfo[@"epoch"];
+    if (![subjectValue isKindOfClass: [NSString class]] || ![contentValue isKindOfClass: [NSString class]]
+            || ![seqValue respondsToSelector: @selector(intValue)] || ![epochValue respondsToSelector: @selector(intValue)]) {
+        [self release];
+        return nil;
+    }
+
+    self = [super init];
+    if (self != nil) {
+        subject = [subjectValue copy];
+        content = [contentValue copy];
+        seq = [seqValue intValue];
+        epoch = [epochValue intValue];
+    }
+
+    return self;
+}
+
+- (NSString *) subject {
+    return subject;
+}
+
+- (NSString *) content {
+    return content;
+}
+
+- (int) seq {
+    return seq;
+}
+
+- (int) epoch {
+    return epoch;
+}
+
+- (void) storeIn: (MessageStore *)store completion: (void (^)(BOOL stored))completion {
+    // The file lock may be held by the extension or the store listener, the caller does not wait for it
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        StoredMessage *message = [[StoredMessage alloc] initWithContent: content seq: seq epoch: epoch time: [NSDate timeIntervalSinceReferenceDate]];
+        NSUInteger firstIndex;
+        BOOL stored = [store appendMessages: [NSArray arrayWithObject: message] subject: subject firstIndex: &firstIndex] == 1;
+        [message release];
+
+        if (stored) {
+            NSDictionary *info = [NSDictionary dictionaryWithObjectsAndKeys: subject, MESSAGE_STORE_SUBJECT,
+                [NSNumber numberWithUnsignedInteger: firstIndex], MESSAGE_STORE_FIRST_INDEX, nil];
+            [[NSNotificationCenter defaultCenter] postNotificationName: MESSAGE_STORE_DID_APPEND object: store userInfo: info];
+        }
+        if (completion != nil) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(stored);
+            });
+        }
+    });
+}
+
+- (void) applyToContent: (UNMutableNotificationContent *)notificationContent {
+    const char *keys[] = { "user", "text" };
+    NSString *fields[2];
+    JSONStringFields(content, keys, fields, 2);
+    NSString *user = fields[0], *text = fields[1];
+
+    notificationContent.title = [subject lastPathComponent];
+    if (user != nil && text != nil) {
+        notificationContent.body = [NSString stringWithFormat: @"%@: %@", user, text];
+    } else if (text != nil) {
+        notificationContent.body = text;
+    } else {
+        notificationContent.body = content;
+    }
+}
+
+- (void) dealloc {
+    [content release];
+    [subject release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,38 @@
+#import <Foundation/Foundation.h>
+#import <UIKit/UIKit.h>
+
+#import "MessageStore.h"
+
+/**
+ * A scrollable timeline of the messages of a chat room, read from the MessageStore.
+ *
+ * Only the rows on screen exist: the messages are read from the store in windows of fixed size, and the height of each
+ * row is computed once and kept in a bounded cache, so memory does not grow with the size of the room. The main thread
+ * never reads the store: the windows are read on a private queue, ahead of the scrolling through table prefetching, and
+ * a row whose window is not read yet is shown empty and reloaded when it is. The controller follows the
+ * MESSAGE_STORE_DID_APPEND notifications of its store, counting the messages on the posting queue: the new rows are
+ * inserted in one batch per burst, without reloading the rows already shown, and the table is reloaded only when a
+ * message was stored before the rows already shown.
+ */
+@interface ChatTimelineController : UIViewController <UITableViewDataSource, UITableViewDataSourcePrefetching, UITableViewDelegate> {
+    MessageStore *store;
+    NSString *subject;
+    UITableView *tableView;
+
+    NSUInteger messageCount;
+    NSMutableDictionary *windows;
+    NSMutableSet *loadingWindows;
+    NSUInteger generation;
+    NSCache *rowHeights;
+    UIFont *font;
+
+    BOOL refreshScheduled;
+    NSUInteger storedCount;
+    NSUInteger firstChanged;
+
+    dispatch_queue_t queue;
+}
+
+- (id) initWithStore: (MessageStore *)aStore subject: (NSString *)aSubject;
+
+@end
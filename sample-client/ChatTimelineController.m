@@ -0,0 +1,304 @@
+#import "ChatTimelineController.h"
+#import "JSONFieldExtractor.h"
+
+// Messages read from the store at once, the rows are split into windows of this size
+#define TIMELINE_WINDOW 200
+
+// Windows kept in memory, the farthest from the last one read are dropped first
+#define TIMELINE_WINDOWS_KEPT 8
+
+// Row heights kept, well above the rows on screen
+#define TIMELINE_HEIGHTS 2000
+
+// New messages arriving within this time are inserted together
+#define TIMELINE_BATCH_DELAY 0.05
+
+// Above this many new rows the table is reloaded rather than animated
+#define TIMELINE_MAX_INSERT 500
+
+#define TIMELINE_PADDING 16
+
+static NSString *TimelineCellIdentifier = @"message";
+
+@interface ChatTimelineController ()
+- (NSString *) textAtIndex: (NSUInteger)index;
+- (void) loadWindow: (NSUInteger)window;
+- (void) didLoadWindow: (NSUInteger)window messages: (NSArray *)messages generation: (NSUInteger)loadGeneration;
+- (void) discardWindowsFrom: (NSUInteger)window;
+- (void) noteCount: (NSUInteger)count firstChanged: (NSUInteger)index;
+- (void) refresh;
+- (void) storeDidAppend: (NSNotification *)notification;
+@end
+
+@implementation ChatTimelineController
+
+- (id) initWithStore: (MessageStore *)aStore subject: (NSString *)aSubject {
+
+    self = [super initWithNibName: nil bundle: nil];
+    if (self != nil) {
+        store = [aStore retain];
+        subject = [aSubject copy];
+        windows = [NSMutableDictionary new];
+        loadingWindows = [NSMutableSet new];
+        rowHeights = [NSCache new];
+        [rowHeights setCountLimit: TIMELINE_HEIGHTS];
+        font = [[UIFont systemFontOfSize: 15] retain];
+        firstChanged = NSNotFound;
+        queue = dispatch_queue_create("com.migratorydata.samples.chat.timeline", DISPATCH_QUEUE_SERIAL);
+        [[NSNotificationCenter defaultCenter] addObserver: self selector: @selector(storeDidAppend:) name: MESSAGE_STORE_DID_APPEND object: store];
+    }
+
+    return self;
+}
+
+- (void) loadView {
+    tableView = [[UITableView alloc] initWithFrame: CGRectZero style: UITableViewStylePlain];
+    tableView.dataSource = self;
+    tableView.prefetchDataSource = self;
+    tableView.delegate = self;
+    // Rows off screen are not measured
+    tableView.estimatedRowHeight = 44;
+    [tableView registerClass: [UITableViewCell class] forCellReuseIdentifier: TimelineCellIdentifier];
+    self.view = tableView;
+
+    // The rows of the messages already stored are added once counted
+    [self retain];
+    dispatch_async(queue, ^{
+        [self noteCount: [store countForSubject: subject] firstChanged: 0];
+        [self release];
+    });
+}
+
+- (void) viewDidAppear: (BOOL)animated {
+    [super viewDidAppear: animated];
+
+    if (messageCount > 0) {
+        [tableView scrollToRowAtIndexPath: [NSIndexPath indexPathForRow: messageCount - 1 inSection: 0] atScrollPosition: UITableViewScrollPositionBottom animated: NO];
+    }
+}
+
+- (void) viewWillTransitionToSize: (CGSize)size withTransitionCoordinator: (id<UIViewControllerTransitionCoordinator>)coordinator {
+    [super viewWillTransitionToSize: size withTransitionCoordinator: coordinator];
+
+    // The heights depend on the width
+    [rowHeights removeAllObjects];
+}
+
+// The text of a row, or nil while its window is being read; called on the main thread.
+- (NSString *) textAtIndex: (NSUInteger)index {
+    NSUInteger window = index / TIMELINE_WINDOW;
+    NSArray *messages = [windows objectForKey: [NSNumber numberWithUnsignedInteger: window]];
+    if (messages == nil) {
+        [self loadWindow: window];
+        return nil;
+    }
+    if (index - window * TIMELINE_WINDOW >= [messages count]) {
+        return @"";
+    }
+
+    NSString *content = [[messages objectAtIndex: index - window * TIMELINE_WINDOW] content];
+    const char *keys[] = { "user", "text" };
+    NSString *fields[2];
+    JSONStringFields(content, keys, fields, 2);
+    NSString *user = fields[0], *text = fields[1];
+    if (user != nil && text != nil) {
+        return [NSString stringWithFormat: @"%@: %@", user, text];
+    }
+    return content != nil ? content : @"";
+}
+
+// Read a window on the queue unless it is read or being read; called on the main thread.
+- (void) loadWindow: (NSUInteger)window {
+    NSNumber *key = [NSNumber numberWithUnsignedInteger: window];
+    if ([windows objectForKey: key] != nil || [loadingWindows containsObject: key]) {
+        return;
+    }
+    [loadingWindows addObject: key];
+
+    NSUInteger loadGeneration = generation;
+    [self retain];
+    dispatch_async(queue, ^{
+        NSArray *messages = [store messagesForSubject: subject range: NSMakeRange(window * TIMELINE_WINDOW, TIMELINE_WINDOW)];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self didLoadWindow: window messages: messages generation: loadGeneration];
+            [self release];
+        });
+    });
+}
+
+- (void) didLoadWindow: (NSUInteger)window messages: (NSArray *)messages generation: (NSUInteger)loadGeneration {
+    NSNumber *key = [NSNumber numberWithUnsignedInteger: window];
+    if (loadGeneration != generation) {
+        // Read before the rows moved, it is read again when needed
+        return;
+    }
+    [loadingWindows removeObject: key];
+    [windows setObject: messages forKey: key];
+
+    while ([windows count] > TIMELINE_WINDOWS_KEPT) {
+        NSNumber *farthest = nil;
+        for (NSNumber *kept in windows) {
+            NSUInteger distance = (NSUInteger)labs((long)[kept unsignedIntegerValue] - (long)window);
+            if (farthest == nil || distance > (NSUInteger)labs((long)[farthest unsignedIntegerValue] - (long)window)) {
+                farthest = kept;
+            }
+        }
+        [windows removeObjectForKey: farthest];
+    }
+
+    // Show the rows which were displayed empty
+    NSMutableArray *rows = [NSMutableArray array];
+    for (NSIndexPath *indexPath in [tableView indexPathsForVisibleRows]) {
+        if ((NSUInteger)indexPath.row / TIMELINE_WINDOW == window) {
+            [rows addObject: indexPath];
+        }
+    }
+    if ([rows count] > 0) {
+        [tableView reloadRowsAtIndexPaths: rows withRowAnimation: UITableViewRowAnimationNone];
+    }
+}
+
+// Forget the windows from the given one on, and the reads in progress; called on the main thread.
+- (void) discardWindowsFrom: (NSUInteger)window {
+    for (NSNumber *key in [windows allKeys]) {
+        if ([key unsignedIntegerValue] >= window) {
+            [windows removeObjectForKey: key];
+        }
+    }
+    [loadingWindows removeAllObjects];
+    generation++;
+}
+
+- (void) tableView: (UITableView *)aTableView prefetchRowsAtIndexPaths: (NSArray *)indexPaths {
+    for (NSIndexPath *indexPath in indexPaths) {
+        if ((NSUInteger)indexPath.row < messageCount) {
+            [self loadWindow: indexPath.row / TIMELINE_WINDOW];
+        }
+    }
+}
+
+- (NSInteger) tableView: (UITableView *)aTableView numberOfRowsInSection: (NSInteger)section {
+    return messageCount;
+}
+
+- (UITableViewCell *) tableView: (UITableView *)aTableView cellForRowAtIndexPath: (NSIndexPath *)indexPath {
+    UITableViewCell *cell = [aTableView dequeueReusableCellWithIdentifier: TimelineCellIdentifier forIndexPath: indexPath];
+    cell.selectionStyle = UITableViewCellSelectionStyleNone;
+    cell.textLabel.font = font;
+    cell.textLabel.numberOfLines = 0;
+    NSString *text = [self textAtIndex: indexPath.row];
+    cell.textLabel.text = text != nil ? text : @"";
+    return cell;
+}
+
+- (CGFloat) tableView: (UITableView *)aTableView heightForRowAtIndexPath: (NSIndexPath *)indexPath {
+    NSNumber *key = [NSNumber numberWithInteger: indexPath.row];
+    NSNumber *height = [rowHeights objectForKey: key];
+    if (height == nil) {
+        NSString *text = [self textAtIndex: indexPath.row];
+        if (text == nil) {
+            // Measured when the window is read and the row reloaded
+            return aTableView.estimatedRowHeight;
+        }
+        CGFloat width = aTableView.bounds.size.width - 2 * TIMELINE_PADDING;
+        CGRect bounds = [text boundingRectWithSize: CGSizeMake(MAX(width, 1), CGFLOAT_MAX)
+            options: NSStringDrawingUsesLineFragmentOrigin attributes: @{ NSFontAttributeName: font } context: nil];
+        height = [NSNumber numberWithDouble: ceil(bounds.size.height) + TIMELINE_PADDING];
+        [rowHeights setObject: height forKey: key];
+    }
+    return [height doubleValue];
+}
+
+// Record the count read off the main thread and refresh the table after a burst; called on any thread.
+- (void) noteCount: (NSUInteger)count firstChanged: (NSUInteger)index {
+    @synchronized (self) {
+        storedCount = MAX(storedCount, count);
+        firstChanged = MIN(firstChanged, index);
+        if (refreshScheduled) {
+            return;
+        }
+        refreshScheduled = YES;
+    }
+
+    [self retain];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(TIMELINE_BATCH_DELAY * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        [self refresh];
+        [self release];
+    });
+}
+
+- (void) refresh {
+    NSUInteger count;
+    NSUInteger changed;
+    @synchronized (self) {
+        refreshScheduled = NO;
+        count = storedCount;
+        changed = firstChanged;
+        firstChanged = NSNotFound;
+    }
+    if (![self isViewLoaded] || count <= messageCount) {
+        return;
+    }
+
+    // Follow the new messages only when the last row is visible
+    NSIndexPath *last = [[tableView indexPathsForVisibleRows] lastObject];
+    BOOL atBottom = messageCount == 0 || (last != nil && (NSUInteger)last.row + 1 >= messageCount);
+
+    if (changed < messageCount) {
+        // A message was stored among the rows already shown, their indexes moved
+        [self discardWindowsFrom: 0];
+        [rowHeights removeAllObjects];
+        messageCount = count;
+        [tableView reloadData];
+    } else {
+        // The last window read may miss the new messages
+        [self discardWindowsFrom: messageCount / TIMELINE_WINDOW];
+        if (count - messageCount > TIMELINE_MAX_INSERT) {
+            messageCount = count;
+            [tableView reloadData];
+        } else {
+            NSMutableArray *rows = [NSMutableArray arrayWithCapacity: count - messageCount];
+            for (NSUInteger row = messageCount; row < count; row++) {
+                [rows addObject: [NSIndexPath indexPathForRow: row inSection: 0]];
+            }
+            messageCount = count;
+            [tableView insertRowsAtIndexPaths: rows withRowAnimation: UITableViewRowAnimationNone];
+        }
+    }
+
+    if (atBottom) {
+        [tableView scrollToRowAtIndexPath: [NSIndexPath indexPathForRow: count - 1 inSection: 0] atScrollPosition: UITableViewScrollPositionBottom animated: NO];
+    }
+}
+
+// Posted on the queue of the MessageStoreListener, where the store is counted.
+- (void) storeDidAppend: (NSNotification *)notification {
+    NSDictionary *info = [notification userInfo];
+    if (![[info objectForKey: MESSAGE_STORE_SUBJECT] isEqualToString: subject]) {
+        return;
+    }
+
+    [self noteCount: [store countForSubject: subject] firstChanged: [[info objectForKey: MESSAGE_STORE_FIRST_INDEX] unsignedIntegerValue]];
+}
+
+- (void) dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver: self];
+
+    tableView.dataSource = nil;
+    tableView.prefetchDataSource = nil;
+    tableView.delegate = nil;
+    [tableView release];
+
+    dispatch_release(queue);
+
+    [font release];
+    [rowHeights release];
+    [loadingWindows release];
+    [windows release];
+    [subject release];
+    [store release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,104 @@
+#import <Foundation/Foundation.h>
+#import <stdatomic.h>
+
+#import "MigratoryDataListener.h"
+
+/**
+ * A value sampled when a snapshot is taken, e.g. the depth of a queue.
+ */
+typedef unsigned long long (^MetricsGauge)(void);
+
+typedef void (^MetricsExporter)(NSDictionary *snapshot);
+
+/**
+ * Keys of the metrics snapshot.
+ */
+extern NSString *METRIC_MESSAGES_IN;
+extern NSString *METRIC_MESSAGES_OUT;
+extern NSString *METRIC_BYTES_IN;
+extern NSString *METRIC_BYTES_OUT;
+extern NSString *METRIC_COMPRESSED_IN;
+extern NSString *METRIC_LISTENER_TIME;
+extern NSString *METRIC_LISTENER_MAX_TIME;
+extern NSString *METRIC_TIME_TO_FIRST_MESSAGE;
+extern NSString *METRIC_RECONNECTS;
+extern NSString *METRIC_SUBJECTS;
+extern NSString *METRIC_OTHER_SUBJECTS;
+extern NSString *METRIC_GAUGES;
+
+/**
+ * Count what goes through the client without a status notification per event.
+ *
+ * The counters are updated on the receive path with relaxed atomic increments and only read when a snapshot is
+ * taken; finding the counters of the subject of a message takes a lock held for one dictionary lookup. Subjects get
+ * counters of their own up to a maximum, the later ones share the counters of METRIC_OTHER_SUBJECTS. The listener
+ * time is the time spent by the listeners downstream in onMessage: and onStatus:info:, so place the metrics right
+ * after an InboundBuffer to time the callbacks of its delivery queue rather than the enqueue. The bytes
+ * are the content bytes as seen by the app, after decompression; the messages sent compressed are counted apart.
+ * Reconnects are counted by the info of NOTIFY_SERVER_DOWN and by NOTIFY_CONNECTION_STALE. Queue depths and the
+ * counters of the other stages are read through gauges.
+ */
+@interface ClientMetrics : NSObject <MigratoryDataListener> {
+    NSObject<MigratoryDataListener> *listener;
+
+    atomic_ullong messagesIn;
+    atomic_ullong messagesOut;
+    atomic_ullong bytesIn;
+    atomic_ullong bytesOut;
+    atomic_ullong compressedIn;
+    atomic_ullong listenerNanos;
+    atomic_ullong listenerMaxNanos;
+    atomic_ullong firstMessageMicros;
+    NSTimeInterval startTime;
+
+    NSMutableDictionary *subjects;
+    NSUInteger maxSubjects;
+    id otherSubjects;
+    NSMutableDictionary *reconnects;
+    NSMutableDictionary *gauges;
+
+    MetricsExporter exporter;
+    dispatch_queue_t queue;
+    dispatch_source_t timer;
+}
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener;
+
+/**
+ * The time from which METRIC_TIME_TO_FIRST_MESSAGE is measured, e.g. the launch of the process; by default the
+ * creation of the metrics.
+ */
+- (void) setStartTime: (NSTimeInterval)timeSinceReferenceDate;
+
+/**
+ * The number of subjects counted apart, 100 by default; 0 counts all subjects under METRIC_OTHER_SUBJECTS.
+ */
+- (void) setMaxSubjects: (NSUInteger)max;
+
+/**
+ * Count a message published by the app; PublishCoalescer calls it for each message when given the metrics.
+ */
+- (void) countPublish: (MigratoryDataMessage *)message;
+
+/**
+ * Add a gauge to the snapshots, or remove it when nil.
+ */
+- (void) setGauge: (MetricsGauge)gauge forName: (NSString *)name;
+
+/**
+ * Remove all the gauges, e.g. before the objects they sample are released.
+ */
+- (void) removeGauges;
+
+/**
+ * The current values: a number for each counter, and dictionaries for the reconnects by reason, the subjects (each
+ * with its messages in, messages out and bytes in) and the gauges by name.
+ */
+- (NSDictionary *) metricsSnapshot;
+
+/**
+ * Push a snapshot to the exporter at the given interval, on a private queue; a nil exporter stops the pushes.
+ */
+- (void) setExporter: (MetricsExporter)anExporter interval: (NSTimeInterval)interval;
+
+@end
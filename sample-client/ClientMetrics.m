@@ -0,0 +1,262 @@
+#import "ClientMetrics.h"
+#import "ConnectionProbe.h"
+
+#include <mach/mach_time.h>
+
+NSString *METRIC_MESSAGES_IN = @"messagesIn";
+NSString *METRIC_MESSAGES_OUT = @"messagesOut";
+NSString *METRIC_BYTES_IN = @"bytesIn";
+NSString *METRIC_BYTES_OUT = @"bytesOut";
+NSString *METRIC_COMPRESSED_IN = @"compressedIn";
+NSString *METRIC_LISTENER_TIME = @"listenerTime";
+NSString *METRIC_LISTENER_MAX_TIME = @"listenerMaxTime";
+NSString *METRIC_TIME_TO_FIRST_MESSAGE = @"timeToFirstMessage";
+NSString *METRIC_RECONNECTS = @"reconnects";
+NSString *METRIC_SUBJECTS = @"subjects";
+NSString *METRIC_OTHER_SUBJECTS = @"*";
+NSString *METRIC_GAUGES = @"gauges";
+
+// The counters of one subject, created once and then updated without locking.
+@interface SubjectMetrics : NSObject {
+@public
+    atomic_ullong messagesIn;
+    atomic_ullong messagesOut;
+    atomic_ullong bytesIn;
+}
+@end
+
+@implementation SubjectMetrics
+@end
+
+static uint64_t MachNanos(uint64_t ticks) {
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    return ticks * timebase.numer / timebase.denom;
+}
+
+static unsigned long long Load(atomic_ullong *counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+static void Add(atomic_ullong *counter, unsigned long long value) {
+    atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+@interface ClientMetrics ()
+- (SubjectMetrics *) metricsForSubject: (NSString *)subject;
+- (void) countReconnect: (NSString *)reason;
+- (void) addListenerTime: (uint64_t)start;
+@end
+
+@implementation ClientMetrics
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener {
+
+    self = [super init];
+    if (self != nil) {
+        listener = [aListener retain];
+        startTime = [NSDate timeIntervalSinceReferenceDate];
+        subjects = [NSMutableDictionary new];
+        maxSubjects = 100;
+        otherSubjects = [SubjectMetrics new];
+        reconnects = [NSMutableDictionary new];
+        gauges = [NSMutableDictionary new];
+        queue = dispatch_queue_create("com.migratorydata.samples.chat.metrics", DISPATCH_QUEUE_SERIAL);
+    }
+
+    return self;
+}
+
+- (void) setStartTime: (NSTimeInterval)timeSinceReferenceDate {
+    startTime = timeSinceReferenceDate;
+}
+
+- (void) setMaxSubjects: (NSUInteger)max {
+    @synchronized (subjects) {
+        maxSubjects = max;
+    }
+}
+
+- (SubjectMetrics *) metricsForSubject: (NSString *)subject {
+    @synchronized (subjects) {
+        SubjectMetrics *metrics = [subjects objectForKey: subject];
+        if (metrics == nil && [subjects count] >= maxSubjects) {
+            // Bound the memory taken by apps which go through many subjects
+            return otherSubjects;
+        }
+        if (metrics == nil) {
+            metrics = [[SubjectMetrics new] autorelease];
+            [subjects setObject: metrics forKey: subject];
+        }
+        return metrics;
+    }
+}
+
+- (void) countReconnect: (NSString *)reason {
+    @synchronized (reconnects) {
+        NSString *key = reason != nil ? reason : @"";
+        unsigned long long count = [[reconnects objectForKey: key] unsignedLongLongValue];
+        [reconnects setObject: [NSNumber numberWithUnsignedLongLong: count + 1] forKey: key];
+    }
+}
+
+- (void) addListenerTime: (uint64_t)start {
+    unsigned long long nanos = MachNanos(mach_absolute_time() - start);
+    Add(&listenerNanos, nanos);
+
+    unsigned long long max = Load(&listenerMaxNanos);
+    while (nanos > max && !atomic_compare_exchange_weak_explicit(&listenerMaxNanos, &max, nanos, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    unsigned long long bytes = [[message getContent] lengthOfBytesUsingEncoding: NSUTF8StringEncoding];
+    SubjectMetrics *metrics = [self metricsForSubject: [message getSubject]];
+    Add(&messagesIn, 1);
+    Add(&bytesIn, bytes);
+    Add(&metrics->messagesIn, 1);
+    Add(&metrics->bytesIn, bytes);
+    if ([message isCompressed]) {
+        Add(&compressedIn, 1);
+    }
+    if (Load(&firstMessageMicros) == 0) {
+        unsigned long long expected = 0;
+        unsigned long long micros = MAX((unsigned long long)(([NSDate timeIntervalSinceReferenceDate] - startTime) * 1000000), 1ULL);
+        atomic_compare_exchange_strong(&firstMessageMicros, &expected, micros);
+    }
+
+    uint64_t start = mach_absolute_time();
+    [listener onMessage: message];
+    [self addListenerTime: start];
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+    if ([status isEqualToString: NOTIFY_SERVER_DOWN]) {
+        [self countReconnect: info];
+    } else if ([status isEqualToString: NOTIFY_CONNECTION_STALE]) {
+        [self countReconnect: status];
+    }
+
+    uint64_t start = mach_absolute_time();
+    [listener onStatus: status info: info];
+    [self addListenerTime: start];
+}
+
+- (void) countPublish: (MigratoryDataMessage *)message {
+    Add(&messagesOut, 1);
+    Add(&bytesOut, [[message getContent] lengthOfBytesUsingEncoding: NSUTF8StringEncoding]);
+    Add(&[self metricsForSubject: [message getSubject]]->messagesOut, 1);
+}
+
+- (void) setGauge: (MetricsGauge)gauge forName: (NSString *)name {
+    @synchronized (gauges) {
+        if (gauge != nil) {
+            [gauges setObject: [[gauge copy] autorelease] forKey: name];
+        } else {
+            [gauges removeObjectForKey: name];
+        }
+    }
+}
+
+- (void) removeGauges {
+    @synchronized (gauges) {
+        [gauges removeAllObjects];
+    }
+}
+
+- (NSDictionary *) metricsSnapshot {
+    NSMutableDictionary *snapshot = [NSMutableDictionary dictionary];
+    [snapshot setObject: [NSNumber numberWithUnsignedLongLong: Load(&messagesIn)] forKey: METRIC_MESSAGES_IN];
+    [snapshot setObject: [NSNumber numberWithUnsignedLongLong: Load(&messagesOut)] forKey: METRIC_MESSAGES_OUT];
+    [snapshot setObject: [NSNumber numberWithUnsignedLongLong: Load(&bytesIn)] forKey: METRIC_BYTES_IN];
+    [snapshot setObject: [NSNumber numberWithUnsignedLongLong: Load(&bytesOut)] forKey: METRIC_BYTES_OUT];
+    [snapshot setObject: [NSNumber numberWithUnsignedLongLong: Load(&compressedIn)] forKey: METRIC_COMPRESSED_IN];
+    [snapshot setObject: [NSNumber numberWithDouble: Load(&listenerNanos) / 1e9] forKey: METRIC_LISTENER_TIME];
+    [snapshot setObject: [NSNumber numberWithDouble: Load(&listenerMaxNanos) / 1e9] forKey: METRIC_LISTENER_MAX_TIME];
+    [snapshot setObject: [NSNumber numberWithDouble: Load(&firstMessageMicros) / 1e6] forKey: METRIC_TIME_TO_FIRST_MESSAGE];
+
+    @synchronized (reconnects) {
+        [snapshot setObject: [[reconnects copy] autorelease] forKey: METRIC_RECONNECTS];
+    }
+
+    NSMutableDictionary *subjectSnapshots = [NSMutableDictionary dictionary];
+    @synchronized (subjects) {
+        NSMutableArray *names = [NSMutableArray arrayWithArray: [subjects allKeys]];
+        SubjectMetrics *other = otherSubjects;
+        if (Load(&other->messagesIn) > 0 || Load(&other->messagesOut) > 0) {
+            [names addObject: METRIC_OTHER_SUBJECTS];
+        }
+        for (NSString *subject in names) {
+            SubjectMetrics *metrics = [subject isEqualToString: METRIC_OTHER_SUBJECTS] ? other : [subjects objectForKey: subject];
+            [subjectSnapshots setObject: [NSDictionary dictionaryWithObjectsAndKeys:
+                [NSNumber numberWithUnsignedLongLong: Load(&metrics->messagesIn)], METRIC_MESSAGES_IN,
+                [NSNumber numberWithUnsignedLongLong: Load(&metrics->messagesOut)], METRIC_MESSAGES_OUT,
+                [NSNumber numberWithUnsignedLongLong: Load(&metrics->bytesIn)], METRIC_BYTES_IN, nil] forKey: subject];
+        }
+    }
+    [snapshot setObject: subjectSnapshots forKey: METRIC_SUBJECTS];
+
+    // Sample the gauges outside the lock, they may take locks of their own
+    NSDictionary *gaugeBlocks;
+    @synchronized (gauges) {
+        gaugeBlocks = [[gauges copy] autorelease];
+    }
+    NSMutableDictionary *gaugeValues = [NSMutableDictionary dictionary];
+    for (NSString *name in gaugeBlocks) {
+        MetricsGauge gauge = [gaugeBlocks objectForKey: name];
+        [gaugeValues setObject: [NSNumber numberWithUnsignedLongLong: gauge()] forKey: name];
+    }
+    [snapshot setObject: gaugeValues forKey: METRIC_GAUGES];
+
+    return snapshot;
+}
+
+- (void) setExporter: (MetricsExporter)anExporter interval: (NSTimeInterval)interval {
+    dispatch_async(queue, ^{
+        if (timer != NULL) {
+            dispatch_source_cancel(timer);
+            dispatch_release(timer);
+            timer = NULL;
+        }
+        [exporter release];
+        exporter = [anExporter copy];
+        if (exporter == nil || interval <= 0) {
+            return;
+        }
+
+        __block ClientMetrics *blockSelf = self;
+        uint64_t nanos = (uint64_t)(interval * NSEC_PER_SEC);
+        timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+        dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, nanos), nanos, nanos / 10);
+        dispatch_source_set_event_handler(timer, ^{
+            @autoreleasepool {
+                blockSelf->exporter([blockSelf metricsSnapshot]);
+            }
+        });
+        dispatch_resume(timer);
+    });
+}
+
+- (void) dealloc {
+    dispatch_sync(queue, ^{
+        if (timer != NULL) {
+            dispatch_source_cancel(timer);
+            dispatch_release(timer);
+            timer = NULL;
+        }
+    });
+    dispatch_release(queue);
+
+    [exporter release];
+    [gauges release];
+    [reconnects release];
+    [otherSubjects release];
+    [subjects release];
+    [listener release];
+
+    [super dealloc];
+}
+
+@end
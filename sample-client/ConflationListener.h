@@ -0,0 +1,39 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataListener.h"
+
+/**
+ * Merge a held message with a newer message of the same subject into the message to be delivered.
+ */
+typedef MigratoryDataMessage *(^ConflationMerge)(MigratoryDataMessage *held, MigratoryDataMessage *next);
+
+/**
+ * Limit the delivery rate of high-rate subjects.
+ *
+ * For a conflated subject at most maxPerSecond messages are delivered to the downstream listener. Messages received
+ * in between are conflated into one held message: the latest one is kept, or the held and the new message are
+ * combined by the merge block. A SNAPSHOT discards the held updates, and a held SNAPSHOT is never replaced by an
+ * UPDATE, it is delivered first. HISTORICAL messages are never conflated.
+ */
+@interface ConflationListener : NSObject <MigratoryDataListener> {
+    NSObject<MigratoryDataListener> *listener;
+
+    NSMutableDictionary *windows;
+    unsigned long long conflatedTotal;
+
+    dispatch_queue_t queue;
+}
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener;
+
+/**
+ * Conflate the subjects to at most maxPerSecond deliveries per second; pass a nil merge block to keep the latest
+ * message. A rate of 0 disables conflation for the subjects.
+ */
+- (void) setConflation: (double)maxPerSecond forSubjects: (NSArray *)subjects merge: (ConflationMerge)merge;
+
+- (unsigned long long) conflatedCountForSubject: (NSString *)subject;
+
+- (unsigned long long) conflatedCount;
+
+@end
@@ -0,0 +1,159 @@
+#import "ConflationListener.h"
+
+// Conflation state for one subject.
+@interface ConflationWindow : NSObject {
+@public
+    NSTimeInterval interval;
+    ConflationMerge merge;
+
+    NSTimeInterval lastDelivery;
+    MigratoryDataMessage *held;
+    unsigned long long conflated;
+}
+@end
+
+@implementation ConflationWindow
+
+- (void) dealloc {
+    [held release];
+    [merge release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface ConflationListener ()
+- (void) deliverHeld: (ConflationWindow *)window;
+@end
+
+@implementation ConflationListener
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener {
+
+    self = [super init];
+    if (self != nil) {
+        listener = [aListener retain];
+        windows = [NSMutableDictionary new];
+        queue = dispatch_queue_create("com.migratorydata.samples.chat.conflation", DISPATCH_QUEUE_SERIAL);
+    }
+
+    return self;
+}
+
+- (void) setConflation: (double)maxPerSecond forSubjects: (NSArray *)subjects merge: (ConflationMerge)merge {
+    dispatch_sync(queue, ^{
+        for (NSString *subject in subjects) {
+            ConflationWindow *window = [windows objectForKey: subject];
+            if (maxPerSecond <= 0) {
+                if (window != nil) {
+                    [self deliverHeld: window];
+                    [windows removeObjectForKey: subject];
+                }
+                continue;
+            }
+
+            if (window == nil) {
+                window = [[ConflationWindow new] autorelease];
+                [windows setObject: window forKey: subject];
+            }
+            window->interval = 1.0 / maxPerSecond;
+            [window->merge release];
+            window->merge = [merge copy];
+        }
+    });
+}
+
+- (unsigned long long) conflatedCountForSubject: (NSString *)subject {
+    __block unsigned long long count = 0;
+    dispatch_sync(queue, ^{
+        ConflationWindow *window = [windows objectForKey: subject];
+        if (window != nil) {
+            count = window->conflated;
+        }
+    });
+    return count;
+}
+
+- (unsigned long long) conflatedCount {
+    __block unsigned long long count;
+    dispatch_sync(queue, ^{
+        count = conflatedTotal;
+    });
+    return count;
+}
+
+// Must be called on the queue.
+- (void) deliverHeld: (ConflationWindow *)window {
+    if (window->held == nil) {
+        return;
+    }
+
+    MigratoryDataMessage *message = [window->held autorelease];
+    window->held = nil;
+    window->lastDelivery = [NSDate timeIntervalSinceReferenceDate];
+
+    [listener onMessage: message];
+}
+
+- (void)onMessage:(MigratoryDataMessage *)message {
+    dispatch_sync(queue, ^{
+        ConflationWindow *window = [windows objectForKey: [message getSubject]];
+        if (window == nil || [message getMessageType] == HISTORICAL) {
+            [listener onMessage: message];
+            return;
+        }
+
+        NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+        NSTimeInterval wait = window->lastDelivery + window->interval - now;
+
+        if (window->held == nil) {
+            if (wait <= 0) {
+                window->lastDelivery = now;
+                [listener onMessage: message];
+                return;
+            }
+
+            window->held = [message retain];
+
+            [window retain];
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(wait * NSEC_PER_SEC)), queue, ^{
+                [self deliverHeld: window];
+                [window release];
+            });
+            return;
+        }
+
+        if ([message getMessageType] == UPDATE && [window->held getMessageType] == SNAPSHOT && window->merge == nil) {
+            // Do not lose the held snapshot to an update, deliver it ahead of time
+            [self deliverHeld: window];
+            window->held = [message retain];
+            return;
+        }
+
+        MigratoryDataMessage *next = message;
+        if ([message getMessageType] != SNAPSHOT && window->merge != nil) {
+            next = window->merge(window->held, message);
+        }
+        [window->held release];
+        window->held = [next retain];
+
+        window->conflated++;
+        conflatedTotal++;
+    });
+}
+
+- (void) onStatus: (NSString *)status info:(NSString *)info {
+    [listener onStatus: status info: info];
+}
+
+- (void) dealloc {
+    dispatch_release(queue);
+
+    [windows release];
+    [listener release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,92 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataClient.h"
+#import "MigratoryDataListener.h"
+
+/**
+ * A status notification which indicates that the connection did not answer a probe in time and is being reconnected.
+ */
+extern NSString *NOTIFY_CONNECTION_STALE;
+
+/**
+ * Detect dead connections quickly while the app is in foreground.
+ *
+ * Any message or status received proves the connection alive, so a probe is only sent when the connection has been
+ * idle for the probe interval: busy connections cost no extra traffic and idle ones wake the radio at most once per
+ * interval. A message the app publishes through the probe with a closure is a probe itself, its publish status is
+ * awaited within the timeout in place of a separate probe. The interval and timeout are the heartbeat of the app, the
+ * client library has no keepalive setting of its own; change them with setInterval:timeout:, e.g. in Low Power Mode. A single timer is armed for the next deadline, so an idle app is not woken up in between. A probe is an
+ * empty message published with a closure on the probe subject, and the publish status answering it is consumed here;
+ * the server must be configured to accept publishes on that subject, e.g. an entitled subject nobody subscribes to.
+ * If no answer arrives within the timeout, NOTIFY_CONNECTION_STALE is emitted and the client reconnects. Nothing is
+ * probed while the client is not connected, so its own reconnect schedule is left alone.
+ */
+@interface ConnectionProbe : NSObject <MigratoryDataListener> {
+    MigratoryDataClient *client;
+    NSObject<MigratoryDataListener> *listener;
+
+    NSString *probeSubject;
+    NSTimeInterval interval;
+    NSTimeInterval timeout;
+
+    NSTimeInterval lastActivity;
+    NSString *pendingClosure;
+    NSTimeInterval pendingDeadline;
+    int probes;
+    BOOL connected;
+
+    unsigned long long probeCount;
+    unsigned long long wakeupCount;
+
+    dispatch_queue_t queue;
+    dispatch_source_t timer;
+    BOOL running;
+}
+
+/**
+ * @param subject The subject the probes are published on
+ * @param probeInterval The idle time after which the connection is probed
+ * @param probeTimeout The time to wait for the answer to a probe
+ */
+- (id) initWithClient: (MigratoryDataClient *)aClient listener: (NSObject<MigratoryDataListener> *)aListener subject: (NSString *)subject interval: (NSTimeInterval)probeInterval timeout: (NSTimeInterval)probeTimeout;
+
+/**
+ * Change the heartbeat, the next deadline is computed with the new values.
+ *
+ * @param probeInterval The idle time after which the connection is probed
+ * @param probeTimeout The time to wait for the answer to a probe
+ */
+- (void) setInterval: (NSTimeInterval)probeInterval timeout: (NSTimeInterval)probeTimeout;
+
+/**
+ * Publish a message of the app; when it has a closure and no probe is pending, its publish status answers for the
+ * connection instead of a probe.
+ */
+- (void) publish: (MigratoryDataMessage *)message;
+
+/**
+ * Start probing, typically when the app enters foreground.
+ */
+- (void) start;
+
+/**
+ * Stop probing, typically when the app enters background.
+ */
+- (void) stop;
+
+/**
+ * Probe the connection now unless it was active within the timeout, e.g. right after the app returns to foreground.
+ */
+- (void) probeNow;
+
+/**
+ * The number of probes sent.
+ */
+- (unsigned long long) probeCount;
+
+/**
+ * The number of times the timer woke the app up.
+ */
+- (unsigned long long) wakeupCount;
+
+@end
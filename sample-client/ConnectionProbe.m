@@ -0,0 +1,221 @@
+#import "ConnectionProbe.h"
+
+NSString *NOTIFY_CONNECTION_STALE = @"NOTIFY_CONNECTION_STALE";
+
+@interface ConnectionProbe ()
+- (void) check: (NSTimeInterval)idle;
+- (void) schedule;
+- (void) sendProbe;
+@end
+
+@implementation ConnectionProbe
+
+- (id) initWithClient: (MigratoryDataClient *)aClient listener: (NSObject<MigratoryDataListener> *)aListener subject: (NSString *)subject interval: (NSTimeInterval)probeInterval timeout: (NSTimeInterval)probeTimeout {
+
+    self = [super init];
+    if (self != nil) {
+        // Not retained, the client retains its listener
+        client = aClient;
+        listener = [aListener retain];
+        interval = probeInterval;
+        timeout = probeTimeout;
+        probeSubject = [subject copy];
+        lastActivity = [NSDate timeIntervalSinceReferenceDate];
+
+        queue = dispatch_queue_create("com.migratorydata.samples.chat.probe", DISPATCH_QUEUE_SERIAL);
+
+        // Not retained by the timer, the timer is cancelled in dealloc; it fires once per deadline, see schedule
+        __block ConnectionProbe *blockSelf = self;
+        timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+        dispatch_source_set_event_handler(timer, ^{
+            blockSelf->wakeupCount++;
+            [blockSelf check: blockSelf->interval];
+            [blockSelf schedule];
+        });
+    }
+
+    return self;
+}
+
+- (void) setInterval: (NSTimeInterval)probeInterval timeout: (NSTimeInterval)probeTimeout {
+    dispatch_async(queue, ^{
+        interval = probeInterval;
+        timeout = probeTimeout;
+        if (running) {
+            [self schedule];
+        }
+    });
+}
+
+- (void) publish: (MigratoryDataMessage *)message {
+    NSString *closure = [message getClosure];
+    if (closure != nil) {
+        dispatch_sync(queue, ^{
+            // Piggyback the probe on the message, unless one is already awaited
+            if (running && connected && pendingClosure == nil) {
+                pendingClosure = [closure copy];
+                pendingDeadline = [NSDate timeIntervalSinceReferenceDate] + timeout;
+                [self schedule];
+            }
+        });
+    }
+
+    [client publish: message];
+}
+
+- (unsigned long long) probeCount {
+    __block unsigned long long count;
+    dispatch_sync(queue, ^{
+        count = probeCount;
+    });
+    return count;
+}
+
+- (unsigned long long) wakeupCount {
+    __block unsigned long long count;
+    dispatch_sync(queue, ^{
+        count = wakeupCount;
+    });
+    return count;
+}
+
+- (void) start {
+    dispatch_async(queue, ^{
+        if (!running) {
+            running = YES;
+            lastActivity = [NSDate timeIntervalSinceReferenceDate];
+            [self schedule];
+            dispatch_resume(timer);
+        }
+    });
+}
+
+- (void) stop {
+    dispatch_async(queue, ^{
+        if (running) {
+            running = NO;
+            dispatch_suspend(timer);
+        }
+        [pendingClosure release];
+        pendingClosure = nil;
+    });
+}
+
+- (void) probeNow {
+    dispatch_async(queue, ^{
+        [self check: timeout];
+        [self schedule];
+    });
+}
+
+// Called on the queue.
+- (void) check: (NSTimeInterval)idle {
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+
+    if (!connected) {
+        return;
+    }
+
+    if (pendingClosure != nil) {
+        if (now < pendingDeadline) {
+            return;
+        }
+
+        [pendingClosure release];
+        pendingClosure = nil;
+
+        [listener onStatus: NOTIFY_CONNECTION_STALE info: [NSString stringWithFormat: @"no answer within %.1f s", timeout]];
+        lastActivity = now;
+        connected = NO;
+        [client pause];
+        [client resume];
+        return;
+    }
+
+    if (now - lastActivity >= idle) {
+        [self sendProbe];
+    }
+}
+
+// Arm the timer for the next deadline: the answer to the pending probe, or the end of the idle interval. Activity
+// does not move the timer, it is checked when the timer fires, so a busy connection wakes up once per interval.
+// Called on the queue.
+- (void) schedule {
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    NSTimeInterval deadline = pendingClosure != nil ? pendingDeadline : lastActivity + interval;
+    if (deadline <= now) {
+        // Nothing was sent at a passed deadline, e.g. while not connected
+        deadline = now + interval;
+    }
+    NSTimeInterval delay = deadline - now;
+    // A large leeway lets the system coalesce the timer with other wakeups, the probe answer needs a tighter one
+    uint64_t leeway = (uint64_t)((pendingClosure != nil ? timeout / 10 : interval / 4) * NSEC_PER_SEC);
+    dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), DISPATCH_TIME_FOREVER, leeway);
+}
+
+- (void) sendProbe {
+    probeCount++;
+    pendingClosure = [[NSString alloc] initWithFormat: @"probe-%d", ++probes];
+    pendingDeadline = [NSDate timeIntervalSinceReferenceDate] + timeout;
+
+    MigratoryDataMessage *probe = [[MigratoryDataMessage alloc] init: probeSubject content: @"" closure: pendingClosure
+        qos: STANDARD retained: NO];
+    [client publish: probe];
+    [probe release];
+}
+
+- (void)onMessage:(MigratoryDataMessage *)message {
+    dispatch_async(queue, ^{
+        lastActivity = [NSDate timeIntervalSinceReferenceDate];
+    });
+
+    [listener onMessage: message];
+}
+
+- (void) onStatus: (NSString *)status info:(NSString *)info {
+    __block BOOL answer = NO;
+    dispatch_sync(queue, ^{
+        lastActivity = [NSDate timeIntervalSinceReferenceDate];
+        if ([status isEqualToString: NOTIFY_SERVER_UP]) {
+            connected = YES;
+        } else if ([status isEqualToString: NOTIFY_SERVER_DOWN]) {
+            connected = NO;
+            [pendingClosure release];
+            pendingClosure = nil;
+        } else if ([status isEqualToString: NOTIFY_PUBLISH_OK] || [status isEqualToString: NOTIFY_PUBLISH_FAILED]
+                || [status isEqualToString: NOTIFY_PUBLISH_DENIED]) {
+            // The status of a message of the app is passed on, even when it answered for the connection
+            answer = [info hasPrefix: @"probe-"];
+            if ([info isEqualToString: pendingClosure]) {
+                [pendingClosure release];
+                pendingClosure = nil;
+                // Wake up at the end of the idle interval rather than at the deadline of the answer
+                if (running) {
+                    [self schedule];
+                }
+            }
+        }
+    });
+
+    if (!answer) {
+        [listener onStatus: status info: info];
+    }
+}
+
+- (void) dealloc {
+    dispatch_source_cancel(timer);
+    if (!running) {
+        // A suspended source must be resumed to be released
+        dispatch_resume(timer);
+    }
+    dispatch_release(timer);
+    dispatch_release(queue);
+
+    [pendingClosure release];
+    [probeSubject release];
+    [listener release];
+
+    [super dealloc];
+}
+
+@end
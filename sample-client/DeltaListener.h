@@ -0,0 +1,56 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataListener.h"
+
+/**
+ * A status notification which indicates that the state of a delta subject was discarded and that its patches are not
+ * applied until its next SNAPSHOT. The detail information gives the subject and the reason, e.g. a seq discontinuity,
+ * a NOTIFY_SEQUENCE_GAP, a NOTIFY_DATA_RESYNC, or a message which is not a JSON object.
+ */
+extern NSString *NOTIFY_DELTA_INVALIDATED;
+
+/**
+ * What the listener receives for a delta subject.
+ */
+typedef NS_ENUM(NSInteger, DeltaDelivery) {
+    /**
+     * Each message carries the full state of the subject after the patch.
+     */
+    DELTA_DELIVER_STATE = 0,
+
+    /**
+     * Each message carries the patch as received; the state is available with stateForSubject:.
+     */
+    DELTA_DELIVER_PATCH
+};
+
+/**
+ * Apply patch updates to a materialized state per subject.
+ *
+ * For the delta subjects, the content of a SNAPSHOT is the full state as a JSON object, and the content of an UPDATE or
+ * RECOVERED message is a JSON merge patch (RFC 7386) against the state. The state is kept here and patched
+ * incrementally, so publishers of room state such as member lists only send what changed. HISTORICAL messages are
+ * delivered unchanged and do not alter the state. Patches must be applied in seq order, so delta subjects should also
+ * be reordered with ReorderBuffer. A patch which does not follow the last applied message in seq, a NOTIFY_SEQUENCE_GAP
+ * or a NOTIFY_DATA_RESYNC of the subject discards its state with a NOTIFY_DELTA_INVALIDATED status; until the next
+ * SNAPSHOT, as before the first one, the patches are not applied, and they are not delivered with DELTA_DELIVER_STATE.
+ */
+@interface DeltaListener : NSObject <MigratoryDataListener> {
+    NSObject<MigratoryDataListener> *listener;
+
+    NSMutableDictionary *deliveries;
+    NSMutableDictionary *states;
+}
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener;
+
+- (void) setDelta: (DeltaDelivery)delivery forSubjects: (NSArray *)subjects;
+
+- (void) removeDeltaForSubjects: (NSArray *)subjects;
+
+/**
+ * Return a copy of the current state of the delta subject, or nil.
+ */
+- (NSDictionary *) stateForSubject: (NSString *)subject;
+
+@end
@@ -0,0 +1,192 @@
+#import "DeltaListener.h"
+#import "ReorderBuffer.h"
+
+NSString *NOTIFY_DELTA_INVALIDATED = @"NOTIFY_DELTA_INVALIDATED";
+
+// Apply a JSON merge patch (RFC 7386) to a mutable object in place: null removes a member, an object is merged
+// recursively and any other value replaces the member.
+static void ApplyMergePatch(NSMutableDictionary *target, NSDictionary *patch) {
+    for (NSString *key in patch) {
+        id value = [patch objectForKey: key];
+
+        if (value == [NSNull null]) {
+            [target removeObjectForKey: key];
+        } else if ([value isKindOfClass: [NSDictionary class]]) {
+            id current = [target objectForKey: key];
+            NSMutableDictionary *merged = [current isKindOfClass: [NSMutableDictionary class]] ? current : [NSMutableDictionary dictionary];
+            ApplyMergePatch(merged, value);
+            [target setObject: merged forKey: key];
+        } else {
+            [target setObject: value forKey: key];
+        }
+    }
+}
+
+static NSDictionary *ParseObject(NSString *content) {
+    NSData *data = [content dataUsingEncoding: NSUTF8StringEncoding];
+    id object = data != nil ? [NSJSONSerialization JSONObjectWithData: data options: NSJSONReadingMutableContainers error: nil] : nil;
+    return [object isKindOfClass: [NSDictionary class]] ? object : nil;
+}
+
+// The materialized state of a delta subject and the seq of the last message applied to it.
+@interface DeltaState : NSObject {
+@public
+    NSMutableDictionary *object;
+    int seq;
+    int epoch;
+}
+@end
+
+@implementation DeltaState
+
+- (void) dealloc {
+    [object release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface DeltaListener ()
+- (NSString *) invalidateSubject: (NSString *)subject reason: (NSString *)reason;
+@end
+
+@implementation DeltaListener
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener {
+
+    self = [super init];
+    if (self != nil) {
+        listener = [aListener retain];
+        deliveries = [NSMutableDictionary new];
+        states = [NSMutableDictionary new];
+    }
+
+    return self;
+}
+
+- (void) setDelta: (DeltaDelivery)delivery forSubjects: (NSArray *)subjects {
+    @synchronized (self) {
+        for (NSString *subject in subjects) {
+            [deliveries setObject: [NSNumber numberWithInteger: delivery] forKey: subject];
+        }
+    }
+}
+
+- (void) removeDeltaForSubjects: (NSArray *)subjects {
+    @synchronized (self) {
+        [deliveries removeObjectsForKeys: subjects];
+        [states removeObjectsForKeys: subjects];
+    }
+}
+
+- (NSDictionary *) stateForSubject: (NSString *)subject {
+    @synchronized (self) {
+        DeltaState *state = [states objectForKey: subject];
+        if (state == nil) {
+            return nil;
+        }
+        // Deep copy, the state keeps being patched in place
+        NSData *data = [NSJSONSerialization dataWithJSONObject: state->object options: 0 error: nil];
+        return data != nil ? [NSJSONSerialization JSONObjectWithData: data options: 0 error: nil] : nil;
+    }
+}
+
+// Discard the state of a subject until its next SNAPSHOT; called with the lock held. Returns the info of the
+// NOTIFY_DELTA_INVALIDATED status to report, or nil if the subject had no state.
+- (NSString *) invalidateSubject: (NSString *)subject reason: (NSString *)reason {
+    if ([states objectForKey: subject] == nil) {
+        return nil;
+    }
+    [states removeObjectForKey: subject];
+    return [NSString stringWithFormat: @"%@ %@", subject, reason];
+}
+
+- (void)onMessage:(MigratoryDataMessage *)message {
+    MigratoryDataMessage *delivered = message;
+    NSString *invalidated = nil;
+
+    @synchronized (self) {
+        NSString *subject = [message getSubject];
+        NSNumber *delivery = [deliveries objectForKey: subject];
+        MigratoryDataMessageType type = [message getMessageType];
+
+        if (delivery != nil && type != HISTORICAL) {
+            DeltaState *state = [states objectForKey: subject];
+            NSDictionary *object = ParseObject([message getContent]);
+
+            if (object == nil) {
+                invalidated = [self invalidateSubject: subject reason: @"not a JSON object"];
+                delivered = nil;
+            } else if (type == SNAPSHOT) {
+                if (state == nil) {
+                    state = [[DeltaState new] autorelease];
+                    state->object = [NSMutableDictionary new];
+                    [states setObject: state forKey: subject];
+                }
+                [state->object setDictionary: object];
+                state->seq = [message getSeq];
+                state->epoch = [message getEpoch];
+            } else if (state == nil) {
+                // No state to patch until the next SNAPSHOT; the patch alone is still delivered to who asked for it
+                if ([delivery integerValue] == DELTA_DELIVER_STATE) {
+                    delivered = nil;
+                }
+            } else if ([message getEpoch] != state->epoch || [message getSeq] != state->seq + 1) {
+                // A patch is missing, the state can no longer be trusted
+                invalidated = [self invalidateSubject: subject reason: @"seq discontinuity"];
+                if ([delivery integerValue] == DELTA_DELIVER_STATE) {
+                    delivered = nil;
+                }
+            } else {
+                ApplyMergePatch(state->object, object);
+                state->seq = [message getSeq];
+
+                if ([delivery integerValue] == DELTA_DELIVER_STATE) {
+                    NSData *data = [NSJSONSerialization dataWithJSONObject: state->object options: 0 error: nil];
+                    NSString *content = [[[NSString alloc] initWithData: data encoding: NSUTF8StringEncoding] autorelease];
+                    delivered = [[[MigratoryDataMessage alloc] init: subject content: content closure: [message getClosure]
+                        retained: [message isRetained] qos: [message getQos] replySubject: [message getReplySubject]
+                        messageType: type seq: [message getSeq] epoch: [message getEpoch]] autorelease];
+                }
+            }
+        }
+    }
+
+    if (invalidated != nil) {
+        [listener onStatus: NOTIFY_DELTA_INVALIDATED info: invalidated];
+    }
+    if (delivered != nil) {
+        [listener onMessage: delivered];
+    }
+}
+
+- (void) onStatus: (NSString *)status info:(NSString *)info {
+    NSString *invalidated = nil;
+    if ([status isEqualToString: NOTIFY_SEQUENCE_GAP] || [status isEqualToString: NOTIFY_DATA_RESYNC]) {
+        // The gap info is the subject followed by the missing range
+        NSRange space = [info rangeOfString: @" " options: NSBackwardsSearch];
+        NSString *subject = [status isEqualToString: NOTIFY_SEQUENCE_GAP] && space.location != NSNotFound
+            ? [info substringToIndex: space.location] : info;
+        @synchronized (self) {
+            if ([deliveries objectForKey: subject] != nil) {
+                invalidated = [self invalidateSubject: subject reason: status];
+            }
+        }
+    }
+
+    [listener onStatus: status info: info];
+    if (invalidated != nil) {
+        [listener onStatus: NOTIFY_DELTA_INVALIDATED info: invalidated];
+    }
+}
+
+- (void) dealloc {
+    [states release];
+    [deliveries release];
+    [listener release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,45 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataListener.h"
+
+/**
+ * The number of sequence numbers below the highest one received which are tracked per subject.
+ */
+#define DUPLICATE_WINDOW_SIZE 256
+
+/**
+ * Drop duplicate messages before they reach the downstream listener.
+ *
+ * The same message can be received more than once, e.g. live and then RECOVERED after a failover, or both from the
+ * client and through a push notification. Messages are identified by subject, epoch and seq; for each subject the
+ * sequence numbers recently received are kept in a sliding bitmap window, so memory per subject is constant.
+ * Messages older than the window cannot be told apart from new ones and are delivered. A newer epoch restarts the
+ * window; a message of an older epoch than the last one received is stale and is dropped as a duplicate.
+ */
+@interface DuplicateFilter : NSObject <MigratoryDataListener> {
+    NSObject<MigratoryDataListener> *listener;
+
+    NSMutableDictionary *windows;
+    NSMutableDictionary *pushWindows;
+    unsigned long long duplicates;
+}
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener;
+
+/**
+ * Record a message received through a push notification. Return YES if it was already received, from the client or
+ * pushed, in which case it should be ignored. Pushes are tracked apart from the messages of the client, so the live
+ * copy of a message pushed first is still delivered to the listener.
+ */
+- (BOOL) checkDuplicatePushSubject: (NSString *)subject seq: (int)seq epoch: (int)epoch;
+
+/**
+ * Record a message received from the client. Return YES if it was already received from the client.
+ */
+- (BOOL) checkDuplicateSubject: (NSString *)subject seq: (int)seq epoch: (int)epoch;
+
+- (unsigned long long) duplicateCountForSubject: (NSString *)subject;
+
+- (unsigned long long) duplicateCount;
+
+@end
@@ -0,0 +1,167 @@
+#import "DuplicateFilter.h"
+
+#define WINDOW_WORDS (DUPLICATE_WINDOW_SIZE / 64)
+
+// Sequence numbers received for one subject: bit i of the window is seq (highest - i).
+@interface DuplicateWindow : NSObject {
+@public
+    int epoch;
+    int highest;
+    uint64_t bits[WINDOW_WORDS];
+    unsigned long long duplicates;
+}
+@end
+
+@implementation DuplicateWindow
+@end
+
+// Slide the window up by the given number of sequence numbers.
+static void ShiftWindow(uint64_t *bits, int64_t shift) {
+    if (shift >= DUPLICATE_WINDOW_SIZE) {
+        memset(bits, 0, sizeof(uint64_t) * WINDOW_WORDS);
+        return;
+    }
+
+    int words = (int)(shift / 64);
+    int offset = (int)(shift % 64);
+    for (int i = WINDOW_WORDS - 1; i >= 0; i--) {
+        uint64_t word = 0;
+        if (i - words >= 0) {
+            word = bits[i - words] << offset;
+            if (offset > 0 && i - words - 1 >= 0) {
+                word |= bits[i - words - 1] >> (64 - offset);
+            }
+        }
+        bits[i] = word;
+    }
+}
+
+@implementation DuplicateFilter
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener {
+
+    self = [super init];
+    if (self != nil) {
+        listener = [aListener retain];
+        windows = [NSMutableDictionary new];
+        pushWindows = [NSMutableDictionary new];
+    }
+
+    return self;
+}
+
+// Whether the window holds the message, without recording it.
+static BOOL WindowContains(DuplicateWindow *window, int seq, int epoch) {
+    if (window == nil || epoch > window->epoch) {
+        return NO;
+    }
+    if (epoch < window->epoch) {
+        return YES;
+    }
+
+    int64_t age = (int64_t)window->highest - seq;
+    if (age < 0 || age >= DUPLICATE_WINDOW_SIZE) {
+        return NO;
+    }
+    return (window->bits[age / 64] & ((uint64_t)1 << (age % 64))) != 0;
+}
+
+// Record the message in the window of its subject, and return YES if it was already recorded.
+static BOOL RecordInWindows(NSMutableDictionary *windows, NSString *subject, int seq, int epoch) {
+    DuplicateWindow *window = [windows objectForKey: subject];
+    if (window != nil && epoch < window->epoch) {
+        // A message of an older epoch is stale, it was sent before the epoch the subject moved to
+        return YES;
+    }
+    if (window == nil || epoch > window->epoch) {
+        // A new epoch restarts the sequence numbers
+        if (window == nil) {
+            window = [[DuplicateWindow new] autorelease];
+            [windows setObject: window forKey: subject];
+        }
+        window->epoch = epoch;
+        window->highest = seq;
+        memset(window->bits, 0, sizeof(window->bits));
+        window->bits[0] = 1;
+        return NO;
+    }
+
+    if (seq > window->highest) {
+        ShiftWindow(window->bits, (int64_t)seq - window->highest);
+        window->highest = seq;
+        window->bits[0] |= 1;
+        return NO;
+    }
+
+    int64_t age = (int64_t)window->highest - seq;
+    if (age >= DUPLICATE_WINDOW_SIZE) {
+        return NO;
+    }
+
+    uint64_t mask = (uint64_t)1 << (age % 64);
+    if (window->bits[age / 64] & mask) {
+        return YES;
+    }
+    window->bits[age / 64] |= mask;
+    return NO;
+}
+
+- (BOOL) checkDuplicatePushSubject: (NSString *)subject seq: (int)seq epoch: (int)epoch {
+    @synchronized (self) {
+        // Pushes are recorded apart, so the live copy of a pushed message still reaches the listener
+        BOOL received = WindowContains([windows objectForKey: subject], seq, epoch);
+        BOOL pushed = RecordInWindows(pushWindows, subject, seq, epoch);
+        if (received || pushed) {
+            duplicates++;
+            return YES;
+        }
+        return NO;
+    }
+}
+
+- (BOOL) checkDuplicateSubject: (NSString *)subject seq: (int)seq epoch: (int)epoch {
+    @synchronized (self) {
+        if (RecordInWindows(windows, subject, seq, epoch)) {
+            DuplicateWindow *window = [windows objectForKey: subject];
+            window->duplicates++;
+            duplicates++;
+            return YES;
+        }
+        return NO;
+    }
+}
+
+- (unsigned long long) duplicateCountForSubject: (NSString *)subject {
+    @synchronized (self) {
+        DuplicateWindow *window = [windows objectForKey: subject];
+        return window != nil ? window->duplicates : 0;
+    }
+}
+
+- (unsigned long long) duplicateCount {
+    @synchronized (self) {
+        return duplicates;
+    }
+}
+
+- (void)onMessage:(MigratoryDataMessage *)message {
+    if ([self checkDuplicateSubject: [message getSubject] seq: [message getSeq] epoch: [message getEpoch]]) {
+        return;
+    }
+
+    [listener onMessage: message];
+}
+
+- (void) onStatus: (NSString *)status info:(NSString *)info {
+    [listener onStatus: status info: info];
+}
+
+- (void) dealloc {
+    [pushWindows release];
+    [windows release];
+    [listener release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,59 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataClient.h"
+#import "MigratoryDataListener.h"
+#import "SubjectSubscriber.h"
+
+/**
+ * Called on the main queue when an older page of history is available. The messages are in ascending seq order;
+ * hasMore is NO once the server cache or the configured history bound is exhausted.
+ */
+typedef void (^HistoryPageCompletion)(NSArray *messages, BOOL hasMore);
+
+/**
+ * Cursor-based history for subscribed subjects.
+ *
+ * Instead of fetching many historical messages per subject up front with subscribeWithHistory:history:, only the
+ * latest page is requested on subscribe and delivered to the downstream listener. Older pages are pulled on demand
+ * with loadOlderPage:completion:, so messages nobody scrolls to are never downloaded.
+ *
+ * The server cache can only be read backwards from the newest message, so a page request re-subscribes with a larger
+ * history and drops by seq the messages re-sent. The history requested doubles from one request to the next and the
+ * older messages beyond the page are kept for the next pages, so the messages received stay linear in the history
+ * loaded rather than quadratic in the number of pages.
+ */
+@interface HistoryPager : NSObject <MigratoryDataListener, SubjectSubscriber> {
+    MigratoryDataClient *client;
+    NSObject<MigratoryDataListener> *listener;
+
+    int pageSize;
+    int maxHistory;
+    NSTimeInterval pageTimeout;
+
+    NSMutableDictionary *cursors;
+}
+
+/**
+ * @param size The number of messages per page
+ * @param max The largest history requested for a subject
+ * @param timeout The time to wait for an older page before completing it with the messages received
+ */
+- (id) initWithClient: (MigratoryDataClient *)aClient listener: (NSObject<MigratoryDataListener> *)aListener pageSize: (int)size maxHistory: (int)max pageTimeout: (NSTimeInterval)timeout;
+
+/**
+ * Subscribe to the subjects, retrieving only the latest page of history for each of them.
+ */
+- (void) subscribe: (NSArray *)subjects;
+
+- (void) unsubscribe: (NSArray *)subjects;
+
+/**
+ * Request the page of history preceding the oldest message held for the subject, from the messages kept by an earlier
+ * request when they fill it. Only one page per subject is loaded at a time; a request made while another page is in
+ * flight completes immediately with no messages.
+ */
+- (void) loadOlderPage: (NSString *)subject completion: (HistoryPageCompletion)completion;
+
+- (BOOL) hasMoreHistory: (NSString *)subject;
+
+@end
@@ -0,0 +1,261 @@
+#import "HistoryPager.h"
+
+// Paging state for one subject.
+@interface HistoryCursor : NSObject {
+@public
+    int oldestSeq;
+    int oldestEpoch;
+    BOOL hasOldest;
+
+    int newestSeq;
+    int newestEpoch;
+
+    // The historical messages up to this seq are re-sent by the server for a page request
+    BOOL resending;
+    int resendSeq;
+    int resendEpoch;
+
+    int requested;
+    // The older messages the last request should bring, and the messages delivered since the first one
+    int expected;
+    int held;
+    // The server may hold messages older than the ones received
+    BOOL hasMore;
+
+    // Older messages received beyond the last page delivered, in ascending seq order
+    NSMutableArray *older;
+    NSMutableArray *page;
+    HistoryPageCompletion completion;
+    NSUInteger generation;
+}
+@end
+
+@implementation HistoryCursor
+
+- (void) dealloc {
+    [older release];
+    [page release];
+    [completion release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface HistoryPager ()
+- (HistoryCursor *) cursorForSubject: (NSString *)subject;
+- (void) finishPage: (HistoryCursor *)cursor;
+- (NSArray *) takePage: (HistoryCursor *)cursor;
+@end
+
+@implementation HistoryPager
+
+- (id) initWithClient: (MigratoryDataClient *)aClient listener: (NSObject<MigratoryDataListener> *)aListener pageSize: (int)size maxHistory: (int)max pageTimeout: (NSTimeInterval)timeout {
+
+    self = [super init];
+    if (self != nil) {
+        // Not retained, the client retains its listener
+        client = aClient;
+        listener = [aListener retain];
+        pageSize = size;
+        maxHistory = max;
+        pageTimeout = timeout;
+        cursors = [NSMutableDictionary new];
+    }
+
+    return self;
+}
+
+- (HistoryCursor *) cursorForSubject: (NSString *)subject {
+    HistoryCursor *cursor = [cursors objectForKey: subject];
+    if (cursor == nil) {
+        cursor = [[HistoryCursor new] autorelease];
+        cursor->hasMore = YES;
+        cursor->older = [NSMutableArray new];
+        [cursors setObject: cursor forKey: subject];
+    }
+    return cursor;
+}
+
+- (void) subscribe: (NSArray *)subjects {
+    @synchronized (self) {
+        for (NSString *subject in subjects) {
+            HistoryCursor *cursor = [self cursorForSubject: subject];
+            cursor->requested = pageSize;
+        }
+    }
+
+    [client subscribeWithHistory: subjects history: pageSize];
+}
+
+- (void) unsubscribe: (NSArray *)subjects {
+    @synchronized (self) {
+        for (NSString *subject in subjects) {
+            HistoryCursor *cursor = [cursors objectForKey: subject];
+            if (cursor != nil && cursor->completion != nil) {
+                [self finishPage: cursor];
+            }
+            [cursors removeObjectForKey: subject];
+        }
+    }
+
+    [client unsubscribe: subjects];
+}
+
+- (BOOL) hasMoreHistory: (NSString *)subject {
+    @synchronized (self) {
+        HistoryCursor *cursor = [cursors objectForKey: subject];
+        return cursor != nil && (cursor->hasMore || [cursor->older count] > 0);
+    }
+}
+
+- (void) loadOlderPage: (NSString *)subject completion: (HistoryPageCompletion)completion {
+    NSUInteger generation;
+    int history;
+
+    @synchronized (self) {
+        HistoryCursor *cursor = [cursors objectForKey: subject];
+        NSUInteger kept = cursor != nil ? [cursor->older count] : 0;
+        if (cursor == nil || (!cursor->hasMore && kept == 0) || cursor->completion != nil) {
+            BOOL more = cursor != nil && (cursor->hasMore || kept > 0);
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion([NSArray array], more);
+            });
+            return;
+        }
+
+        if (kept >= (NSUInteger)pageSize || !cursor->hasMore) {
+            NSArray *messages = [self takePage: cursor];
+            BOOL more = cursor->hasMore || [cursor->older count] > 0;
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(messages, more);
+            });
+            return;
+        }
+
+        // The server cache can only be read backwards from the newest message, so ask for everything held plus
+        // as much again and keep only what precedes the oldest message already delivered; the messages kept are
+        // received again.
+        [cursor->older removeAllObjects];
+        cursor->requested = MIN(MAX(cursor->requested + pageSize, 2 * cursor->requested), maxHistory);
+        cursor->expected = cursor->requested - cursor->held;
+        cursor->page = [NSMutableArray new];
+        cursor->completion = [completion copy];
+        cursor->resending = cursor->hasOldest;
+        cursor->resendSeq = cursor->newestSeq;
+        cursor->resendEpoch = cursor->newestEpoch;
+        generation = ++cursor->generation;
+        history = cursor->requested;
+    }
+
+    NSArray *subjects = [NSArray arrayWithObject: subject];
+    [client unsubscribe: subjects];
+    [client subscribeWithHistory: subjects history: history];
+
+    // Complete with whatever arrived if the server never reaches the overlap, e.g. after a cache expiry.
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(pageTimeout * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        @synchronized (self) {
+            HistoryCursor *cursor = [cursors objectForKey: subject];
+            if (cursor != nil && cursor->generation == generation) {
+                if (cursor->completion != nil) {
+                    [self finishPage: cursor];
+                }
+                cursor->resending = NO;
+            }
+        }
+    });
+}
+
+// Must be called with the lock held.
+- (void) finishPage: (HistoryCursor *)cursor {
+    NSArray *received = [cursor->page autorelease];
+    HistoryPageCompletion completion = [cursor->completion autorelease];
+    cursor->page = nil;
+    cursor->completion = nil;
+
+    // Fewer messages than expected means the server cache is exhausted
+    cursor->hasMore = (int)[received count] >= cursor->expected && cursor->requested < maxHistory;
+    [cursor->older setArray: received];
+
+    NSArray *messages = [self takePage: cursor];
+    BOOL more = cursor->hasMore || [cursor->older count] > 0;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        completion(messages, more);
+    });
+}
+
+// Move the newest page of the older messages kept to the messages delivered. Must be called with the lock held.
+- (NSArray *) takePage: (HistoryCursor *)cursor {
+    NSUInteger count = MIN([cursor->older count], (NSUInteger)pageSize);
+    NSRange range = NSMakeRange([cursor->older count] - count, count);
+    NSArray *messages = [cursor->older subarrayWithRange: range];
+    [cursor->older removeObjectsInRange: range];
+
+    if (count > 0) {
+        MigratoryDataMessage *first = [messages objectAtIndex: 0];
+        cursor->oldestSeq = [first getSeq];
+        cursor->oldestEpoch = [first getEpoch];
+        cursor->held += (int)count;
+    }
+    return messages;
+}
+
+- (void)onMessage:(MigratoryDataMessage *)message {
+    BOOL forward = YES;
+
+    @synchronized (self) {
+        HistoryCursor *cursor = [cursors objectForKey: [message getSubject]];
+        if (cursor != nil) {
+            int seq = [message getSeq];
+            int epoch = [message getEpoch];
+            BOOL historical = [message getMessageType] == HISTORICAL;
+
+            if (cursor->completion != nil) {
+                // Collect history older than the oldest message held; the page closes at the first re-sent or live message.
+                if (historical && epoch == cursor->oldestEpoch && seq < cursor->oldestSeq) {
+                    [cursor->page addObject: message];
+                    return;
+                }
+                [self finishPage: cursor];
+            }
+
+            if (cursor->resending && historical && epoch == cursor->resendEpoch && seq <= cursor->resendSeq) {
+                // Already delivered, re-sent because a page request re-subscribed the subject; the re-sent range
+                // ends with the newest message delivered before the request.
+                forward = NO;
+                cursor->resending = seq < cursor->resendSeq;
+            } else if (!cursor->hasOldest) {
+                cursor->oldestSeq = seq;
+                cursor->oldestEpoch = epoch;
+                cursor->newestSeq = seq;
+                cursor->newestEpoch = epoch;
+                cursor->hasOldest = YES;
+            } else if (epoch > cursor->newestEpoch || (epoch == cursor->newestEpoch && seq > cursor->newestSeq)) {
+                // Late and out of order messages are forwarded, the duplicate filter and the reorder buffer
+                // downstream handle them
+                cursor->newestSeq = seq;
+                cursor->newestEpoch = epoch;
+            }
+            if (forward) {
+                cursor->held++;
+            }
+        }
+    }
+
+    if (forward) {
+        [listener onMessage: message];
+    }
+}
+
+- (void) onStatus: (NSString *)status info:(NSString *)info {
+    [listener onStatus: status info: info];
+}
+
+- (void) dealloc {
+    [cursors release];
+    [listener release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,94 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataClient.h"
+#import "MigratoryDataListener.h"
+
+/**
+ * A status notification which indicates that the inbound buffer reached its high-water mark. The detail information
+ * gives the number of buffered messages and bytes.
+ */
+extern NSString *NOTIFY_INBOUND_HIGH_WATER;
+
+/**
+ * A status notification which indicates that the inbound buffer drained below its low-water mark after reaching its
+ * high-water mark.
+ */
+extern NSString *NOTIFY_INBOUND_LOW_WATER;
+
+/**
+ * What the inbound buffer does with new messages while above its high-water mark.
+ */
+typedef NS_ENUM(NSInteger, InboundOverflowPolicy) {
+    /**
+     * Pause the client until the buffer drains below the low-water mark. With guaranteed delivery, the messages
+     * published meanwhile are recovered when the client resumes.
+     */
+    OVERFLOW_PAUSE = 0,
+
+    /**
+     * Replace the buffered message of the same subject, if any, with the new message; the search is bounded to the
+     * newest buffered entries. Without a message to replace, the oldest buffered messages are dropped as with
+     * OVERFLOW_DROP_OLDEST, so the buffer stays bounded.
+     */
+    OVERFLOW_CONFLATE,
+
+    /**
+     * Drop the oldest buffered messages to make room for the new message.
+     */
+    OVERFLOW_DROP_OLDEST
+};
+
+/**
+ * A memory-bounded queue between the client and a slow listener.
+ *
+ * Messages are handed to the downstream listener on a delivery queue, so the client thread never waits for the app.
+ * The number of buffered messages and their content size are bounded; at the high-water mark a
+ * NOTIFY_INBOUND_HIGH_WATER status is emitted and the overflow policy applies.
+ */
+@interface InboundBuffer : NSObject <MigratoryDataListener> {
+    MigratoryDataClient *client;
+    NSObject<MigratoryDataListener> *listener;
+
+    NSUInteger maxMessages;
+    NSUInteger maxBytes;
+    InboundOverflowPolicy policy;
+
+    NSMutableArray *buffer;
+    NSUInteger bufferedBytes;
+    BOOL draining;
+    BOOL overHighWater;
+    BOOL pausedClient;
+    BOOL appPausedClient;
+    unsigned long long dropped;
+
+    dispatch_queue_t deliveryQueue;
+}
+
+- (id) initWithClient: (MigratoryDataClient *)aClient listener: (NSObject<MigratoryDataListener> *)aListener maxMessages: (NSUInteger)messages maxBytes: (NSUInteger)bytes policy: (InboundOverflowPolicy)overflowPolicy;
+
+/**
+ * Change the overflow policy; it applies from the next message received above the high-water mark.
+ */
+- (void) setPolicy: (InboundOverflowPolicy)overflowPolicy;
+
+- (InboundOverflowPolicy) policy;
+
+/**
+ * Pause the client for the app, e.g. in background. Use these methods rather than pausing and resuming the client
+ * directly, so the buffer does not resume at its low-water mark a client paused by the app, and the app does not
+ * resume a client paused by the buffer before it drained.
+ */
+- (void) pauseClient;
+
+- (void) resumeClient;
+
+- (NSUInteger) bufferedMessages;
+
+- (NSUInteger) bufferedBytes;
+
+/**
+ * The number of messages dropped or conflated by the overflow policy.
+ */
+- (unsigned long long) droppedCount;
+
+@end
@@ -0,0 +1,245 @@
+#import "InboundBuffer.h"
+
+NSString *NOTIFY_INBOUND_HIGH_WATER = @"NOTIFY_INBOUND_HIGH_WATER";
+NSString *NOTIFY_INBOUND_LOW_WATER = @"NOTIFY_INBOUND_LOW_WATER";
+
+// Buffered entries searched back from the newest for a message to conflate, so the search under the lock is bounded
+#define CONFLATE_SCAN 64
+
+// Content size used for the byte bound; characters are counted to avoid re-encoding every message.
+// Statuses are buffered as status/info pairs and do not count.
+static NSUInteger MessageSize(id entry) {
+    if (![entry isKindOfClass: [MigratoryDataMessage class]]) {
+        return 0;
+    }
+    return [[entry getContent] length] + [[entry getSubject] length];
+}
+
+@interface InboundBuffer ()
+- (void) enqueue: (id)entry;
+- (void) drain;
+- (void) dropOldestFor: (NSUInteger)size;
+@end
+
+@implementation InboundBuffer
+
+- (id) initWithClient: (MigratoryDataClient *)aClient listener: (NSObject<MigratoryDataListener> *)aListener maxMessages: (NSUInteger)messages maxBytes: (NSUInteger)bytes policy: (InboundOverflowPolicy)overflowPolicy {
+
+    self = [super init];
+    if (self != nil) {
+        // Not retained, the client retains its listener
+        client = aClient;
+        listener = [aListener retain];
+        maxMessages = messages;
+        maxBytes = bytes;
+        policy = overflowPolicy;
+        buffer = [NSMutableArray new];
+        deliveryQueue = dispatch_queue_create("com.migratorydata.samples.chat.inbound", DISPATCH_QUEUE_SERIAL);
+    }
+
+    return self;
+}
+
+- (void) setPolicy: (InboundOverflowPolicy)overflowPolicy {
+    @synchronized (self) {
+        policy = overflowPolicy;
+    }
+}
+
+- (InboundOverflowPolicy) policy {
+    @synchronized (self) {
+        return policy;
+    }
+}
+
+- (NSUInteger) bufferedMessages {
+    @synchronized (self) {
+        return [buffer count];
+    }
+}
+
+- (NSUInteger) bufferedBytes {
+    @synchronized (self) {
+        return bufferedBytes;
+    }
+}
+
+- (unsigned long long) droppedCount {
+    @synchronized (self) {
+        return dropped;
+    }
+}
+
+- (void)onMessage:(MigratoryDataMessage *)message {
+    NSString *highWaterInfo = nil;
+    BOOL pause = NO;
+    BOOL scheduleDrain = NO;
+
+    @synchronized (self) {
+        NSUInteger size = MessageSize(message);
+        BOOL full = [buffer count] + 1 > maxMessages || bufferedBytes + size > maxBytes;
+
+        if (full && !overHighWater) {
+            overHighWater = YES;
+            highWaterInfo = [NSString stringWithFormat: @"%lu messages, %lu bytes", (unsigned long)[buffer count], (unsigned long)bufferedBytes];
+        }
+
+        if (full && policy == OVERFLOW_CONFLATE) {
+            NSString *subject = [message getSubject];
+            NSUInteger index = NSNotFound;
+            NSUInteger last = [buffer count] > CONFLATE_SCAN ? [buffer count] - CONFLATE_SCAN : 0;
+            for (NSUInteger i = [buffer count]; i > last; i--) {
+                id held = [buffer objectAtIndex: i - 1];
+                if ([held isKindOfClass: [MigratoryDataMessage class]] && [[held getSubject] isEqualToString: subject]
+                        && [held getMessageType] != SNAPSHOT) {
+                    index = i - 1;
+                    break;
+                }
+            }
+            if (index != NSNotFound) {
+                bufferedBytes -= MessageSize([buffer objectAtIndex: index]);
+                [buffer removeObjectAtIndex: index];
+                dropped++;
+            }
+            // Nothing of the subject to replace, or the replaced message was smaller: make room as with drop-oldest
+            [self dropOldestFor: size];
+        } else if (full && policy == OVERFLOW_DROP_OLDEST) {
+            [self dropOldestFor: size];
+        } else if (full && policy == OVERFLOW_PAUSE && !pausedClient) {
+            pausedClient = YES;
+            pause = !appPausedClient;
+        }
+
+        [buffer addObject: message];
+        bufferedBytes += size;
+
+        if (highWaterInfo != nil) {
+            [buffer addObject: [NSArray arrayWithObjects: NOTIFY_INBOUND_HIGH_WATER, highWaterInfo, nil]];
+        }
+
+        if (!draining) {
+            draining = YES;
+            scheduleDrain = YES;
+        }
+    }
+
+    if (pause) {
+        [client pause];
+    }
+
+    if (scheduleDrain) {
+        dispatch_async(deliveryQueue, ^{
+            [self drain];
+        });
+    }
+}
+
+// Drop the oldest entries until a message of the given size fits; called with the lock held.
+- (void) dropOldestFor: (NSUInteger)size {
+    while ([buffer count] > 0 && ([buffer count] + 1 > maxMessages || bufferedBytes + size > maxBytes)) {
+        // Statuses are dropped along with messages, the high-water status reports the overflow
+        bufferedBytes -= MessageSize([buffer objectAtIndex: 0]);
+        [buffer removeObjectAtIndex: 0];
+        dropped++;
+    }
+}
+
+- (void) pauseClient {
+    BOOL pause;
+    @synchronized (self) {
+        pause = !appPausedClient && !pausedClient;
+        appPausedClient = YES;
+    }
+    if (pause) {
+        [client pause];
+    }
+}
+
+- (void) resumeClient {
+    BOOL resume;
+    @synchronized (self) {
+        resume = appPausedClient && !pausedClient;
+        appPausedClient = NO;
+    }
+    if (resume) {
+        [client resume];
+    }
+}
+
+- (void) enqueue: (id)entry {
+    BOOL scheduleDrain = NO;
+
+    @synchronized (self) {
+        [buffer addObject: entry];
+
+        if (!draining) {
+            draining = YES;
+            scheduleDrain = YES;
+        }
+    }
+
+    if (scheduleDrain) {
+        dispatch_async(deliveryQueue, ^{
+            [self drain];
+        });
+    }
+}
+
+- (void) drain {
+    while (YES) {
+        BOOL lowWater = NO;
+        BOOL resume = NO;
+
+        @autoreleasepool {
+            id entry;
+            @synchronized (self) {
+                if ([buffer count] == 0) {
+                    draining = NO;
+                    return;
+                }
+
+                entry = [[[buffer objectAtIndex: 0] retain] autorelease];
+                [buffer removeObjectAtIndex: 0];
+                bufferedBytes -= MessageSize(entry);
+
+                // The low-water mark is half of each bound; the client paused by the app stays paused
+                if (overHighWater && [buffer count] <= maxMessages / 2 && bufferedBytes <= maxBytes / 2) {
+                    overHighWater = NO;
+                    lowWater = YES;
+                    resume = pausedClient && !appPausedClient;
+                    pausedClient = NO;
+                }
+            }
+
+            if ([entry isKindOfClass: [MigratoryDataMessage class]]) {
+                [listener onMessage: entry];
+            } else {
+                [listener onStatus: [entry objectAtIndex: 0] info: [entry objectAtIndex: 1]];
+            }
+
+            if (lowWater) {
+                [listener onStatus: NOTIFY_INBOUND_LOW_WATER info: @""];
+            }
+        }
+
+        if (resume) {
+            [client resume];
+        }
+    }
+}
+
+- (void) onStatus: (NSString *)status info:(NSString *)info {
+    // Buffered along with the messages to keep their order
+    [self enqueue: [NSArray arrayWithObjects: status, (info != nil ? info : @""), nil]];
+}
+
+- (void) dealloc {
+    dispatch_release(deliveryQueue);
+
+    [buffer release];
+    [listener release];
+
+    [super dealloc];
+}
+
+@end
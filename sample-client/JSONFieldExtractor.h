@@ -0,0 +1,15 @@
+#import <Foundation/Foundation.h>
+
+#include "JSONScanner.h"
+
+/**
+ * Return the string value of a member of the top-level JSON object in the content of a message, or nil if the content
+ * is not a JSON object or the member is missing or not a string. Only the returned string is allocated.
+ */
+NSString *JSONStringField(NSString *json, const char *key);
+
+/**
+ * Return in values the string values of several members of the top-level JSON object in the content of a message,
+ * scanning the content once. A value is nil as for JSONStringField.
+ */
+void JSONStringFields(NSString *json, const char *const *keys, NSString **values, size_t count);
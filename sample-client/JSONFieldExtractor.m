@@ -0,0 +1,39 @@
+#import "JSONFieldExtractor.h"
+
+// The string held by the view of a string value, unescaped; nil if the value is missing or not a string.
+static NSString *StringFromView(const char *bytes, JSONValueView view) {
+    if (view.data == NULL || view.data == bytes || view.data[-1] != '"') {
+        return nil;
+    }
+
+    if (memchr(view.data, '\\', view.length) == NULL) {
+        return [[[NSString alloc] initWithBytes: view.data length: view.length encoding: NSUTF8StringEncoding] autorelease];
+    }
+
+    // Let the system unescape the string, and only this string
+    NSData *fragment = [NSData dataWithBytes: view.data - 1 length: view.length + 2];
+    id string = [NSJSONSerialization JSONObjectWithData: fragment options: NSJSONReadingAllowFragments error: nil];
+    return [string isKindOfClass: [NSString class]] ? string : nil;
+}
+
+NSString *JSONStringField(NSString *json, const char *key) {
+    NSString *value;
+    JSONStringFields(json, &key, &value, 1);
+    return value;
+}
+
+void JSONStringFields(NSString *json, const char *const *keys, NSString **values, size_t count) {
+    const char *bytes = [json UTF8String];
+    JSONValueView views[count > 0 ? count : 1];
+
+    if (bytes == NULL || JSONExtractFields(bytes, strlen(bytes), keys, count, views) == 0) {
+        for (size_t k = 0; k < count; k++) {
+            values[k] = nil;
+        }
+        return;
+    }
+
+    for (size_t k = 0; k < count; k++) {
+        values[k] = StringFromView(bytes, views[k]);
+    }
+}
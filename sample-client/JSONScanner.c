@@ -0,0 +1,163 @@
+#include "JSONScanner.h"
+
+#include <string.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Index of the first quote or backslash at or after i, or length if there is none, checked a vector at a time.
+static size_t FindQuoteOrEscape(const char *json, size_t i, size_t length) {
+    const unsigned char *data = (const unsigned char *)json;
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    uint8x16_t quote = vdupq_n_u8('"'), escape = vdupq_n_u8('\\');
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t chunk = vld1q_u8(data + i);
+        if (vmaxvq_u8(vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, escape))) != 0) {
+            break;
+        }
+    }
+#elif defined(__SSE2__)
+    __m128i quote = _mm_set1_epi8('"'), escape = _mm_set1_epi8('\\');
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, escape))) != 0) {
+            break;
+        }
+    }
+#endif
+    while (i < length && data[i] != '"' && data[i] != '\\') {
+        i++;
+    }
+    return i;
+}
+
+static size_t SkipWhitespace(const char *json, size_t i, size_t length) {
+    while (i < length && (json[i] == ' ' || json[i] == '\t' || json[i] == '\n' || json[i] == '\r')) {
+        i++;
+    }
+    return i;
+}
+
+// Index just past the string starting with the quote at i, or 0 if it is not terminated.
+static size_t SkipString(const char *json, size_t i, size_t length) {
+    for (i++; ; i += 2) {
+        i = FindQuoteOrEscape(json, i, length);
+        if (i >= length) {
+            return 0;
+        }
+        if (json[i] == '"') {
+            return i + 1;
+        }
+    }
+}
+
+// Index just past the value starting at i, or 0 if it is malformed.
+static size_t SkipValue(const char *json, size_t i, size_t length) {
+    if (i >= length) {
+        return 0;
+    }
+
+    if (json[i] == '"') {
+        return SkipString(json, i, length);
+    }
+
+    if (json[i] == '{' || json[i] == '[') {
+        int depth = 0;
+        for (; i < length; i++) {
+            char c = json[i];
+            if (c == '"') {
+                i = SkipString(json, i, length);
+                if (i == 0) {
+                    return 0;
+                }
+                i--;
+            } else if (c == '{' || c == '[') {
+                depth++;
+            } else if (c == '}' || c == ']') {
+                if (--depth == 0) {
+                    return i + 1;
+                }
+            }
+        }
+        return 0;
+    }
+
+    // Number or literal
+    size_t start = i;
+    while (i < length && json[i] != ',' && json[i] != '}' && json[i] != ']' && json[i] != ' ' && json[i] != '\t'
+            && json[i] != '\n' && json[i] != '\r') {
+        i++;
+    }
+    return i > start ? i : 0;
+}
+
+bool JSONExtractField(const char *json, size_t length, const char *key, JSONValueView *value) {
+    return JSONExtractFields(json, length, &key, 1, value) == 1;
+}
+
+size_t JSONExtractFields(const char *json, size_t length, const char *const *keys, size_t count, JSONValueView *values) {
+    size_t found = 0;
+    size_t i = SkipWhitespace(json, 0, length);
+
+    for (size_t k = 0; k < count; k++) {
+        values[k].data = NULL;
+        values[k].length = 0;
+    }
+
+    if (i >= length || json[i] != '{') {
+        return 0;
+    }
+    i = SkipWhitespace(json, i + 1, length);
+
+    while (i < length && json[i] == '"') {
+        size_t keyEnd = SkipString(json, i, length);
+        if (keyEnd == 0) {
+            return found;
+        }
+        // Keys are compared raw, an escaped key never matches; the first member with a key wins
+        size_t keyLength = keyEnd - i - 2;
+        size_t match = count;
+        for (size_t k = 0; k < count; k++) {
+            if (values[k].data == NULL && strncmp(keys[k], json + i + 1, keyLength) == 0 && keys[k][keyLength] == 0) {
+                match = k;
+                break;
+            }
+        }
+
+        i = SkipWhitespace(json, keyEnd, length);
+        if (i >= length || json[i] != ':') {
+            return found;
+        }
+        i = SkipWhitespace(json, i + 1, length);
+
+        size_t valueEnd = SkipValue(json, i, length);
+        if (valueEnd == 0) {
+            return found;
+        }
+
+        if (match < count) {
+            if (json[i] == '"') {
+                values[match].data = json + i + 1;
+                values[match].length = valueEnd - i - 2;
+            } else {
+                values[match].data = json + i;
+                values[match].length = valueEnd - i;
+            }
+            if (++found == count) {
+                return found;
+            }
+        }
+
+        i = SkipWhitespace(json, valueEnd, length);
+        if (i < length && json[i] == ',') {
+            i = SkipWhitespace(json, i + 1, length);
+        } else {
+            return found;
+        }
+    }
+
+    return found;
+}
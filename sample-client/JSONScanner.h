@@ -0,0 +1,40 @@
+#ifndef JSON_SCANNER_H
+#define JSON_SCANNER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * The scanning part of JSONFieldExtractor, in plain C without Foundation, so it builds with any C compiler.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A view into a buffer: the raw bytes of a JSON value, not copied and not unescaped.
+ */
+typedef struct {
+    const char *data;
+    size_t length;
+} JSONValueView;
+
+/**
+ * Find a member of the top-level JSON object held by the buffer, without parsing the other members. On success the
+ * view holds the value of the member: for a string the bytes between the quotes, otherwise the whole value. Nested
+ * objects and arrays are skipped, not searched. Strings are skipped 16 bytes at a time with NEON or SSE2.
+ */
+bool JSONExtractField(const char *json, size_t length, const char *key, JSONValueView *value);
+
+/**
+ * Find several members of the top-level JSON object in one pass, stopping as soon as all of them are found. Each view
+ * is filled as by JSONExtractField, or holds NULL if its member is missing. Returns the number of members found.
+ */
+size_t JSONExtractFields(const char *json, size_t length, const char *const *keys, size_t count, JSONValueView *values);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
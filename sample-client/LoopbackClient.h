@@ -0,0 +1,36 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataClient.h"
+#import "LoopbackServer.h"
+
+/**
+ * A MigratoryDataClient connected to an in-process LoopbackServer instead of a MigratoryData cluster.
+ *
+ * It can replace the client anywhere a MigratoryDataClient is used. Servers, encryption, tokens and transport are
+ * ignored. As with the real client, it keeps the last seq of each subscribed subject to recover the messages missed
+ * while disconnected or paused.
+ */
+@interface LoopbackClient : MigratoryDataClient {
+    LoopbackServer *server;
+    NSObject<MigratoryDataListener> *loopbackListener;
+
+    NSMutableDictionary *seqs;
+    int epoch;
+    BOOL connected;
+    BOOL started;
+    BOOL attached;
+
+    dispatch_queue_t deliveryQueue;
+}
+
+- (id) initWithServer: (LoopbackServer *)aServer;
+
+/// @cond
+- (void) deliver: (MigratoryDataMessage *)message after: (NSTimeInterval)delay;
+- (void) deliverStatus: (NSString *)status info: (NSString *)info after: (NSTimeInterval)delay;
+- (void) serverDown: (NSTimeInterval)reconnectDelay;
+- (void) didAttachAfter: (NSTimeInterval)delay;
+- (BOOL) isConnected;
+/// @endcond
+
+@end
@@ -0,0 +1,231 @@
+#import "LoopbackClient.h"
+
+// Without latency, deliver in the order sent; timers with the same deadline may fire in any order.
+static void DispatchAfter(NSTimeInterval delay, dispatch_queue_t queue, dispatch_block_t block) {
+    if (delay <= 0) {
+        dispatch_async(queue, block);
+    } else {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), queue, block);
+    }
+}
+
+// Identifies the delivery queue of a client, see onQueue:
+static char LoopbackClientQueueKey;
+
+@interface LoopbackClient ()
+- (void) onQueue: (dispatch_block_t)block;
+@end
+
+@implementation LoopbackClient
+
+- (id) initWithServer: (LoopbackServer *)aServer {
+
+    self = [super init];
+    if (self != nil) {
+        server = [aServer retain];
+        seqs = [NSMutableDictionary new];
+        deliveryQueue = dispatch_queue_create("com.migratorydata.samples.chat.loopback.client", DISPATCH_QUEUE_SERIAL);
+        dispatch_queue_set_specific(deliveryQueue, &LoopbackClientQueueKey, self, NULL);
+    }
+
+    return self;
+}
+
+// Run the block on the delivery queue and wait for it; in place when called by the listener, from the queue itself.
+- (void) onQueue: (dispatch_block_t)block {
+    if (dispatch_get_specific(&LoopbackClientQueueKey) == self) {
+        block();
+    } else {
+        dispatch_sync(deliveryQueue, block);
+    }
+}
+
+- (void) setListener: (NSObject<MigratoryDataListener> *)listener {
+    [self onQueue: ^{
+        [loopbackListener autorelease];
+        loopbackListener = [listener retain];
+    }];
+}
+
+- (BOOL) isConnected {
+    @synchronized (self) {
+        return connected;
+    }
+}
+
+- (void) deliver: (MigratoryDataMessage *)message after: (NSTimeInterval)delay {
+    [message retain];
+    DispatchAfter(delay, deliveryQueue, ^{
+        // Messages in flight when the connection breaks are lost, and recovered after the reconnection
+        if ([self isConnected]) {
+            NSString *subject = [message getSubject];
+            if ([seqs objectForKey: subject] != nil) {
+                id last = [seqs objectForKey: subject];
+                if (last == [NSNull null] || [message getEpoch] != epoch || [message getSeq] > [last intValue]) {
+                    [seqs setObject: [NSNumber numberWithInt: [message getSeq]] forKey: subject];
+                }
+                epoch = [message getEpoch];
+                [loopbackListener onMessage: message];
+            }
+        }
+        [message release];
+    });
+}
+
+- (void) deliverStatus: (NSString *)status info: (NSString *)info after: (NSTimeInterval)delay {
+    [info retain];
+    DispatchAfter(delay, deliveryQueue, ^{
+        [loopbackListener onStatus: status info: info];
+        [info release];
+    });
+}
+
+- (void) serverDown: (NSTimeInterval)reconnectDelay {
+    dispatch_async(deliveryQueue, ^{
+        if (![self isConnected]) {
+            return;
+        }
+        @synchronized (self) {
+            connected = NO;
+        }
+        [loopbackListener onStatus: NOTIFY_SERVER_DOWN info: @"loopback"];
+
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(reconnectDelay * NSEC_PER_SEC)), deliveryQueue, ^{
+            if (!started) {
+                return;
+            }
+            @synchronized (self) {
+                connected = YES;
+            }
+            [loopbackListener onStatus: NOTIFY_SERVER_UP info: @"loopback"];
+            [server recover: self seqs: [[seqs copy] autorelease] epoch: epoch];
+        });
+    });
+}
+
+- (void) connect {
+    // Asynchronous as with the real client, the connection is up when the server answers
+    dispatch_async(deliveryQueue, ^{
+        if (started) {
+            return;
+        }
+        started = YES;
+        [server attach: self];
+    });
+}
+
+- (void) didAttachAfter: (NSTimeInterval)delay {
+    DispatchAfter(delay, deliveryQueue, ^{
+        if (!started || attached) {
+            return;
+        }
+        attached = YES;
+        @synchronized (self) {
+            connected = YES;
+        }
+        [loopbackListener onStatus: NOTIFY_SERVER_UP info: @"loopback"];
+
+        // Subscribe what was subscribed before connecting
+        NSMutableArray *subjects = [NSMutableArray array];
+        for (NSString *subject in seqs) {
+            [subjects addObject: subject];
+        }
+        if ([subjects count] > 0) {
+            [server subscribe: self subjects: subjects history: 0];
+        }
+    });
+}
+
+- (void) subscribe: (NSArray *)subjects {
+    [self subscribeWithHistory: subjects history: 0];
+}
+
+- (void) subscribeWithHistory: (NSArray *)subjects history: (int)history {
+    [self onQueue: ^{
+        for (NSString *subject in subjects) {
+            if ([seqs objectForKey: subject] == nil) {
+                [seqs setObject: [NSNull null] forKey: subject];
+            }
+        }
+        if (attached) {
+            [server subscribe: self subjects: subjects history: history];
+        }
+    }];
+}
+
+- (void) unsubscribe: (NSArray *)subjects {
+    [self onQueue: ^{
+        [seqs removeObjectsForKeys: subjects];
+        if (attached) {
+            [server unsubscribe: self subjects: subjects];
+        }
+    }];
+}
+
+- (NSArray *) getSubjects {
+    __block NSArray *subjects;
+    [self onQueue: ^{
+        subjects = [[seqs allKeys] retain];
+    }];
+    return [subjects autorelease];
+}
+
+- (void) publish: (MigratoryDataMessage *)message {
+    if ([self isConnected]) {
+        [server publish: message from: self];
+    } else if ([message getClosure] != nil) {
+        [self deliverStatus: NOTIFY_PUBLISH_FAILED info: [message getClosure] after: 0];
+    }
+}
+
+- (void) pause {
+    dispatch_async(deliveryQueue, ^{
+        @synchronized (self) {
+            connected = NO;
+        }
+    });
+}
+
+- (void) resume {
+    dispatch_async(deliveryQueue, ^{
+        if (!attached || [self isConnected]) {
+            return;
+        }
+        @synchronized (self) {
+            connected = YES;
+        }
+        [loopbackListener onStatus: NOTIFY_SERVER_UP info: @"loopback"];
+        [server recover: self seqs: [[seqs copy] autorelease] epoch: epoch];
+    });
+}
+
+- (void) disconnect {
+    [self onQueue: ^{
+        if (!started) {
+            return;
+        }
+        started = NO;
+        attached = NO;
+        @synchronized (self) {
+            connected = NO;
+        }
+        [server detach: self];
+    }];
+}
+
+- (void) dealloc {
+    // No block of the delivery queue is pending, they retain the client, but the last one may be releasing it: detach
+    // without waiting for the queue
+    if (started) {
+        [server detach: self];
+    }
+    dispatch_release(deliveryQueue);
+
+    [seqs release];
+    [loopbackListener release];
+    [server release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,57 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataMessage.h"
+
+@class LoopbackClient;
+
+/**
+ * An in-process stand-in for a MigratoryData cluster, to exercise and benchmark the client side without a network.
+ *
+ * It keeps a bounded history cache, a seq per subject and an epoch, answers publishes with a NOTIFY_PUBLISH_*
+ * status, and recovers the messages missed by a client during a disconnection. Faults can be injected: delivery
+ * latency, dropped deliveries, disconnections and epoch restarts. LoopbackClient connects to it.
+ */
+@interface LoopbackServer : NSObject {
+    NSTimeInterval latency;
+    double dropRate;
+    NSUInteger maxCachedMessages;
+
+    int epoch;
+    NSMutableDictionary *histories;
+    NSMutableArray *clients;
+
+    dispatch_queue_t queue;
+}
+
+- (id) initWithMaxCachedMessages: (NSUInteger)maxCached;
+
+/**
+ * Delay each delivery to a client by the given time.
+ */
+- (void) setLatency: (NSTimeInterval)seconds;
+
+/**
+ * Drop each delivery of a message to a client with the given probability, leaving a seq gap.
+ */
+- (void) setDropRate: (double)rate;
+
+/**
+ * Break the connection of every client; they reconnect after the given delay and recover the missed messages.
+ */
+- (void) injectDisconnect: (NSTimeInterval)reconnectDelay;
+
+/**
+ * Restart the sequence numbers in a new epoch, as after a cluster restart; clients resynchronize with a SNAPSHOT.
+ */
+- (void) injectEpochRestart;
+
+/// @cond
+- (void) attach: (LoopbackClient *)client;
+- (void) detach: (LoopbackClient *)client;
+- (void) subscribe: (LoopbackClient *)client subjects: (NSArray *)subjects history: (int)history;
+- (void) unsubscribe: (LoopbackClient *)client subjects: (NSArray *)subjects;
+- (void) publish: (MigratoryDataMessage *)message from: (LoopbackClient *)client;
+- (void) recover: (LoopbackClient *)client seqs: (NSDictionary *)seqs epoch: (int)clientEpoch;
+/// @endcond
+
+@end
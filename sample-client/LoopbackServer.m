@@ -0,0 +1,253 @@
+#import "LoopbackServer.h"
+#import "LoopbackClient.h"
+
+// Copy a message with the type, seq and epoch given by the server.
+static MigratoryDataMessage *ServerMessage(MigratoryDataMessage *message, MigratoryDataMessageType type, int seq, int epoch) {
+    return [[[MigratoryDataMessage alloc] init: [message getSubject] content: [message getContent] closure: nil
+        retained: [message isRetained] qos: [message getQos] replySubject: [message getReplySubject]
+        messageType: type seq: seq epoch: epoch] autorelease];
+}
+
+// The cache and the subscribers of one subject.
+@interface LoopbackSubject : NSObject {
+@public
+    int seq;
+    NSMutableArray *messages;
+    MigratoryDataMessage *retainedMessage;
+    NSMutableArray *subscribers;
+}
+@end
+
+@implementation LoopbackSubject
+
+- (id) init {
+
+    self = [super init];
+    if (self != nil) {
+        messages = [NSMutableArray new];
+        subscribers = [NSMutableArray new];
+    }
+
+    return self;
+}
+
+- (void) dealloc {
+    [subscribers release];
+    [retainedMessage release];
+    [messages release];
+
+    [super dealloc];
+}
+
+@end
+
+// Set on the queue of each server, to tell whether the caller already runs on it
+static char LoopbackServerQueueKey;
+
+@interface LoopbackServer ()
+- (LoopbackSubject *) subjectNamed: (NSString *)name;
+- (void) send: (MigratoryDataMessage *)message to: (LoopbackClient *)client;
+- (void) resync: (LoopbackClient *)client subject: (LoopbackSubject *)subject name: (NSString *)name;
+@end
+
+@implementation LoopbackServer
+
+- (id) initWithMaxCachedMessages: (NSUInteger)maxCached {
+
+    self = [super init];
+    if (self != nil) {
+        maxCachedMessages = maxCached;
+        epoch = (int)arc4random_uniform(1 << 20) + 1;
+        histories = [NSMutableDictionary new];
+        // Clients are not retained, they retain the server and detach when disconnected
+        clients = [NSMutableArray new];
+        queue = dispatch_queue_create("com.migratorydata.samples.chat.loopback", DISPATCH_QUEUE_SERIAL);
+        dispatch_queue_set_specific(queue, &LoopbackServerQueueKey, self, NULL);
+    }
+
+    return self;
+}
+
+- (void) setLatency: (NSTimeInterval)seconds {
+    dispatch_async(queue, ^{
+        latency = seconds;
+    });
+}
+
+- (void) setDropRate: (double)rate {
+    dispatch_async(queue, ^{
+        dropRate = rate;
+    });
+}
+
+- (LoopbackSubject *) subjectNamed: (NSString *)name {
+    LoopbackSubject *subject = [histories objectForKey: name];
+    if (subject == nil) {
+        subject = [[LoopbackSubject new] autorelease];
+        [histories setObject: subject forKey: name];
+    }
+    return subject;
+}
+
+- (void) send: (MigratoryDataMessage *)message to: (LoopbackClient *)client {
+    if (dropRate > 0 && arc4random_uniform(1000000) < dropRate * 1000000) {
+        return;
+    }
+    [client deliver: message after: latency];
+}
+
+- (void) attach: (LoopbackClient *)client {
+    // The connection takes one latency, and clients connecting at once wait for each other on the queue
+    dispatch_async(queue, ^{
+        [clients addObject: [NSValue valueWithNonretainedObject: client]];
+        [client didAttachAfter: latency];
+    });
+}
+
+- (void) detach: (LoopbackClient *)client {
+    // Done before returning, the client may be deallocating; a client released by a block of the queue is detached
+    // in place, as waiting for the queue from the queue would deadlock
+    void (^detach)(void) = ^{
+        NSValue *key = [NSValue valueWithNonretainedObject: client];
+        [clients removeObject: key];
+        for (LoopbackSubject *subject in [histories allValues]) {
+            [subject->subscribers removeObject: key];
+        }
+    };
+    if (dispatch_get_specific(&LoopbackServerQueueKey) == self) {
+        detach();
+    } else {
+        dispatch_sync(queue, detach);
+    }
+}
+
+- (void) subscribe: (LoopbackClient *)client subjects: (NSArray *)subjects history: (int)history {
+    dispatch_async(queue, ^{
+        NSValue *key = [NSValue valueWithNonretainedObject: client];
+        for (NSString *name in subjects) {
+            LoopbackSubject *subject = [self subjectNamed: name];
+            if (![subject->subscribers containsObject: key]) {
+                [subject->subscribers addObject: key];
+            }
+
+            NSUInteger count = MIN((NSUInteger)MAX(history, 0), [subject->messages count]);
+            if (count > 0) {
+                NSRange range = NSMakeRange([subject->messages count] - count, count);
+                for (MigratoryDataMessage *message in [subject->messages subarrayWithRange: range]) {
+                    [self send: ServerMessage(message, HISTORICAL, [message getSeq], epoch) to: client];
+                }
+            } else if (subject->retainedMessage != nil) {
+                [self send: ServerMessage(subject->retainedMessage, SNAPSHOT, subject->seq, epoch) to: client];
+            }
+        }
+    });
+}
+
+- (void) unsubscribe: (LoopbackClient *)client subjects: (NSArray *)subjects {
+    dispatch_async(queue, ^{
+        NSValue *key = [NSValue valueWithNonretainedObject: client];
+        for (NSString *name in subjects) {
+            LoopbackSubject *subject = [histories objectForKey: name];
+            if (subject != nil) {
+                [subject->subscribers removeObject: key];
+            }
+        }
+    });
+}
+
+- (void) publish: (MigratoryDataMessage *)message from: (LoopbackClient *)client {
+    dispatch_async(queue, ^{
+        LoopbackSubject *subject = [self subjectNamed: [message getSubject]];
+        MigratoryDataMessage *stored = ServerMessage(message, UPDATE, ++subject->seq, epoch);
+
+        if ([message getQos] == GUARANTEED) {
+            [subject->messages addObject: stored];
+            if ([subject->messages count] > maxCachedMessages) {
+                [subject->messages removeObjectAtIndex: 0];
+            }
+        }
+        if ([message isRetained]) {
+            [subject->retainedMessage release];
+            subject->retainedMessage = [stored retain];
+        }
+
+        for (NSValue *key in subject->subscribers) {
+            LoopbackClient *subscriber = [key nonretainedObjectValue];
+            if ([subscriber isConnected]) {
+                [self send: stored to: subscriber];
+            }
+        }
+
+        if ([message getClosure] != nil) {
+            [client deliverStatus: NOTIFY_PUBLISH_OK info: [message getClosure] after: latency];
+        }
+    });
+}
+
+- (void) resync: (LoopbackClient *)client subject: (LoopbackSubject *)subject name: (NSString *)name {
+    if (subject->retainedMessage != nil) {
+        [self send: ServerMessage(subject->retainedMessage, SNAPSHOT, subject->seq, epoch) to: client];
+    }
+    [client deliverStatus: NOTIFY_DATA_RESYNC info: name after: latency];
+}
+
+- (void) recover: (LoopbackClient *)client seqs: (NSDictionary *)seqs epoch: (int)clientEpoch {
+    dispatch_async(queue, ^{
+        for (NSString *name in seqs) {
+            LoopbackSubject *subject = [self subjectNamed: name];
+            id lastSeq = [seqs objectForKey: name];
+
+            if (clientEpoch != epoch || lastSeq == [NSNull null]) {
+                [self resync: client subject: subject name: name];
+                continue;
+            }
+
+            int last = [lastSeq intValue];
+            MigratoryDataMessage *oldest = [subject->messages firstObject];
+            if (subject->seq > last && (oldest == nil || [oldest getSeq] > last + 1)) {
+                // The missed messages are no longer cached
+                [self resync: client subject: subject name: name];
+                continue;
+            }
+
+            for (MigratoryDataMessage *message in subject->messages) {
+                if ([message getSeq] > last) {
+                    [self send: ServerMessage(message, RECOVERED, [message getSeq], epoch) to: client];
+                }
+            }
+            [client deliverStatus: NOTIFY_DATA_SYNC info: name after: latency];
+        }
+    });
+}
+
+- (void) injectDisconnect: (NSTimeInterval)reconnectDelay {
+    dispatch_async(queue, ^{
+        for (NSValue *key in clients) {
+            [[key nonretainedObjectValue] serverDown: reconnectDelay];
+        }
+    });
+}
+
+- (void) injectEpochRestart {
+    dispatch_async(queue, ^{
+        epoch++;
+        for (LoopbackSubject *subject in [histories allValues]) {
+            subject->seq = 0;
+            [subject->messages removeAllObjects];
+        }
+        for (NSValue *key in clients) {
+            [[key nonretainedObjectValue] serverDown: 0.1];
+        }
+    });
+}
+
+- (void) dealloc {
+    dispatch_release(queue);
+
+    [clients release];
+    [histories release];
+
+    [super dealloc];
+}
+
+@end
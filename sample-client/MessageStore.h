@@ -0,0 +1,132 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataListener.h"
+
+/**
+ * The app group shared by the app and its Notification Service Extension.
+ */
+extern NSString *MESSAGE_STORE_APP_GROUP;
+
+/**
+ * Posted by MessageStoreListener, on its queue, and by ChatPush after messages were written to the store. The user info holds the
+ * subject under MESSAGE_STORE_SUBJECT and, under MESSAGE_STORE_FIRST_INDEX, the lowest index written, which is below
+ * the previous count when a message was inserted before the last stored one.
+ */
+extern NSString *MESSAGE_STORE_DID_APPEND;
+extern NSString *MESSAGE_STORE_SUBJECT;
+extern NSString *MESSAGE_STORE_FIRST_INDEX;
+
+/**
+ * A message read from the store.
+ */
+@interface StoredMessage : NSObject {
+    NSString *content;
+    int seq;
+    int epoch;
+    NSTimeInterval time;
+}
+
+- (id) initWithContent: (NSString *)aContent seq: (int)aSeq epoch: (int)anEpoch time: (NSTimeInterval)aTime;
+
+- (NSString *) content;
+- (int) seq;
+- (int) epoch;
+
+/**
+ * The time the message was stored, since the reference date.
+ */
+- (NSTimeInterval) time;
+
+@end
+
+/**
+ * An append-only store of the chat messages of each subject, shared between processes.
+ *
+ * Each subject has a log of records and an index of their offsets, so the count is known from the index size and any
+ * range of messages is read without reading the others. The messages are kept in (epoch, seq) order: a message received
+ * after a later one, e.g. a push stored by the Notification Service Extension before the one which preceded it, is
+ * inserted at its place, and a message whose epoch and seq are already stored is skipped. Writers
+ * take an exclusive file lock and readers a shared one, so the app and its Notification Service Extension can use the
+ * same directory at the same time. The store needs only Foundation and keeps nothing in memory.
+ */
+@interface MessageStore : NSObject {
+    NSString *directory;
+}
+
+/**
+ * The store in the container of the app group, or nil if the app group is not available.
+ */
++ (MessageStore *) sharedStore;
+
+- (id) initWithDirectory: (NSString *)aDirectory;
+
+/**
+ * Store a message of a subject at its place in (epoch, seq) order.
+ *
+ * @return NO if the message is already stored, it is older than the last 1000 stored messages, or it could not be
+ * written
+ */
+- (BOOL) appendContent: (NSString *)content subject: (NSString *)subject seq: (int)seq epoch: (int)epoch;
+
+/**
+ * Store several messages of a subject, with the lock taken and the files opened once.
+ *
+ * @param firstIndex if not NULL, set to the lowest index written, or NSNotFound if nothing was written
+ * @return the number of messages written
+ */
+- (NSUInteger) appendMessages: (NSArray *)messages subject: (NSString *)subject firstIndex: (NSUInteger *)firstIndex;
+
+- (NSUInteger) countForSubject: (NSString *)subject;
+
+/**
+ * Read the messages of a subject in the given range of indexes, oldest first; the range is clipped to the count.
+ */
+- (NSArray *) messagesForSubject: (NSString *)subject range: (NSRange)range;
+
+/**
+ * The seq and epoch of the last message stored for a subject.
+ *
+ * @return NO if no message is stored for the subject
+ */
+- (BOOL) lastSeq: (int *)seq epoch: (int *)epoch forSubject: (NSString *)subject;
+
+/**
+ * The directory of the store, where other files kept along with the logs can be written.
+ */
+- (NSString *) directory;
+
+/**
+ * The path of a file kept next to the log of a subject with the given extension, for data stored along with it.
+ */
+- (NSString *) pathForSubject: (NSString *)subject extension: (NSString *)extension;
+
+@end
+
+/**
+ * Write the messages of the chat subjects delivered to the app into a MessageStore and forward them unchanged.
+ *
+ * Only the subjects enabled with setStoredSubjects: are stored, so reply subjects, delta patches and high-rate subjects
+ * are not written. The messages are written on a private queue, in batches of up to 64 messages or 50 ms, so the
+ * delivery thread never waits for the file lock or the disk; MESSAGE_STORE_DID_APPEND is posted after each batch.
+ */
+@interface MessageStoreListener : NSObject <MigratoryDataListener> {
+    NSObject<MigratoryDataListener> *listener;
+    MessageStore *store;
+
+    NSMutableSet *storedSubjects;
+    NSMutableDictionary *pending;
+    NSUInteger pendingCount;
+    BOOL flushScheduled;
+    dispatch_queue_t queue;
+}
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener store: (MessageStore *)aStore;
+
+/**
+ * Store the messages of the given subjects.
+ */
+- (void) setStoredSubjects: (NSArray *)subjects;
+
+- (void) removeStoredSubjects: (NSArray *)subjects;
+
+@end
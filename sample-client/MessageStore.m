@@ -0,0 +1,415 @@
+#import "MessageStore.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+NSString *MESSAGE_STORE_APP_GROUP = @"group.com.migratorydata.samples.chat";
+NSString *MESSAGE_STORE_DID_APPEND = @"MESSAGE_STORE_DID_APPEND";
+NSString *MESSAGE_STORE_SUBJECT = @"subject";
+NSString *MESSAGE_STORE_FIRST_INDEX = @"firstIndex";
+
+// Records scanned back from the end of a log to place a message received out of order
+#define STORE_INSERT_SCAN 1000
+
+// Messages written by MessageStoreListener in one batch, and the longest they wait for it
+#define STORE_BATCH_SIZE 64
+#define STORE_BATCH_DELAY 0.05
+
+// The header of a record of the log, followed by the UTF-8 content.
+typedef struct {
+    uint32_t length;
+    int32_t seq;
+    int32_t epoch;
+    uint32_t reserved;
+    double time;
+} StoreRecord;
+
+// 64-bit FNV-1a of the subject, which names its files.
+static uint64_t SubjectHash(NSString *subject) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)[subject UTF8String]; *p != 0; p++) {
+        hash = (hash ^ *p) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static BOOL ReadFully(int fd, void *buffer, size_t length, off_t offset) {
+    return pread(fd, buffer, length, offset) == (ssize_t)length;
+}
+
+@implementation StoredMessage
+
+- (id) initWithContent: (NSString *)aContent seq: (int)aSeq epoch: (int)anEpoch time: (NSTimeInterval)aTime {
+
+    self = [super init];
+    if (self != nil) {
+        content = [aContent copy];
+        seq = aSeq;
+        epoch = anEpoch;
+        time = aTime;
+    }
+
+    return self;
+}
+
+- (NSString *) content {
+    return content;
+}
+
+- (int) seq {
+    return seq;
+}
+
+- (int) epoch {
+    return epoch;
+}
+
+- (NSTimeInterval) time {
+    return time;
+}
+
+- (void) dealloc {
+    [content release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface MessageStore ()
+- (int) lock: (int)operation;
+- (NSUInteger) insert: (StoredMessage *)message index: (int)indexFd log: (int)logFd;
+- (BOOL) readLast: (StoreRecord *)record index: (int)indexFd log: (int)logFd;
+@end
+
+@implementation MessageStore
+
++ (MessageStore *) sharedStore {
+    NSURL *container = [[NSFileManager defaultManager] containerURLForSecurityApplicationGroupIdentifier: MESSAGE_STORE_APP_GROUP];
+    if (container == nil) {
+        return nil;
+    }
+    NSString *path = [[container path] stringByAppendingPathComponent: @"Messages"];
+    return [[[MessageStore alloc] initWithDirectory: path] autorelease];
+}
+
+- (id) initWithDirectory: (NSString *)aDirectory {
+
+    self = [super init];
+    if (self != nil) {
+        directory = [aDirectory copy];
+        [[NSFileManager defaultManager] createDirectoryAtPath: directory withIntermediateDirectories: YES attributes: nil error: nil];
+    }
+
+    return self;
+}
+
+- (NSString *) directory {
+    return directory;
+}
+
+- (NSString *) pathForSubject: (NSString *)subject extension: (NSString *)extension {
+    NSString *name = [NSString stringWithFormat: @"%016llx.%@", SubjectHash(subject), extension];
+    return [directory stringByAppendingPathComponent: name];
+}
+
+// One lock for the whole store, held for the duration of a call; returns the locked descriptor or -1.
+- (int) lock: (int)operation {
+    int fd = open([[directory stringByAppendingPathComponent: @".lock"] fileSystemRepresentation], O_RDWR | O_CREAT, 0644);
+    if (fd >= 0 && flock(fd, operation) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+- (BOOL) readLast: (StoreRecord *)record index: (int)indexFd log: (int)logFd {
+    off_t size = lseek(indexFd, 0, SEEK_END);
+    uint64_t offset;
+    return size >= (off_t)sizeof(offset) && ReadFully(indexFd, &offset, sizeof(offset), size - sizeof(offset))
+        && ReadFully(logFd, record, sizeof(*record), (off_t)offset);
+}
+
+- (BOOL) appendContent: (NSString *)content subject: (NSString *)subject seq: (int)seq epoch: (int)epoch {
+    StoredMessage *message = [[[StoredMessage alloc] initWithContent: content seq: seq epoch: epoch time: [NSDate timeIntervalSinceReferenceDate]] autorelease];
+    return [self appendMessages: [NSArray arrayWithObject: message] subject: subject firstIndex: NULL] == 1;
+}
+
+// Insert one record in seq order, scanning the index backwards from its end; called with the lock held. Returns the
+// index of the message, or NSNotFound if it is already stored or it could not be written.
+- (NSUInteger) insert: (StoredMessage *)message index: (int)indexFd log: (int)logFd {
+    NSUInteger count = (NSUInteger)(lseek(indexFd, 0, SEEK_END) / sizeof(uint64_t));
+    NSUInteger position = count;
+    while (position > 0) {
+        if (count - position >= STORE_INSERT_SCAN) {
+            // Too far behind the end of the log, it belongs to history the store does not hold
+            return NSNotFound;
+        }
+        uint64_t offset;
+        StoreRecord previous;
+        if (!ReadFully(indexFd, &offset, sizeof(offset), (off_t)((position - 1) * sizeof(offset)))
+                || !ReadFully(logFd, &previous, sizeof(previous), (off_t)offset)) {
+            return NSNotFound;
+        }
+        if (previous.epoch == [message epoch] && previous.seq == [message seq]) {
+            return NSNotFound;
+        }
+        if (previous.epoch < [message epoch] || (previous.epoch == [message epoch] && previous.seq < [message seq])) {
+            break;
+        }
+        position--;
+    }
+
+    NSData *bytes = [[message content] dataUsingEncoding: NSUTF8StringEncoding];
+    StoreRecord record = { (uint32_t)[bytes length], [message seq], [message epoch], 0, [message time] };
+    uint64_t offset = (uint64_t)lseek(logFd, 0, SEEK_END);
+    if (pwrite(logFd, &record, sizeof(record), (off_t)offset) != sizeof(record)
+            || pwrite(logFd, [bytes bytes], [bytes length], (off_t)(offset + sizeof(record))) != (ssize_t)[bytes length]) {
+        return NSNotFound;
+    }
+
+    // The index is written last, a record left without its offset by a crash is never read. The offsets after the
+    // insertion point are moved first; a crash before the new offset is written shows the next message twice.
+    NSUInteger moved = count - position;
+    uint64_t *tail = malloc(MAX(moved, 1) * sizeof(uint64_t));
+    BOOL written = ReadFully(indexFd, tail, moved * sizeof(uint64_t), (off_t)(position * sizeof(uint64_t)))
+        && pwrite(indexFd, tail, moved * sizeof(uint64_t), (off_t)((position + 1) * sizeof(uint64_t))) == (ssize_t)(moved * sizeof(uint64_t))
+        && pwrite(indexFd, &offset, sizeof(offset), (off_t)(position * sizeof(offset))) == sizeof(offset);
+    free(tail);
+    return written ? position : NSNotFound;
+}
+
+- (NSUInteger) appendMessages: (NSArray *)messages subject: (NSString *)subject firstIndex: (NSUInteger *)firstIndex {
+    if (firstIndex != NULL) {
+        *firstIndex = NSNotFound;
+    }
+    int lockFd = [self lock: LOCK_EX];
+    if (lockFd < 0) {
+        return 0;
+    }
+
+    NSUInteger appended = 0;
+    int indexFd = open([[self pathForSubject: subject extension: @"idx"] fileSystemRepresentation], O_RDWR | O_CREAT, 0644);
+    int logFd = open([[self pathForSubject: subject extension: @"log"] fileSystemRepresentation], O_RDWR | O_CREAT, 0644);
+    if (indexFd >= 0 && logFd >= 0) {
+        // Drop a partial offset left by a crash
+        off_t indexSize = lseek(indexFd, 0, SEEK_END);
+        if (indexSize % sizeof(uint64_t) != 0) {
+            ftruncate(indexFd, indexSize - indexSize % sizeof(uint64_t));
+        }
+        for (StoredMessage *message in messages) {
+            NSUInteger index = [self insert: message index: indexFd log: logFd];
+            if (index == NSNotFound) {
+                continue;
+            }
+            appended++;
+            if (firstIndex != NULL) {
+                *firstIndex = MIN(*firstIndex, index);
+            }
+        }
+    }
+
+    if (logFd >= 0) {
+        close(logFd);
+    }
+    if (indexFd >= 0) {
+        close(indexFd);
+    }
+    close(lockFd);
+    return appended;
+}
+
+- (NSUInteger) countForSubject: (NSString *)subject {
+    int lockFd = [self lock: LOCK_SH];
+    if (lockFd < 0) {
+        return 0;
+    }
+    struct stat info;
+    NSUInteger count = 0;
+    if (stat([[self pathForSubject: subject extension: @"idx"] fileSystemRepresentation], &info) == 0) {
+        count = (NSUInteger)(info.st_size / sizeof(uint64_t));
+    }
+    close(lockFd);
+    return count;
+}
+
+- (NSArray *) messagesForSubject: (NSString *)subject range: (NSRange)range {
+    int lockFd = [self lock: LOCK_SH];
+    if (lockFd < 0) {
+        return [NSArray array];
+    }
+
+    NSMutableArray *messages = [NSMutableArray arrayWithCapacity: range.length];
+    int indexFd = open([[self pathForSubject: subject extension: @"idx"] fileSystemRepresentation], O_RDONLY);
+    int logFd = open([[self pathForSubject: subject extension: @"log"] fileSystemRepresentation], O_RDONLY);
+    if (indexFd >= 0 && logFd >= 0) {
+        NSUInteger count = (NSUInteger)(lseek(indexFd, 0, SEEK_END) / sizeof(uint64_t));
+        NSUInteger end = MIN(NSMaxRange(range), count);
+        NSUInteger start = MIN(range.location, end);
+
+        uint64_t *offsets = malloc(MAX(end - start, 1) * sizeof(uint64_t));
+        if (ReadFully(indexFd, offsets, (end - start) * sizeof(uint64_t), (off_t)(start * sizeof(uint64_t)))) {
+            for (NSUInteger i = 0; i < end - start; i++) {
+                StoreRecord record;
+                if (!ReadFully(logFd, &record, sizeof(record), (off_t)offsets[i])) {
+                    break;
+                }
+                NSMutableData *bytes = [NSMutableData dataWithLength: record.length];
+                if (!ReadFully(logFd, [bytes mutableBytes], record.length, (off_t)(offsets[i] + sizeof(record)))) {
+                    break;
+                }
+                NSString *content = [[[NSString alloc] initWithData: bytes encoding: NSUTF8StringEncoding] autorelease];
+                StoredMessage *message = [[StoredMessage alloc] initWithContent: content != nil ? content : @""
+                    seq: record.seq epoch: record.epoch time: record.time];
+                [messages addObject: message];
+                [message release];
+            }
+        }
+        free(offsets);
+    }
+
+    if (logFd >= 0) {
+        close(logFd);
+    }
+    if (indexFd >= 0) {
+        close(indexFd);
+    }
+    close(lockFd);
+    return messages;
+}
+
+- (BOOL) lastSeq: (int *)seq epoch: (int *)epoch forSubject: (NSString *)subject {
+    int lockFd = [self lock: LOCK_SH];
+    if (lockFd < 0) {
+        return NO;
+    }
+
+    BOOL found = NO;
+    int indexFd = open([[self pathForSubject: subject extension: @"idx"] fileSystemRepresentation], O_RDONLY);
+    int logFd = open([[self pathForSubject: subject extension: @"log"] fileSystemRepresentation], O_RDONLY);
+    StoreRecord last;
+    if (indexFd >= 0 && logFd >= 0 && [self readLast: &last index: indexFd log: logFd]) {
+        *seq = last.seq;
+        *epoch = last.epoch;
+        found = YES;
+    }
+
+    if (logFd >= 0) {
+        close(logFd);
+    }
+    if (indexFd >= 0) {
+        close(indexFd);
+    }
+    close(lockFd);
+    return found;
+}
+
+- (void) dealloc {
+    [directory release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface MessageStoreListener ()
+- (void) flush;
+@end
+
+@implementation MessageStoreListener
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener store: (MessageStore *)aStore {
+
+    self = [super init];
+    if (self != nil) {
+        listener = [aListener retain];
+        store = [aStore retain];
+        storedSubjects = [NSMutableSet new];
+        pending = [NSMutableDictionary new];
+        queue = dispatch_queue_create("com.migratorydata.samples.chat.store", DISPATCH_QUEUE_SERIAL);
+    }
+
+    return self;
+}
+
+- (void) setStoredSubjects: (NSArray *)subjects {
+    dispatch_sync(queue, ^{
+        [storedSubjects addObjectsFromArray: subjects];
+    });
+}
+
+- (void) removeStoredSubjects: (NSArray *)subjects {
+    dispatch_sync(queue, ^{
+        [storedSubjects minusSet: [NSSet setWithArray: subjects]];
+    });
+}
+
+// Write what is pending, one call to the store per subject; runs on the queue.
+- (void) flush {
+    flushScheduled = NO;
+    for (NSString *subject in pending) {
+        NSUInteger firstIndex;
+        if ([store appendMessages: [pending objectForKey: subject] subject: subject firstIndex: &firstIndex] > 0) {
+            NSDictionary *info = [NSDictionary dictionaryWithObjectsAndKeys: subject, MESSAGE_STORE_SUBJECT,
+                [NSNumber numberWithUnsignedInteger: firstIndex], MESSAGE_STORE_FIRST_INDEX, nil];
+            [[NSNotificationCenter defaultCenter] postNotificationName: MESSAGE_STORE_DID_APPEND object: store userInfo: info];
+        }
+    }
+    [pending removeAllObjects];
+    pendingCount = 0;
+}
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    // Historical messages may be older than the stored ones, they are left to the history pager
+    if ([message getMessageType] != HISTORICAL) {
+        dispatch_async(queue, ^{
+            NSString *subject = [message getSubject];
+            if ([storedSubjects containsObject: subject]) {
+                NSMutableArray *messages = [pending objectForKey: subject];
+                if (messages == nil) {
+                    messages = [NSMutableArray array];
+                    [pending setObject: messages forKey: subject];
+                }
+                StoredMessage *stored = [[StoredMessage alloc] initWithContent: [message getContent] seq: [message getSeq]
+                    epoch: [message getEpoch] time: [NSDate timeIntervalSinceReferenceDate]];
+                [messages addObject: stored];
+                [stored release];
+                pendingCount++;
+
+                if (pendingCount >= STORE_BATCH_SIZE) {
+                    [self flush];
+                } else if (!flushScheduled) {
+                    flushScheduled = YES;
+                    [self retain];
+                    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(STORE_BATCH_DELAY * NSEC_PER_SEC)), queue, ^{
+                        if (flushScheduled) {
+                            [self flush];
+                        }
+                        [self release];
+                    });
+                }
+            }
+        });
+    }
+
+    [listener onMessage: message];
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+    [listener onStatus: status info: info];
+}
+
+- (void) dealloc {
+    // A pending flush retains the listener, nothing is left to write
+    dispatch_release(queue);
+    [pending release];
+    [storedSubjects release];
+    [store release];
+    [listener release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,64 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataListener.h"
+
+/**
+ * The delivery priority of a subject.
+ */
+typedef NS_ENUM(NSInteger, DeliveryPriority) {
+    /**
+     * Messages are delivered to the listener as soon as they are received. This is the default.
+     */
+    PRIORITY_FOREGROUND = 0,
+
+    /**
+     * Messages are held and delivered to the listener in batches, at most once per flush interval.
+     */
+    PRIORITY_BACKGROUND,
+
+    /**
+     * Messages are not delivered, only the number of messages received is reported once per flush interval.
+     */
+    PRIORITY_COUNT_ONLY
+};
+
+/**
+ * Called on the main queue with the number of messages received for each PRIORITY_COUNT_ONLY subject since the
+ * previous call, as NSNumber values keyed by subject.
+ */
+typedef void (^PendingCountsHandler)(NSDictionary *counts);
+
+/**
+ * Dispatch messages to the downstream listener by subject priority, so that the visible room stays responsive while
+ * busy background rooms are throttled or summarized as counts.
+ *
+ * Foreground messages, background batches and statuses are all delivered to the listener on one private serial
+ * queue, so the listener is never called concurrently. A background batch is delivered a few messages at a time, and
+ * the foreground messages received meanwhile are delivered in between, so a large batch does not delay the visible
+ * room; the messages of each subject keep their order. The flush timer only runs while messages are held or counted.
+ */
+@interface PriorityDispatcher : NSObject <MigratoryDataListener> {
+    NSObject<MigratoryDataListener> *listener;
+    PendingCountsHandler countsHandler;
+
+    NSMutableDictionary *priorities;
+    NSMutableArray *deferred;
+    NSMutableDictionary *counts;
+    NSMutableArray *backlog;
+
+    dispatch_queue_t queue;
+    dispatch_queue_t deliveryQueue;
+    dispatch_source_t timer;
+    uint64_t flushNanos;
+    BOOL timerSuspended;
+}
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener flushInterval: (NSTimeInterval)interval;
+
+- (void) setPriority: (DeliveryPriority)priority forSubjects: (NSArray *)subjects;
+
+- (DeliveryPriority) priorityForSubject: (NSString *)subject;
+
+- (void) setPendingCountsHandler: (PendingCountsHandler)handler;
+
+@end
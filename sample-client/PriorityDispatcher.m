@@ -0,0 +1,238 @@
+#import "PriorityDispatcher.h"
+
+// Messages of a background batch delivered before the foreground messages waiting behind them
+#define BACKLOG_CHUNK 16
+
+@interface PriorityDispatcher ()
+- (void) flush;
+- (void) flushSubject: (NSString *)subject;
+- (void) deliver: (NSArray *)messages;
+- (void) deliverBatch: (NSArray *)messages;
+- (void) drainBacklog;
+- (void) startTimer;
+@end
+
+@implementation PriorityDispatcher
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener flushInterval: (NSTimeInterval)interval {
+
+    self = [super init];
+    if (self != nil) {
+        listener = [aListener retain];
+        priorities = [NSMutableDictionary new];
+        deferred = [NSMutableArray new];
+        counts = [NSMutableDictionary new];
+        backlog = [NSMutableArray new];
+
+        queue = dispatch_queue_create("com.migratorydata.samples.chat.priority", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(queue, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0));
+
+        // The only queue on which the listener is called; foreground messages must not wait behind the timer
+        deliveryQueue = dispatch_queue_create("com.migratorydata.samples.chat.priority.delivery", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(deliveryQueue, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0));
+
+        // Not retained by the timer, the timer is cancelled on its queue in dealloc; started by the first message held
+        __block PriorityDispatcher *blockSelf = self;
+        flushNanos = (uint64_t)(interval * NSEC_PER_SEC);
+        timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+        dispatch_source_set_event_handler(timer, ^{
+            [blockSelf flush];
+        });
+        timerSuspended = YES;
+    }
+
+    return self;
+}
+
+- (void) setPriority: (DeliveryPriority)priority forSubjects: (NSArray *)subjects {
+    dispatch_sync(queue, ^{
+        for (NSString *subject in subjects) {
+            if (priority == PRIORITY_FOREGROUND) {
+                [priorities removeObjectForKey: subject];
+                [counts removeObjectForKey: subject];
+                // Deliver what is held for the subject before its new messages, so order is kept
+                [self flushSubject: subject];
+            } else {
+                [priorities setObject: [NSNumber numberWithInteger: priority] forKey: subject];
+            }
+        }
+    });
+}
+
+- (DeliveryPriority) priorityForSubject: (NSString *)subject {
+    __block DeliveryPriority priority;
+    dispatch_sync(queue, ^{
+        priority = [[priorities objectForKey: subject] integerValue];
+    });
+    return priority;
+}
+
+- (void) setPendingCountsHandler: (PendingCountsHandler)handler {
+    dispatch_sync(queue, ^{
+        [countsHandler release];
+        countsHandler = [handler copy];
+        if ([counts count] > 0) {
+            [self startTimer];
+        }
+    });
+}
+
+// Called on the state queue; the first flush is one interval after the first message held.
+- (void) startTimer {
+    if (timerSuspended) {
+        timerSuspended = NO;
+        dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, flushNanos), flushNanos, flushNanos / 10);
+        dispatch_resume(timer);
+    }
+}
+
+- (void) flushSubject: (NSString *)subject {
+    NSMutableArray *held = [NSMutableArray array];
+    NSMutableIndexSet *indexes = [NSMutableIndexSet indexSet];
+    [deferred enumerateObjectsUsingBlock: ^(MigratoryDataMessage *message, NSUInteger index, BOOL *stop) {
+        if ([[message getSubject] isEqualToString: subject]) {
+            [held addObject: message];
+            [indexes addIndex: index];
+        }
+    }];
+    [deferred removeObjectsAtIndexes: indexes];
+
+    // The messages of the subject still in the backlog are delivered first, before its new foreground messages
+    dispatch_async(deliveryQueue, ^{
+        NSMutableArray *pending = [NSMutableArray array];
+        NSMutableIndexSet *pendingIndexes = [NSMutableIndexSet indexSet];
+        [backlog enumerateObjectsUsingBlock: ^(MigratoryDataMessage *message, NSUInteger index, BOOL *stop) {
+            if ([[message getSubject] isEqualToString: subject]) {
+                [pending addObject: message];
+                [pendingIndexes addIndex: index];
+            }
+        }];
+        [backlog removeObjectsAtIndexes: pendingIndexes];
+
+        for (MigratoryDataMessage *message in [pending arrayByAddingObjectsFromArray: held]) {
+            [listener onMessage: message];
+        }
+    });
+}
+
+// Called on the state queue, so that messages are queued for delivery in the order their priority was decided
+- (void) deliver: (NSArray *)messages {
+    if ([messages count] == 0) {
+        return;
+    }
+
+    dispatch_async(deliveryQueue, ^{
+        for (MigratoryDataMessage *message in messages) {
+            [listener onMessage: message];
+        }
+    });
+}
+
+// Called on the state queue; the batch is appended to the backlog, drained on the delivery queue.
+- (void) deliverBatch: (NSArray *)messages {
+    dispatch_async(deliveryQueue, ^{
+        BOOL draining = [backlog count] > 0;
+        [backlog addObjectsFromArray: messages];
+        if (!draining) {
+            [self drainBacklog];
+        }
+    });
+}
+
+// Called on the delivery queue: deliver a chunk of the backlog, then queue the rest behind what was queued meanwhile.
+- (void) drainBacklog {
+    NSUInteger count = MIN([backlog count], BACKLOG_CHUNK);
+    if (count == 0) {
+        return;
+    }
+    NSArray *chunk = [backlog subarrayWithRange: NSMakeRange(0, count)];
+    [backlog removeObjectsInRange: NSMakeRange(0, count)];
+
+    for (MigratoryDataMessage *message in chunk) {
+        [listener onMessage: message];
+    }
+    if ([backlog count] > 0) {
+        dispatch_async(deliveryQueue, ^{
+            [self drainBacklog];
+        });
+    }
+}
+
+- (void) flush {
+    if ([deferred count] > 0) {
+        NSArray *batch = [[deferred copy] autorelease];
+        [deferred removeAllObjects];
+
+        [self deliverBatch: batch];
+    }
+
+    if ([counts count] > 0 && countsHandler != nil) {
+        NSDictionary *snapshot = [[counts copy] autorelease];
+        PendingCountsHandler handler = [[countsHandler retain] autorelease];
+        [counts removeAllObjects];
+
+        dispatch_async(dispatch_get_main_queue(), ^{
+            handler(snapshot);
+        });
+    }
+
+    // Nothing held, or counts without a handler to take them; the next message held starts the timer again
+    if ([deferred count] == 0 && ([counts count] == 0 || countsHandler == nil) && !timerSuspended) {
+        timerSuspended = YES;
+        dispatch_suspend(timer);
+    }
+}
+
+- (void)onMessage:(MigratoryDataMessage *)message {
+    NSString *subject = [message getSubject];
+
+    dispatch_sync(queue, ^{
+        DeliveryPriority priority = [[priorities objectForKey: subject] integerValue];
+        if (priority == PRIORITY_FOREGROUND) {
+            [self deliver: [NSArray arrayWithObject: message]];
+        } else if (priority == PRIORITY_BACKGROUND) {
+            [deferred addObject: message];
+            [self startTimer];
+        } else if (priority == PRIORITY_COUNT_ONLY) {
+            NSUInteger count = [[counts objectForKey: subject] unsignedIntegerValue];
+            [counts setObject: [NSNumber numberWithUnsignedInteger: count + 1] forKey: subject];
+            if (countsHandler != nil) {
+                [self startTimer];
+            }
+        }
+    });
+}
+
+- (void) onStatus: (NSString *)status info:(NSString *)info {
+    dispatch_sync(queue, ^{
+        dispatch_async(deliveryQueue, ^{
+            [listener onStatus: status info: info];
+        });
+    });
+}
+
+- (void) dealloc {
+    // Cancelled on its queue, so a tick in progress completes first and none starts after
+    dispatch_sync(queue, ^{
+        dispatch_source_cancel(timer);
+        // A suspended source must be resumed before it is released
+        if (timerSuspended) {
+            timerSuspended = NO;
+            dispatch_resume(timer);
+        }
+    });
+    dispatch_release(timer);
+    dispatch_release(queue);
+    dispatch_release(deliveryQueue);
+
+    [backlog release];
+    [countsHandler release];
+    [counts release];
+    [deferred release];
+    [priorities release];
+    [listener release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,61 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataClient.h"
+#import "MigratoryDataListener.h"
+#import "ClientMetrics.h"
+
+/**
+ * Coalesce the acknowledgments of GUARANTEED publishes.
+ *
+ * Each published message with a closure costs a status notification from the server. When no acknowledgment is
+ * pending for a subject, a GUARANTEED message with a closure is published at once; while one is pending, the next ones
+ * are held until it arrives, for at most maxDelay or until maxMessages are held, and published as a batch where only
+ * the last message carries a closure. Batches never mix subjects, so all the messages of a batch share the same
+ * entitlement and connection, and the server handles them in order.
+ *
+ * The status answering a batch is reported to the listener once per original closure, as follows. A failed or denied
+ * batch is reported failed or denied for each of its messages. Messages larger than 4 KB are never batched, so a
+ * size limit status only ever answers one message. When the connection went down while a batch was waiting for its
+ * acknowledgment, only its last message is reported published, the others are reported failed. Other messages, STANDARD or without a closure, are published at once, after the messages held for their subject, so the
+ * order of the messages of a subject is kept.
+ */
+@interface PublishCoalescer : NSObject <MigratoryDataListener> {
+    MigratoryDataClient *client;
+    NSObject<MigratoryDataListener> *listener;
+    ClientMetrics *metrics;
+
+    NSUInteger maxMessages;
+    NSTimeInterval maxDelay;
+
+    NSMutableDictionary *held;
+    NSMutableDictionary *batches;
+    NSCountedSet *pendingSubjects;
+    int batchId;
+    unsigned long long coalescedAcks;
+
+    dispatch_queue_t queue;
+    NSUInteger generation;
+    BOOL timerPending;
+}
+
+- (id) initWithClient: (MigratoryDataClient *)aClient listener: (NSObject<MigratoryDataListener> *)aListener maxMessages: (NSUInteger)messages maxDelay: (NSTimeInterval)delay;
+
+- (void) publish: (MigratoryDataMessage *)message;
+
+/**
+ * Count the published messages in the given metrics.
+ */
+- (void) setMetrics: (ClientMetrics *)aMetrics;
+
+/**
+ * Publish the held messages now.
+ */
+- (void) flush;
+
+/**
+ * The number of server acknowledgments saved by coalescing, i.e. the closures answered by the acknowledgment of
+ * another message of their batch.
+ */
+- (unsigned long long) coalescedAckCount;
+
+@end
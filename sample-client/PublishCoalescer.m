@@ -0,0 +1,217 @@
+#import "PublishCoalescer.h"
+
+// Content larger than this is published alone, so that a size limit status answers only its own message
+#define COALESCE_MAX_BYTES 4096
+
+// The original closures of a batch of messages published with one acknowledgment.
+@interface PublishBatch : NSObject {
+@public
+    NSString *subject;
+    NSString *ackClosure;
+    NSArray *closures;
+    BOOL interrupted;
+}
+@end
+
+@implementation PublishBatch
+
+- (void) dealloc {
+    [closures release];
+    [ackClosure release];
+    [subject release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface PublishCoalescer ()
+- (void) flushSubject: (NSString *)subject;
+- (void) flushHeld;
+- (void) scheduleFlush;
+@end
+
+@implementation PublishCoalescer
+
+- (id) initWithClient: (MigratoryDataClient *)aClient listener: (NSObject<MigratoryDataListener> *)aListener maxMessages: (NSUInteger)messages maxDelay: (NSTimeInterval)delay {
+
+    self = [super init];
+    if (self != nil) {
+        // Not retained, the client retains its listener
+        client = aClient;
+        listener = [aListener retain];
+        maxMessages = messages;
+        maxDelay = delay;
+        held = [NSMutableDictionary new];
+        batches = [NSMutableDictionary new];
+        pendingSubjects = [NSCountedSet new];
+        queue = dispatch_queue_create("com.migratorydata.samples.chat.publish", DISPATCH_QUEUE_SERIAL);
+    }
+
+    return self;
+}
+
+- (void) setMetrics: (ClientMetrics *)aMetrics {
+    [metrics release];
+    metrics = [aMetrics retain];
+}
+
+- (void) publish: (MigratoryDataMessage *)message {
+    [metrics countPublish: message];
+
+    dispatch_async(queue, ^{
+        NSString *subject = [message getSubject];
+        BOOL coalesced = [message getQos] == GUARANTEED && [message getClosure] != nil
+            && [[message getContent] lengthOfBytesUsingEncoding: NSUTF8StringEncoding] <= COALESCE_MAX_BYTES;
+
+        if (!coalesced) {
+            // Keep the order of the subject: what is held for it goes first
+            [self flushSubject: subject];
+            [client publish: message];
+            return;
+        }
+
+        NSMutableArray *messages = [held objectForKey: subject];
+        if (messages == nil) {
+            messages = [NSMutableArray array];
+            [held setObject: messages forKey: subject];
+        }
+        [messages addObject: message];
+
+        // Nothing to wait for when no acknowledgment is pending for the subject
+        if ([pendingSubjects countForObject: subject] == 0 || [messages count] >= maxMessages) {
+            [self flushSubject: subject];
+        } else {
+            [self scheduleFlush];
+        }
+    });
+}
+
+- (void) flush {
+    dispatch_async(queue, ^{
+        [self flushHeld];
+    });
+}
+
+- (unsigned long long) coalescedAckCount {
+    __block unsigned long long count;
+    dispatch_sync(queue, ^{
+        count = coalescedAcks;
+    });
+    return count;
+}
+
+// Called on the queue.
+- (void) scheduleFlush {
+    if (timerPending) {
+        return;
+    }
+    timerPending = YES;
+
+    NSUInteger current = generation;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(maxDelay * NSEC_PER_SEC)), queue, ^{
+        if (generation == current) {
+            timerPending = NO;
+            [self flushHeld];
+        }
+    });
+}
+
+// Called on the queue.
+- (void) flushHeld {
+    for (NSString *subject in [held allKeys]) {
+        [self flushSubject: subject];
+    }
+}
+
+// Called on the queue.
+- (void) flushSubject: (NSString *)subject {
+    NSArray *messages = [[[held objectForKey: subject] retain] autorelease];
+    if (messages == nil) {
+        return;
+    }
+    [held removeObjectForKey: subject];
+    if ([held count] == 0) {
+        // Nothing left for the pending timer
+        generation++;
+        timerPending = NO;
+    }
+
+    PublishBatch *batch = [[PublishBatch new] autorelease];
+    batch->subject = [subject copy];
+    batch->ackClosure = [[NSString alloc] initWithFormat: @"batch-%d", ++batchId];
+    NSMutableArray *closures = [NSMutableArray arrayWithCapacity: [messages count]];
+    for (MigratoryDataMessage *message in messages) {
+        [closures addObject: [message getClosure]];
+    }
+    batch->closures = [closures copy];
+    [batches setObject: batch forKey: batch->ackClosure];
+    [pendingSubjects addObject: subject];
+    coalescedAcks += [messages count] - 1;
+
+    NSUInteger last = [messages count] - 1;
+    [messages enumerateObjectsUsingBlock: ^(MigratoryDataMessage *message, NSUInteger index, BOOL *stop) {
+        MigratoryDataMessage *copy = [[MigratoryDataMessage alloc] init: [message getSubject] content: [message getContent]
+            closure: (index == last ? batch->ackClosure : nil) qos: GUARANTEED retained: [message isRetained] replySubject: [message getReplySubject]];
+        [copy setCompressed: [message isCompressed]];
+        [client publish: copy];
+        [copy release];
+    }];
+}
+
+- (void)onMessage:(MigratoryDataMessage *)message {
+    [listener onMessage: message];
+}
+
+- (void) onStatus: (NSString *)status info:(NSString *)info {
+    if ([status isEqualToString: NOTIFY_SERVER_DOWN]) {
+        // The messages of the batches in flight before the last one may be lost with the connection
+        dispatch_async(queue, ^{
+            for (PublishBatch *batch in [batches allValues]) {
+                batch->interrupted = YES;
+            }
+        });
+    }
+
+    BOOL publishStatus = [status isEqualToString: NOTIFY_PUBLISH_OK] || [status isEqualToString: NOTIFY_PUBLISH_FAILED]
+        || [status isEqualToString: NOTIFY_PUBLISH_DENIED] || [status isEqualToString: NOTIFY_MESSAGE_SIZE_LIMIT_EXCEEDED];
+    if (!publishStatus || ![info hasPrefix: @"batch-"]) {
+        [listener onStatus: status info: info];
+        return;
+    }
+
+    __block NSArray *closures = nil;
+    __block BOOL interrupted = NO;
+    dispatch_sync(queue, ^{
+        PublishBatch *batch = [batches objectForKey: info];
+        if (batch != nil) {
+            closures = [batch->closures retain];
+            interrupted = batch->interrupted;
+            [pendingSubjects removeObject: batch->subject];
+            // The acknowledgment the held messages were waiting for
+            [self flushSubject: [[batch->subject retain] autorelease]];
+            [batches removeObjectForKey: info];
+        }
+    });
+
+    NSUInteger last = [closures count] - 1;
+    [closures enumerateObjectsUsingBlock: ^(NSString *closure, NSUInteger index, BOOL *stop) {
+        BOOL unconfirmed = interrupted && index != last && [status isEqualToString: NOTIFY_PUBLISH_OK];
+        [listener onStatus: (unconfirmed ? NOTIFY_PUBLISH_FAILED : status) info: closure];
+    }];
+    [closures release];
+}
+
+- (void) dealloc {
+    dispatch_release(queue);
+
+    [metrics release];
+    [pendingSubjects release];
+    [batches release];
+    [held release];
+    [listener release];
+
+    [super dealloc];
+}
+
+@end
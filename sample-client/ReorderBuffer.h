@@ -0,0 +1,44 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataListener.h"
+
+/**
+ * A status notification which indicates that messages of a reordered subject are missing and will not be delivered.
+ * The detail information gives the subject and the missing seq range, e.g. "/rooms/demoRoom 12-15".
+ */
+extern NSString *NOTIFY_SEQUENCE_GAP;
+
+/**
+ * Deliver the messages of the reordered subjects in seq order.
+ *
+ * While a subject is synchronized after a failover, recovered messages and new live messages can interleave. For the
+ * subjects enabled with setReorderingForSubjects:, a message received ahead of its predecessors is held until the gap
+ * closes or a timeout expires, in which case a NOTIFY_SEQUENCE_GAP status is emitted and delivery continues with the
+ * held messages. Listeners can thus append messages without sorting them. A message which arrives after its gap was
+ * reported, or from an epoch older than the current one, is dropped and counted by lateDroppedCount. The listeners
+ * upstream must forward late messages for them to be placed here.
+ */
+@interface ReorderBuffer : NSObject <MigratoryDataListener> {
+    NSObject<MigratoryDataListener> *listener;
+
+    NSTimeInterval gapTimeout;
+    NSUInteger maxHeld;
+
+    NSMutableDictionary *sequences;
+    unsigned long long lateDropped;
+
+    dispatch_queue_t queue;
+}
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener gapTimeout: (NSTimeInterval)timeout maxHeld: (NSUInteger)held;
+
+- (void) setReorderingForSubjects: (NSArray *)subjects;
+
+- (void) removeReorderingForSubjects: (NSArray *)subjects;
+
+/**
+ * The number of messages dropped because they arrived after their gap was reported or from an older epoch.
+ */
+- (unsigned long long) lateDroppedCount;
+
+@end
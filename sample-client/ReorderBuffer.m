@@ -0,0 +1,204 @@
+#import "ReorderBuffer.h"
+
+NSString *NOTIFY_SEQUENCE_GAP = @"NOTIFY_SEQUENCE_GAP";
+
+// Reordering state for one subject.
+@interface SubjectSequence : NSObject {
+@public
+    BOOL started;
+    int epoch;
+    int nextSeq;
+
+    NSMutableDictionary *held;
+    NSUInteger generation;
+}
+@end
+
+@implementation SubjectSequence
+
+- (id) init {
+
+    self = [super init];
+    if (self != nil) {
+        held = [NSMutableDictionary new];
+    }
+
+    return self;
+}
+
+- (void) dealloc {
+    [held release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface ReorderBuffer ()
+- (void) deliverInOrder: (SubjectSequence *)sequence;
+- (void) skipGap: (SubjectSequence *)sequence subject: (NSString *)subject;
+- (void) scheduleGapTimeout: (SubjectSequence *)sequence subject: (NSString *)subject;
+@end
+
+@implementation ReorderBuffer
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener gapTimeout: (NSTimeInterval)timeout maxHeld: (NSUInteger)held {
+
+    self = [super init];
+    if (self != nil) {
+        listener = [aListener retain];
+        gapTimeout = timeout;
+        maxHeld = held;
+        sequences = [NSMutableDictionary new];
+        queue = dispatch_queue_create("com.migratorydata.samples.chat.reorder", DISPATCH_QUEUE_SERIAL);
+    }
+
+    return self;
+}
+
+- (void) setReorderingForSubjects: (NSArray *)subjects {
+    dispatch_sync(queue, ^{
+        for (NSString *subject in subjects) {
+            if ([sequences objectForKey: subject] == nil) {
+                [sequences setObject: [[SubjectSequence new] autorelease] forKey: subject];
+            }
+        }
+    });
+}
+
+- (void) removeReorderingForSubjects: (NSArray *)subjects {
+    dispatch_sync(queue, ^{
+        for (NSString *subject in subjects) {
+            SubjectSequence *sequence = [sequences objectForKey: subject];
+            if (sequence == nil) {
+                continue;
+            }
+            // Hand over what is held, in order
+            while ([sequence->held count] > 0) {
+                [self skipGap: sequence subject: subject];
+            }
+            [sequences removeObjectForKey: subject];
+        }
+    });
+}
+
+- (unsigned long long) lateDroppedCount {
+    __block unsigned long long count;
+    dispatch_sync(queue, ^{
+        count = lateDropped;
+    });
+    return count;
+}
+
+// Deliver the held messages which follow the last delivered one without a gap.
+- (void) deliverInOrder: (SubjectSequence *)sequence {
+    while (YES) {
+        NSNumber *key = [NSNumber numberWithInt: sequence->nextSeq];
+        MigratoryDataMessage *message = [sequence->held objectForKey: key];
+        if (message == nil) {
+            return;
+        }
+
+        [[message retain] autorelease];
+        [sequence->held removeObjectForKey: key];
+        sequence->nextSeq++;
+
+        [listener onMessage: message];
+    }
+}
+
+// Give up waiting for the missing messages before the lowest held one.
+- (void) skipGap: (SubjectSequence *)sequence subject: (NSString *)subject {
+    int lowest = INT_MAX;
+    for (NSNumber *seq in sequence->held) {
+        lowest = MIN(lowest, [seq intValue]);
+    }
+
+    NSString *info = [NSString stringWithFormat: @"%@ %d-%d", subject, sequence->nextSeq, lowest - 1];
+    [listener onStatus: NOTIFY_SEQUENCE_GAP info: info];
+
+    sequence->nextSeq = lowest;
+    [self deliverInOrder: sequence];
+}
+
+- (void) scheduleGapTimeout: (SubjectSequence *)sequence subject: (NSString *)subject {
+    NSUInteger generation = ++sequence->generation;
+
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(gapTimeout * NSEC_PER_SEC)), queue, ^{
+        SubjectSequence *current = [sequences objectForKey: subject];
+        if (current != sequence || sequence->generation != generation || [sequence->held count] == 0) {
+            return;
+        }
+
+        [self skipGap: sequence subject: subject];
+        if ([sequence->held count] > 0) {
+            [self scheduleGapTimeout: sequence subject: subject];
+        }
+    });
+}
+
+- (void)onMessage:(MigratoryDataMessage *)message {
+    dispatch_sync(queue, ^{
+        NSString *subject = [message getSubject];
+        SubjectSequence *sequence = [sequences objectForKey: subject];
+        if (sequence == nil) {
+            [listener onMessage: message];
+            return;
+        }
+
+        int seq = [message getSeq];
+        int epoch = [message getEpoch];
+
+        if (sequence->started && epoch < sequence->epoch) {
+            // Left over from before an epoch change, it can no longer be placed
+            lateDropped++;
+            return;
+        }
+
+        if (!sequence->started || epoch > sequence->epoch) {
+            // Sequence numbers restart with a new epoch, hand over the previous epoch first
+            while ([sequence->held count] > 0) {
+                [self skipGap: sequence subject: subject];
+            }
+            sequence->started = YES;
+            sequence->epoch = epoch;
+            sequence->nextSeq = seq;
+        }
+
+        if (seq < sequence->nextSeq) {
+            lateDropped++;
+            return;
+        }
+
+        BOOL wasWaiting = [sequence->held count] > 0;
+        [sequence->held setObject: message forKey: [NSNumber numberWithInt: seq]];
+        [self deliverInOrder: sequence];
+
+        while ([sequence->held count] > maxHeld) {
+            [self skipGap: sequence subject: subject];
+        }
+
+        if ([sequence->held count] > 0 && !wasWaiting) {
+            [self scheduleGapTimeout: sequence subject: subject];
+        } else if ([sequence->held count] == 0) {
+            sequence->generation++;
+        }
+    });
+}
+
+- (void) onStatus: (NSString *)status info:(NSString *)info {
+    dispatch_sync(queue, ^{
+        [listener onStatus: status info: info];
+    });
+}
+
+- (void) dealloc {
+    dispatch_release(queue);
+
+    [sequences release];
+    [listener release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,66 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataClient.h"
+#import "MigratoryDataListener.h"
+#import "SubscriptionCache.h"
+#import "TimingWheel.h"
+
+extern NSString *RequestReplyErrorDomain;
+
+/**
+ * The error codes of RequestReplyErrorDomain.
+ */
+typedef NS_ENUM(NSInteger, RequestReplyError) {
+    /**
+     * No reply was received before the request timed out.
+     */
+    REQUEST_TIMEOUT = 1,
+
+    /**
+     * The content of the request is not a JSON object.
+     */
+    REQUEST_INVALID_CONTENT
+};
+
+/**
+ * Called on the main queue with the reply to a request, or with an error.
+ */
+typedef void (^ReplyCompletion)(MigratoryDataMessage *reply, NSError *error);
+
+/**
+ * Request/reply on top of the reply subject of MigratoryDataMessage.
+ *
+ * A private reply inbox is subscribed once, with the first request. The content of a request must be a JSON object;
+ * an integer "rid" member is added to it and responders are expected to copy it into their reply, which must also be a
+ * JSON object published on the reply subject of the request. Pending requests expire on a timing wheel, so any
+ * number of outstanding requests costs O(1) per timeout.
+ */
+@interface RequestReply : NSObject <MigratoryDataListener> {
+    MigratoryDataClient *client;
+    SubscriptionCache *subscriptions;
+
+    NSString *inbox;
+    BOOL subscribed;
+    int nextId;
+
+    NSMutableDictionary *pending;
+    TimingWheel *wheel;
+    NSTimeInterval wheelTime;
+
+    dispatch_queue_t queue;
+    dispatch_source_t timer;
+    BOOL timerRunning;
+}
+
+- (id) initWithClient: (MigratoryDataClient *)aClient subscriptions: (SubscriptionCache *)cache;
+
+- (void) request: (MigratoryDataMessage *)message timeout: (NSTimeInterval)timeout completion: (ReplyCompletion)completion;
+
+- (NSUInteger) pendingCount;
+
+/**
+ * Unsubscribe the reply inbox. The local subscription retains this object until then.
+ */
+- (void) close;
+
+@end
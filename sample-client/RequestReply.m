@@ -0,0 +1,177 @@
+#import "RequestReply.h"
+
+NSString *RequestReplyErrorDomain = @"RequestReplyErrorDomain";
+
+// The tick of the timing wheel, i.e. the precision of the timeouts
+#define WHEEL_TICK 0.05
+
+@interface RequestReply ()
+- (void) expire;
+- (void) complete: (ReplyCompletion)completion reply: (MigratoryDataMessage *)reply error: (NSError *)error;
+@end
+
+@implementation RequestReply
+
+- (id) initWithClient: (MigratoryDataClient *)aClient subscriptions: (SubscriptionCache *)cache {
+
+    self = [super init];
+    if (self != nil) {
+        // Not retained, the client and the subscriptions retain their listeners
+        client = aClient;
+        subscriptions = cache;
+
+        inbox = [[NSString alloc] initWithFormat: @"/inbox/%@", [[NSUUID UUID] UUIDString]];
+        pending = [NSMutableDictionary new];
+        wheel = [[TimingWheel alloc] initWithTick: WHEEL_TICK];
+
+        queue = dispatch_queue_create("com.migratorydata.samples.chat.request", DISPATCH_QUEUE_SERIAL);
+
+        // Not retained by the timer, the timer is cancelled in dealloc
+        __block RequestReply *blockSelf = self;
+        uint64_t nanos = (uint64_t)(WHEEL_TICK * NSEC_PER_SEC);
+        timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+        dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, nanos), nanos, nanos / 10);
+        dispatch_source_set_event_handler(timer, ^{
+            [blockSelf expire];
+        });
+    }
+
+    return self;
+}
+
+- (void) request: (MigratoryDataMessage *)message timeout: (NSTimeInterval)timeout completion: (ReplyCompletion)completion {
+    // Splice the request id in front of the members of the JSON object, rather than parsing it
+    NSString *content = [[message getContent] stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    if (![content hasPrefix: @"{"] || ![content hasSuffix: @"}"]) {
+        NSError *error = [NSError errorWithDomain: RequestReplyErrorDomain code: REQUEST_INVALID_CONTENT userInfo: nil];
+        [self complete: completion reply: nil error: error];
+        return;
+    }
+
+    __block int rid;
+    __block BOOL subscribe = NO;
+    dispatch_sync(queue, ^{
+        rid = ++nextId;
+        [pending setObject: [[completion copy] autorelease] forKey: [NSNumber numberWithInt: rid]];
+        [wheel schedule: [NSNumber numberWithInt: rid] after: timeout];
+
+        if (!timerRunning) {
+            timerRunning = YES;
+            wheelTime = [NSDate timeIntervalSinceReferenceDate];
+            dispatch_resume(timer);
+        }
+
+        if (!subscribed) {
+            subscribed = YES;
+            subscribe = YES;
+        }
+    });
+
+    if (subscribe) {
+        [subscriptions addSubscriber: self forSubjects: [NSArray arrayWithObject: inbox]];
+    }
+
+    NSString *separator = [content length] > 2 ? @"," : @"";
+    NSString *requestContent = [NSString stringWithFormat: @"{\"rid\":%d%@%@", rid, separator, [content substringFromIndex: 1]];
+    MigratoryDataMessage *request = [[MigratoryDataMessage alloc] init: [message getSubject] content: requestContent closure: nil
+        qos: [message getQos] retained: NO replySubject: inbox];
+    [client publish: request];
+    [request release];
+}
+
+- (void) close {
+    __block BOOL unsubscribe;
+    dispatch_sync(queue, ^{
+        unsubscribe = subscribed;
+        subscribed = NO;
+    });
+
+    if (unsubscribe) {
+        [subscriptions removeSubscriber: self forSubjects: [NSArray arrayWithObject: inbox]];
+    }
+}
+
+- (NSUInteger) pendingCount {
+    __block NSUInteger count;
+    dispatch_sync(queue, ^{
+        count = [pending count];
+    });
+    return count;
+}
+
+- (void) complete: (ReplyCompletion)completion reply: (MigratoryDataMessage *)reply error: (NSError *)error {
+    dispatch_async(dispatch_get_main_queue(), ^{
+        completion(reply, error);
+    });
+}
+
+// Called on the queue at each tick of the timer.
+- (void) expire {
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+
+    // Catch up with the ticks the timer missed
+    while (wheelTime + [wheel tick] <= now) {
+        wheelTime += [wheel tick];
+
+        for (NSNumber *rid in [wheel advance]) {
+            ReplyCompletion completion = [pending objectForKey: rid];
+            if (completion == nil) {
+                // Already replied
+                continue;
+            }
+
+            NSError *error = [NSError errorWithDomain: RequestReplyErrorDomain code: REQUEST_TIMEOUT userInfo: nil];
+            [self complete: completion reply: nil error: error];
+            [pending removeObjectForKey: rid];
+        }
+    }
+
+    // Replied requests stay in the wheel until their timeout, stop ticking only when it is empty
+    if ([wheel count] == 0) {
+        timerRunning = NO;
+        dispatch_suspend(timer);
+    }
+}
+
+- (void)onMessage:(MigratoryDataMessage *)message {
+    if (![[message getSubject] isEqualToString: inbox]) {
+        return;
+    }
+
+    NSData *data = [[message getContent] dataUsingEncoding: NSUTF8StringEncoding];
+    id reply = data != nil ? [NSJSONSerialization JSONObjectWithData: data options: 0 error: nil] : nil;
+    id rid = [reply isKindOfClass: [NSDictionary class]] ? [reply objectForKey: @"rid"] : nil;
+    if (![rid isKindOfClass: [NSNumber class]]) {
+        return;
+    }
+
+    dispatch_sync(queue, ^{
+        NSNumber *key = [NSNumber numberWithInt: [rid intValue]];
+        ReplyCompletion completion = [pending objectForKey: key];
+        if (completion != nil) {
+            [self complete: completion reply: message error: nil];
+            [pending removeObjectForKey: key];
+        }
+    });
+}
+
+- (void) onStatus: (NSString *)status info:(NSString *)info {
+}
+
+- (void) dealloc {
+    dispatch_source_cancel(timer);
+    if (!timerRunning) {
+        // A suspended source must be resumed to be released
+        dispatch_resume(timer);
+    }
+    dispatch_release(timer);
+    dispatch_release(queue);
+
+    [wheel release];
+    [pending release];
+    [inbox release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,99 @@
+#import <Foundation/Foundation.h>
+
+#import "MessageStore.h"
+
+/**
+ * The summary of a chat room, for a room list.
+ */
+@interface RoomSummary : NSObject {
+    NSString *subject;
+    NSUInteger unreadCount;
+    NSString *preview;
+    NSTimeInterval lastActivity;
+    int lastSeq;
+    int lastEpoch;
+}
+
+- (id) initWithSubject: (NSString *)aSubject unreadCount: (NSUInteger)unread preview: (NSString *)aPreview lastActivity: (NSTimeInterval)activity lastSeq: (int)seq lastEpoch: (int)epoch;
+
+- (NSString *) subject;
+
+/**
+ * The number of messages stored since the room was last marked read.
+ */
+- (NSUInteger) unreadCount;
+
+/**
+ * The beginning of the last message, as shown in a room list.
+ */
+- (NSString *) preview;
+
+/**
+ * The time of the last message, since the reference date.
+ */
+- (NSTimeInterval) lastActivity;
+
+- (int) lastSeq;
+- (int) lastEpoch;
+
+@end
+
+/**
+ * Keep a summary of every chat room stored in a MessageStore, so a room list is shown without reading any message.
+ *
+ * The summaries follow the store rather than the client: after each MESSAGE_STORE_DID_APPEND, the messages appended
+ * at the end of the log of a room update its unread count since the last read message, the preview of the last
+ * message and the time of the last activity, so a message counts once whether the client, a push or the Notification
+ * Service Extension stored it. An insertion before the messages already counted, and the messages stored by the
+ * extension while the app was suspended, are counted again from the end of the store by refresh. Historical messages
+ * are not stored and a snapshot already stored is skipped by the store, so neither counts as unread.
+ *
+ * Only the subjects enabled with setSummarizedSubjects: are summarized, the chat subjects given to
+ * MessageStoreListener. The summaries are saved in a single file in the directory of the store shortly after they
+ * change; the file is loaded and the store read on a private queue, never on the calling thread.
+ */
+@interface RoomSummaryIndex : NSObject {
+    MessageStore *store;
+
+    NSString *path;
+    NSMutableSet *summarizedSubjects;
+    NSMutableDictionary *rooms;
+    BOOL saveScheduled;
+
+    dispatch_queue_t queue;
+}
+
+- (id) initWithStore: (MessageStore *)aStore;
+
+/**
+ * Summarize the given subjects, counting their stored messages.
+ */
+- (void) setSummarizedSubjects: (NSArray *)subjects;
+
+/**
+ * Count again the stored messages of every room from the end of the store, e.g. when the app returns to foreground
+ * after the extension stored messages.
+ */
+- (void) refresh;
+
+/**
+ * The summary of a room, or nil if the room is not summarized or no message of the room was stored.
+ */
+- (RoomSummary *) summaryForSubject: (NSString *)subject;
+
+/**
+ * The summaries of all rooms, the most recently active first.
+ */
+- (NSArray *) summaries;
+
+/**
+ * Mark the messages of a room read up to the last one stored.
+ */
+- (void) markReadSubject: (NSString *)subject;
+
+/**
+ * Write the summaries now rather than after the save delay, e.g. when the app goes to background.
+ */
+- (void) save;
+
+@end
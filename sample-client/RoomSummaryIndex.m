@@ -0,0 +1,394 @@
+#import "RoomSummaryIndex.h"
+#import "JSONFieldExtractor.h"
+
+// Changes within this time are saved together
+#define SUMMARY_SAVE_DELAY 1.0
+
+// Characters kept for the preview
+#define SUMMARY_PREVIEW_LENGTH 100
+
+// Stored messages read at once while counting from the end of the store
+#define SUMMARY_RECONCILE_CHUNK 64
+
+// Stored messages read at most while counting, older unread messages are not counted
+#define SUMMARY_RECONCILE_MAX 1000
+
+static NSString *Preview(NSString *content) {
+    const char *keys[] = { "user", "text" };
+    NSString *fields[2];
+    JSONStringFields(content, keys, fields, 2);
+    NSString *user = fields[0], *text = fields[1];
+    NSString *preview = (user != nil && text != nil) ? [NSString stringWithFormat: @"%@: %@", user, text] : content;
+    if ([preview length] > SUMMARY_PREVIEW_LENGTH) {
+        preview = [preview substringWithRange: [preview rangeOfComposedCharacterSequencesForRange: NSMakeRange(0, SUMMARY_PREVIEW_LENGTH)]];
+    }
+    return preview != nil ? preview : @"";
+}
+
+// Whether a message comes after the given seq and epoch, in the order of the store.
+static BOOL IsAfter(StoredMessage *message, int seq, int epoch) {
+    return [message epoch] > epoch || ([message epoch] == epoch && [message seq] > seq);
+}
+
+// The mutable summary of a room, saved as a property list with the last message read.
+@interface RoomState : NSObject {
+@public
+    NSUInteger unread;
+    NSString *preview;
+    NSTimeInterval lastActivity;
+    int lastSeq;
+    int lastEpoch;
+    BOOL hasLast;
+    int readSeq;
+    int readEpoch;
+    BOOL hasRead;
+    // The stored messages counted, not saved: the store may change before the next load
+    NSUInteger storedCount;
+}
+- (id) initWithPropertyList: (NSDictionary *)plist;
+- (NSDictionary *) propertyList;
+- (void) setPreview: (NSString *)aPreview;
+- (BOOL) isUnread: (StoredMessage *)message;
+- (void) setLast: (StoredMessage *)message;
+@end
+
+@implementation RoomState
+
+- (id) initWithPropertyList: (NSDictionary *)plist {
+
+    self = [super init];
+    if (self != nil) {
+        storedCount = NSNotFound;
+    }
+    if (self != nil && plist != nil) {
+        unread = [[plist objectForKey: @"unread"] unsignedIntegerValue];
+        preview = [[plist objectForKey: @"preview"] copy];
+        lastActivity = [[plist objectForKey: @"lastActivity"] doubleValue];
+        lastSeq = [[plist objectForKey: @"lastSeq"] intValue];
+        lastEpoch = [[plist objectForKey: @"lastEpoch"] intValue];
+        hasLast = YES;
+        hasRead = [plist objectForKey: @"readSeq"] != nil;
+        readSeq = [[plist objectForKey: @"readSeq"] intValue];
+        readEpoch = [[plist objectForKey: @"readEpoch"] intValue];
+    }
+
+    return self;
+}
+
+- (NSDictionary *) propertyList {
+    NSMutableDictionary *plist = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithUnsignedInteger: unread], @"unread",
+        preview != nil ? preview : @"", @"preview",
+        [NSNumber numberWithDouble: lastActivity], @"lastActivity",
+        [NSNumber numberWithInt: lastSeq], @"lastSeq",
+        [NSNumber numberWithInt: lastEpoch], @"lastEpoch", nil];
+    if (hasRead) {
+        [plist setObject: [NSNumber numberWithInt: readSeq] forKey: @"readSeq"];
+        [plist setObject: [NSNumber numberWithInt: readEpoch] forKey: @"readEpoch"];
+    }
+    return plist;
+}
+
+// Whether a stored message is after the last message read.
+- (BOOL) isUnread: (StoredMessage *)message {
+    return !hasRead || IsAfter(message, readSeq, readEpoch);
+}
+
+- (void) setLast: (StoredMessage *)message {
+    [self setPreview: Preview([message content])];
+    lastActivity = [message time];
+    lastSeq = [message seq];
+    lastEpoch = [message epoch];
+    hasLast = YES;
+}
+
+- (void) setPreview: (NSString *)aPreview {
+    [preview autorelease];
+    preview = [aPreview copy];
+}
+
+- (void) dealloc {
+    [preview release];
+
+    [super dealloc];
+}
+
+@end
+
+@implementation RoomSummary
+
+- (id) initWithSubject: (NSString *)aSubject unreadCount: (NSUInteger)unread preview: (NSString *)aPreview lastActivity: (NSTimeInterval)activity lastSeq: (int)seq lastEpoch: (int)epoch {
+
+    self = [super init];
+    if (self != nil) {
+        subject = [aSubject copy];
+        unreadCount = unread;
+        preview = [aPreview copy];
+        lastActivity = activity;
+        lastSeq = seq;
+        lastEpoch = epoch;
+    }
+
+    return self;
+}
+
+- (NSString *) subject {
+    return subject;
+}
+
+- (NSUInteger) unreadCount {
+    return unreadCount;
+}
+
+- (NSString *) preview {
+    return preview;
+}
+
+- (NSTimeInterval) lastActivity {
+    return lastActivity;
+}
+
+- (int) lastSeq {
+    return lastSeq;
+}
+
+- (int) lastEpoch {
+    return lastEpoch;
+}
+
+- (void) dealloc {
+    [preview release];
+    [subject release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface RoomSummaryIndex ()
+- (RoomState *) stateForSubject: (NSString *)subject;
+- (void) reconcile: (NSString *)subject state: (RoomState *)state;
+- (void) countAppended: (NSString *)subject firstIndex: (NSUInteger)firstIndex;
+- (void) storeDidAppend: (NSNotification *)notification;
+- (void) scheduleSave;
+- (void) writeSummaries;
+- (RoomSummary *) summaryOf: (NSString *)subject state: (RoomState *)state;
+@end
+
+@implementation RoomSummaryIndex
+
+- (id) initWithStore: (MessageStore *)aStore {
+
+    self = [super init];
+    if (self != nil) {
+        store = [aStore retain];
+        path = [[[store directory] stringByAppendingPathComponent: @"summaries.plist"] copy];
+        summarizedSubjects = [NSMutableSet new];
+        rooms = [NSMutableDictionary new];
+        queue = dispatch_queue_create("com.migratorydata.samples.chat.summaries", DISPATCH_QUEUE_SERIAL);
+
+        // Loaded off the launch path, the store is read when the subjects are set
+        dispatch_async(queue, ^{
+            NSDictionary *saved = [NSDictionary dictionaryWithContentsOfFile: path];
+            for (NSString *subject in saved) {
+                RoomState *state = [[RoomState alloc] initWithPropertyList: [saved objectForKey: subject]];
+                [rooms setObject: state forKey: subject];
+                [state release];
+            }
+        });
+        [[NSNotificationCenter defaultCenter] addObserver: self selector: @selector(storeDidAppend:) name: MESSAGE_STORE_DID_APPEND object: store];
+    }
+
+    return self;
+}
+
+- (void) setSummarizedSubjects: (NSArray *)subjects {
+    dispatch_async(queue, ^{
+        for (NSString *subject in subjects) {
+            if (![summarizedSubjects containsObject: subject]) {
+                [summarizedSubjects addObject: subject];
+                [self reconcile: subject state: [self stateForSubject: subject]];
+            }
+        }
+        [self scheduleSave];
+    });
+}
+
+- (void) refresh {
+    dispatch_async(queue, ^{
+        for (NSString *subject in summarizedSubjects) {
+            [self reconcile: subject state: [self stateForSubject: subject]];
+        }
+        [self scheduleSave];
+    });
+}
+
+- (RoomState *) stateForSubject: (NSString *)subject {
+    RoomState *state = [rooms objectForKey: subject];
+    if (state == nil) {
+        state = [[[RoomState alloc] initWithPropertyList: nil] autorelease];
+        [rooms setObject: state forKey: subject];
+    }
+    return state;
+}
+
+// Count the messages stored after the last one read, reading the store backwards from its end.
+- (void) reconcile: (NSString *)subject state: (RoomState *)state {
+    NSUInteger count = [store countForSubject: subject];
+    NSUInteger end = count;
+    NSUInteger counted = 0;
+    StoredMessage *newest = nil;
+    BOOL done = NO;
+    while (!done && end > 0 && counted < SUMMARY_RECONCILE_MAX) {
+        NSUInteger start = end > SUMMARY_RECONCILE_CHUNK ? end - SUMMARY_RECONCILE_CHUNK : 0;
+        NSArray *messages = [store messagesForSubject: subject range: NSMakeRange(start, end - start)];
+        for (StoredMessage *message in [messages reverseObjectEnumerator]) {
+            if (newest == nil) {
+                newest = message;
+            }
+            if (![state isUnread: message]) {
+                done = YES;
+                break;
+            }
+            counted++;
+        }
+        end = start;
+    }
+
+    state->unread = counted;
+    state->storedCount = count;
+    if (newest != nil) {
+        [state setLast: newest];
+    }
+}
+
+// Count the messages appended after those already counted; an insertion before them, or a store changed by another
+// process meanwhile, is counted again from the end.
+- (void) countAppended: (NSString *)subject firstIndex: (NSUInteger)firstIndex {
+    RoomState *state = [self stateForSubject: subject];
+    NSUInteger count = [store countForSubject: subject];
+    if (state->storedCount == NSNotFound || firstIndex < state->storedCount || count < state->storedCount) {
+        [self reconcile: subject state: state];
+        return;
+    }
+
+    NSArray *messages = [store messagesForSubject: subject range: NSMakeRange(state->storedCount, count - state->storedCount)];
+    for (StoredMessage *message in messages) {
+        if ([state isUnread: message]) {
+            state->unread++;
+        }
+    }
+    state->storedCount += [messages count];
+    if ([messages count] > 0) {
+        [state setLast: [messages lastObject]];
+    }
+}
+
+// Posted after a batch was stored, by MessageStoreListener on its queue or by ChatPush.
+- (void) storeDidAppend: (NSNotification *)notification {
+    NSDictionary *info = [notification userInfo];
+    NSString *subject = [info objectForKey: MESSAGE_STORE_SUBJECT];
+    NSUInteger firstIndex = [[info objectForKey: MESSAGE_STORE_FIRST_INDEX] unsignedIntegerValue];
+
+    dispatch_async(queue, ^{
+        if ([summarizedSubjects containsObject: subject]) {
+            [self countAppended: subject firstIndex: firstIndex];
+            [self scheduleSave];
+        }
+    });
+}
+
+- (RoomSummary *) summaryOf: (NSString *)subject state: (RoomState *)state {
+    return [[[RoomSummary alloc] initWithSubject: subject unreadCount: state->unread preview: state->preview
+        lastActivity: state->lastActivity lastSeq: state->lastSeq lastEpoch: state->lastEpoch] autorelease];
+}
+
+- (RoomSummary *) summaryForSubject: (NSString *)subject {
+    __block RoomSummary *summary = nil;
+    dispatch_sync(queue, ^{
+        RoomState *state = [rooms objectForKey: subject];
+        if (state != nil && state->hasLast && [summarizedSubjects containsObject: subject]) {
+            summary = [[self summaryOf: subject state: state] retain];
+        }
+    });
+    return [summary autorelease];
+}
+
+- (NSArray *) summaries {
+    NSMutableArray *summaries = [NSMutableArray array];
+    dispatch_sync(queue, ^{
+        for (NSString *subject in summarizedSubjects) {
+            RoomState *state = [rooms objectForKey: subject];
+            if (state != nil && state->hasLast) {
+                [summaries addObject: [self summaryOf: subject state: state]];
+            }
+        }
+    });
+    [summaries sortUsingComparator: ^NSComparisonResult(RoomSummary *a, RoomSummary *b) {
+        if ([a lastActivity] == [b lastActivity]) {
+            return NSOrderedSame;
+        }
+        return [a lastActivity] > [b lastActivity] ? NSOrderedAscending : NSOrderedDescending;
+    }];
+    return summaries;
+}
+
+- (void) markReadSubject: (NSString *)subject {
+    dispatch_async(queue, ^{
+        RoomState *state = [rooms objectForKey: subject];
+        if (state != nil && state->hasLast) {
+            state->unread = 0;
+            state->readSeq = state->lastSeq;
+            state->readEpoch = state->lastEpoch;
+            state->hasRead = YES;
+            [self scheduleSave];
+        }
+    });
+}
+
+- (void) scheduleSave {
+    if (saveScheduled) {
+        return;
+    }
+    saveScheduled = YES;
+
+    [self retain];
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(SUMMARY_SAVE_DELAY * NSEC_PER_SEC)), queue, ^{
+        if (saveScheduled) {
+            [self writeSummaries];
+        }
+        [self release];
+    });
+}
+
+- (void) save {
+    dispatch_sync(queue, ^{
+        [self writeSummaries];
+    });
+}
+
+- (void) writeSummaries {
+    saveScheduled = NO;
+    NSMutableDictionary *plist = [NSMutableDictionary dictionaryWithCapacity: [rooms count]];
+    for (NSString *subject in rooms) {
+        RoomState *state = [rooms objectForKey: subject];
+        if (state->hasLast) {
+            [plist setObject: [state propertyList] forKey: subject];
+        }
+    }
+    [plist writeToFile: path atomically: YES];
+}
+
+- (void) dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver: self];
+    dispatch_release(queue);
+
+    [rooms release];
+    [summarizedSubjects release];
+    [path release];
+    [store release];
+
+    [super dealloc];
+}
+
+@end
@@ -6,8 +6,14 @@
 @interface SampleListener : NSObject <MigratoryDataListener> {
 	UITextField *messageTextField;
 	UITextField *statusTextField;
+    dispatch_block_t firstMessageHandler;
 }
 
 - (id) initWithMessageField: (UITextField *)liveMessage statusField: (UITextField *)liveStatus;
 
+/**
+ * Set a block called once on the main thread, right after the first message is shown.
+ */
+- (void) setFirstMessageHandler: (dispatch_block_t)handler;
+
 @end
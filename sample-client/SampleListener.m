@@ -1,4 +1,5 @@
 #import "SampleListener.h"
+#import "JSONFieldExtractor.h"
 
 @implementation SampleListener
 
@@ -19,11 +20,32 @@
 	
 	NSLog(@"Got new message: subject = '%@', content = '%@'", subject, content);
 	
+    // Chat messages are JSON objects, pick the two fields shown without parsing the whole message
+    const char *keys[] = { "user", "text" };
+    NSString *fields[2];
+    JSONStringFields(content, keys, fields, 2);
+    NSString *user = fields[0], *text = fields[1];
+    if (user != nil && text != nil) {
+        content = [NSString stringWithFormat: @"%@: %@", user, text];
+    }
+	
     dispatch_async(dispatch_get_main_queue(), ^{
         messageTextField.text = [NSString stringWithFormat: @"%@ = %@\n", subject, content ];
+        if (firstMessageHandler != nil) {
+            dispatch_block_t handler = firstMessageHandler;
+            firstMessageHandler = nil;
+            handler();
+            [handler release];
+        }
     });
 }
 
+// Called on the main thread.
+- (void) setFirstMessageHandler: (dispatch_block_t)handler {
+    [firstMessageHandler release];
+    firstMessageHandler = [handler copy];
+}
+
 - (void) onStatus: (NSString *)status info:(NSString *)info {
     
 	NSLog(@"Got new status notification: '%@'", status);
@@ -34,6 +56,7 @@
 }
 
 - (void) dealloc {
+    [firstMessageHandler release];
     
 	[super dealloc];
 }
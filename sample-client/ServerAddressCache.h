@@ -0,0 +1,52 @@
+#import <Foundation/Foundation.h>
+
+/**
+ * Resolve a host name into an array of numeric addresses, or nil on failure. Called on a background queue.
+ */
+typedef NSArray *(^HostResolver)(NSString *host);
+
+/**
+ * A DNS cache for the servers of a MigratoryData cluster.
+ *
+ * All cluster members are resolved in parallel in the background, ahead of connect and reconnect, so name resolution
+ * is off the reconnect path: the system resolver cache is warm when the client connects. An entry is refreshed once
+ * its time to live expires, and the stale addresses are kept until the refresh succeeds, so a failed lookup during
+ * failover still yields the last known addresses.
+ */
+@interface ServerAddressCache : NSObject {
+    HostResolver resolver;
+    NSTimeInterval ttl;
+
+    NSMutableDictionary *entries;
+    dispatch_queue_t resolveQueue;
+}
+
+/**
+ * Create a cache which resolves with getaddrinfo().
+ */
+- (id) initWithTTL: (NSTimeInterval)seconds;
+
+/**
+ * Create a cache which resolves with the given resolver, e.g. a stub which injects latency.
+ */
+- (id) initWithTTL: (NSTimeInterval)seconds resolver: (HostResolver)hostResolver;
+
+/**
+ * Resolve in parallel the hosts of the servers, given in the format accepted by MigratoryDataClient.setServers(),
+ * which are not cached or whose entry expired. Returns immediately.
+ */
+- (void) prefetchServers: (NSArray *)servers;
+
+/**
+ * Return the cached addresses of the host, even if expired, or nil if the host was never resolved. An expired entry
+ * is refreshed in the background.
+ */
+- (NSArray *) addressesForHost: (NSString *)host;
+
+/**
+ * Return the servers with host names replaced by their cached addresses, keeping weights and ports. Only use it for
+ * unencrypted connections: TLS needs the host name to verify the server certificate.
+ */
+- (NSArray *) resolvedServers: (NSArray *)servers;
+
+@end
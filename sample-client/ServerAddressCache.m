@@ -0,0 +1,211 @@
+#import "ServerAddressCache.h"
+
+#include <netdb.h>
+#include <arpa/inet.h>
+
+// Cached addresses of one host.
+@interface ServerAddressEntry : NSObject {
+@public
+    NSArray *addresses;
+    NSTimeInterval expires;
+    BOOL resolving;
+}
+@end
+
+@implementation ServerAddressEntry
+
+- (void) dealloc {
+    [addresses release];
+
+    [super dealloc];
+}
+
+@end
+
+static NSArray *ResolveWithGetaddrinfo(NSString *host) {
+    struct addrinfo hints;
+    struct addrinfo *result = NULL;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo([host UTF8String], NULL, &hints, &result) != 0) {
+        return nil;
+    }
+
+    NSMutableArray *addresses = [NSMutableArray array];
+    for (struct addrinfo *info = result; info != NULL; info = info->ai_next) {
+        char buffer[INET6_ADDRSTRLEN];
+        const void *address;
+        if (info->ai_family == AF_INET) {
+            address = &((struct sockaddr_in *)info->ai_addr)->sin_addr;
+        } else if (info->ai_family == AF_INET6) {
+            address = &((struct sockaddr_in6 *)info->ai_addr)->sin6_addr;
+        } else {
+            continue;
+        }
+        if (inet_ntop(info->ai_family, address, buffer, sizeof(buffer)) != NULL) {
+            NSString *string = [NSString stringWithUTF8String: buffer];
+            if (![addresses containsObject: string]) {
+                [addresses addObject: string];
+            }
+        }
+    }
+    freeaddrinfo(result);
+
+    return [addresses count] > 0 ? addresses : nil;
+}
+
+// Split "[weight ]host[:port]" into its parts; port and weight are nil when absent.
+static void ParseServer(NSString *server, NSString **weight, NSString **host, NSString **port) {
+    NSString *address = [server stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceCharacterSet]];
+    *weight = nil;
+    *port = nil;
+
+    NSRange space = [address rangeOfString: @" "];
+    if (space.location != NSNotFound) {
+        *weight = [address substringToIndex: space.location];
+        address = [[address substringFromIndex: space.location + 1] stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceCharacterSet]];
+    }
+
+    if ([address hasPrefix: @"["]) {
+        NSRange close = [address rangeOfString: @"]"];
+        if (close.location != NSNotFound) {
+            *host = [address substringWithRange: NSMakeRange(1, close.location - 1)];
+            if ([address length] > close.location + 2) {
+                *port = [address substringFromIndex: close.location + 2];
+            }
+            return;
+        }
+    }
+
+    NSRange colon = [address rangeOfString: @":" options: NSBackwardsSearch];
+    if (colon.location != NSNotFound && [address rangeOfString: @":"].location == colon.location) {
+        *host = [address substringToIndex: colon.location];
+        *port = [address substringFromIndex: colon.location + 1];
+    } else {
+        *host = address;
+    }
+}
+
+@interface ServerAddressCache ()
+- (void) resolveHost: (NSString *)host;
+@end
+
+@implementation ServerAddressCache
+
+- (id) initWithTTL: (NSTimeInterval)seconds {
+    return [self initWithTTL: seconds resolver: ^NSArray *(NSString *host) {
+        return ResolveWithGetaddrinfo(host);
+    }];
+}
+
+- (id) initWithTTL: (NSTimeInterval)seconds resolver: (HostResolver)hostResolver {
+
+    self = [super init];
+    if (self != nil) {
+        resolver = [hostResolver copy];
+        ttl = seconds;
+        entries = [NSMutableDictionary new];
+        resolveQueue = dispatch_queue_create("com.migratorydata.samples.chat.dns", DISPATCH_QUEUE_CONCURRENT);
+        dispatch_set_target_queue(resolveQueue, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0));
+    }
+
+    return self;
+}
+
+- (void) prefetchServers: (NSArray *)servers {
+    for (NSString *server in servers) {
+        NSString *weight, *host, *port;
+        ParseServer(server, &weight, &host, &port);
+        [self resolveHost: host];
+    }
+}
+
+- (void) resolveHost: (NSString *)host {
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+
+    @synchronized (self) {
+        ServerAddressEntry *entry = [entries objectForKey: host];
+        if (entry == nil) {
+            entry = [[ServerAddressEntry new] autorelease];
+            [entries setObject: entry forKey: host];
+        } else if (entry->resolving || entry->expires > now) {
+            return;
+        }
+        entry->resolving = YES;
+    }
+
+    dispatch_async(resolveQueue, ^{
+        NSArray *addresses = resolver(host);
+
+        @synchronized (self) {
+            ServerAddressEntry *entry = [entries objectForKey: host];
+            entry->resolving = NO;
+            // Keep the stale addresses if the lookup failed, retry at the next prefetch
+            if (addresses != nil) {
+                [entry->addresses release];
+                entry->addresses = [addresses copy];
+                entry->expires = [NSDate timeIntervalSinceReferenceDate] + ttl;
+            }
+        }
+    });
+}
+
+- (NSArray *) addressesForHost: (NSString *)host {
+    NSArray *addresses;
+    BOOL expired;
+
+    @synchronized (self) {
+        ServerAddressEntry *entry = [entries objectForKey: host];
+        addresses = entry != nil ? [[entry->addresses retain] autorelease] : nil;
+        expired = entry == nil || entry->expires <= [NSDate timeIntervalSinceReferenceDate];
+    }
+
+    if (expired) {
+        [self resolveHost: host];
+    }
+
+    return addresses;
+}
+
+- (NSArray *) resolvedServers: (NSArray *)servers {
+    NSMutableArray *resolved = [NSMutableArray arrayWithCapacity: [servers count]];
+
+    for (NSString *server in servers) {
+        NSString *weight, *host, *port;
+        ParseServer(server, &weight, &host, &port);
+
+        NSArray *addresses = [self addressesForHost: host];
+        if ([addresses count] == 0) {
+            [resolved addObject: server];
+            continue;
+        }
+
+        // A weight is shared among the addresses of a host, so a cluster member with many addresses is not favoured
+        int total = weight != nil ? [weight intValue] : 100;
+        int share = MAX(1, total / (int)[addresses count]);
+        for (NSString *address in addresses) {
+            NSMutableString *entry = [NSMutableString stringWithFormat: @"%d ", share];
+            [entry appendString: ([address rangeOfString: @":"].location != NSNotFound ? [NSString stringWithFormat: @"[%@]", address] : address)];
+            if (port != nil) {
+                [entry appendFormat: @":%@", port];
+            }
+            [resolved addObject: entry];
+        }
+    }
+
+    return resolved;
+}
+
+- (void) dealloc {
+    dispatch_release(resolveQueue);
+
+    [entries release];
+    [resolver release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,66 @@
+#import <Foundation/Foundation.h>
+#import <stdatomic.h>
+
+#import "MigratoryDataListener.h"
+
+/**
+ * The first bytes of a trace file, followed by a one byte format version.
+ */
+#define SESSION_TRACE_MAGIC "MDTR"
+#define SESSION_TRACE_VERSION 1
+
+/**
+ * The kinds of trace records; each record starts with its kind and the microseconds elapsed since the previous record.
+ */
+typedef NS_ENUM(uint8_t, SessionRecordKind) {
+    RECORD_MESSAGE = 1,
+    RECORD_STATUS = 2
+};
+
+/**
+ * Record the messages and statuses received by the client, with their timing, into a compact binary trace.
+ *
+ * The recorder is placed first after the client and forwards everything unchanged; nothing is written, and nothing
+ * is queued on the delivery path, until startRecording is called. Integers are written as varints and each subject is written once per file, then referred
+ * to by its index. The trace is split into files of at most maxFileSize bytes, and only the last maxFiles of them are
+ * kept, so a long session keeps its most recent part within a bounded size. SessionReplayer plays a trace back.
+ */
+@interface SessionRecorder : NSObject <MigratoryDataListener> {
+    NSObject<MigratoryDataListener> *listener;
+
+    NSString *path;
+    NSUInteger maxFileSize;
+    NSUInteger maxFiles;
+
+    atomic_bool recording;
+    NSFileHandle *file;
+    NSUInteger fileIndex;
+    NSUInteger fileSize;
+    NSMutableData *buffer;
+    NSMutableDictionary *subjectIndexes;
+    NSTimeInterval lastRecordTime;
+
+    dispatch_queue_t queue;
+}
+
+/**
+ * @param aListener The listener which receives the messages and statuses
+ * @param tracePath The path of the trace, the files are named tracePath.0, tracePath.1 and so on
+ * @param fileSize The size at which a file is closed and a new one is started
+ * @param files The number of most recent files kept
+ */
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener path: (NSString *)tracePath maxFileSize: (NSUInteger)fileSize maxFiles: (NSUInteger)files;
+
+- (void) startRecording;
+
+/**
+ * Stop recording and write the buffered records to the file.
+ */
+- (void) stopRecording;
+
+/**
+ * The files of the trace, oldest first.
+ */
+- (NSArray *) traceFiles;
+
+@end
@@ -0,0 +1,235 @@
+#import "SessionRecorder.h"
+
+// Records are buffered and written in blocks of this size
+#define TRACE_WRITE_SIZE (64 * 1024)
+
+static void AppendVarint(NSMutableData *data, uint64_t value) {
+    uint8_t bytes[10];
+    int length = 0;
+    while (value >= 0x80) {
+        bytes[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    bytes[length++] = (uint8_t)value;
+    [data appendBytes: bytes length: length];
+}
+
+static void AppendString(NSMutableData *data, NSString *string) {
+    // Zero for nil, otherwise the UTF-8 length plus one
+    if (string == nil) {
+        AppendVarint(data, 0);
+        return;
+    }
+    const char *bytes = [string UTF8String];
+    if (bytes == NULL) {
+        // Not representable in UTF-8, e.g. a lone surrogate; written with the unconvertible characters replaced
+        NSData *lossy = [string dataUsingEncoding: NSUTF8StringEncoding allowLossyConversion: YES];
+        AppendVarint(data, [lossy length] + 1);
+        [data appendData: lossy];
+        return;
+    }
+    NSUInteger length = [string lengthOfBytesUsingEncoding: NSUTF8StringEncoding];
+    AppendVarint(data, length + 1);
+    [data appendBytes: bytes length: length];
+}
+
+static BOOL IsRecording(atomic_bool *recording) {
+    return atomic_load_explicit(recording, memory_order_relaxed);
+}
+
+@interface SessionRecorder ()
+- (void) appendHeader: (SessionRecordKind)kind time: (NSTimeInterval)now;
+- (void) endRecord;
+- (void) write;
+- (void) rotate;
+- (NSString *) fileAtIndex: (NSUInteger)index;
+@end
+
+@implementation SessionRecorder
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener path: (NSString *)tracePath maxFileSize: (NSUInteger)fileSize maxFiles: (NSUInteger)files {
+
+    self = [super init];
+    if (self != nil) {
+        listener = [aListener retain];
+        path = [tracePath copy];
+        maxFileSize = MAX(fileSize, TRACE_WRITE_SIZE);
+        maxFiles = MAX(files, 1);
+        buffer = [NSMutableData new];
+        subjectIndexes = [NSMutableDictionary new];
+        queue = dispatch_queue_create("com.migratorydata.samples.chat.recorder", DISPATCH_QUEUE_SERIAL);
+    }
+
+    return self;
+}
+
+- (NSString *) fileAtIndex: (NSUInteger)index {
+    return [NSString stringWithFormat: @"%@.%lu", path, (unsigned long)index];
+}
+
+- (void) startRecording {
+    dispatch_async(queue, ^{
+        if (IsRecording(&recording)) {
+            return;
+        }
+        atomic_store_explicit(&recording, YES, memory_order_relaxed);
+        lastRecordTime = [NSDate timeIntervalSinceReferenceDate];
+
+        // Continue after the files of a previous recording
+        NSArray *files = [self traceFiles];
+        fileIndex = [files count] > 0 ? [[[files lastObject] pathExtension] integerValue] + 1 : 0;
+        [self rotate];
+    });
+}
+
+- (void) stopRecording {
+    dispatch_sync(queue, ^{
+        if (!IsRecording(&recording)) {
+            return;
+        }
+        atomic_store_explicit(&recording, NO, memory_order_relaxed);
+        [self write];
+        [file closeFile];
+        [file release];
+        file = nil;
+    });
+}
+
+- (NSArray *) traceFiles {
+    NSString *directory = [path stringByDeletingLastPathComponent];
+    NSString *prefix = [[path lastPathComponent] stringByAppendingString: @"."];
+
+    NSMutableArray *indexes = [NSMutableArray array];
+    for (NSString *name in [[NSFileManager defaultManager] contentsOfDirectoryAtPath: directory error: nil]) {
+        if ([name hasPrefix: prefix]) {
+            [indexes addObject: [NSNumber numberWithInteger: [[name pathExtension] integerValue]]];
+        }
+    }
+    [indexes sortUsingSelector: @selector(compare:)];
+
+    NSMutableArray *files = [NSMutableArray arrayWithCapacity: [indexes count]];
+    for (NSNumber *index in indexes) {
+        [files addObject: [self fileAtIndex: [index unsignedIntegerValue]]];
+    }
+    return files;
+}
+
+- (void) rotate {
+    [self write];
+    [file closeFile];
+    [file release];
+
+    NSString *name = [self fileAtIndex: fileIndex];
+    [[NSFileManager defaultManager] createFileAtPath: name contents: nil attributes: nil];
+    file = [[NSFileHandle fileHandleForWritingAtPath: name] retain];
+    if (fileIndex >= maxFiles) {
+        [[NSFileManager defaultManager] removeItemAtPath: [self fileAtIndex: fileIndex - maxFiles] error: nil];
+    }
+    fileIndex++;
+    fileSize = 0;
+
+    // Each file can be replayed on its own
+    [subjectIndexes removeAllObjects];
+    [buffer appendBytes: SESSION_TRACE_MAGIC length: strlen(SESSION_TRACE_MAGIC)];
+    uint8_t version = SESSION_TRACE_VERSION;
+    [buffer appendBytes: &version length: 1];
+}
+
+- (void) write {
+    if ([buffer length] == 0) {
+        return;
+    }
+    @try {
+        [file writeData: buffer];
+    } @catch (NSException *exception) {
+        NSLog(@"Unable to write the session trace: %@", exception);
+    }
+    fileSize += [buffer length];
+    [buffer setLength: 0];
+}
+
+- (void) appendHeader: (SessionRecordKind)kind time: (NSTimeInterval)now {
+    uint64_t micros = now > lastRecordTime ? (uint64_t)((now - lastRecordTime) * 1000000) : 0;
+    lastRecordTime = now;
+
+    [buffer appendBytes: &kind length: 1];
+    AppendVarint(buffer, micros);
+}
+
+- (void) endRecord {
+    if ([buffer length] >= TRACE_WRITE_SIZE) {
+        [self write];
+    }
+    if (fileSize + [buffer length] >= maxFileSize) {
+        [self rotate];
+    }
+}
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    // Checked again on the queue, the recording may stop in between
+    if (IsRecording(&recording)) {
+        // Taken on arrival, the queue may run the record later
+        NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+        dispatch_async(queue, ^{
+            if (!IsRecording(&recording)) {
+                return;
+            }
+            [self appendHeader: RECORD_MESSAGE time: now];
+
+            // The index of the subject, or the next index followed by the subject the first time
+            NSString *subject = [message getSubject];
+            NSNumber *index = [subjectIndexes objectForKey: subject];
+            if (index != nil) {
+                AppendVarint(buffer, [index unsignedIntegerValue]);
+            } else {
+                AppendVarint(buffer, [subjectIndexes count]);
+                AppendString(buffer, subject);
+                [subjectIndexes setObject: [NSNumber numberWithUnsignedInteger: [subjectIndexes count]] forKey: subject];
+            }
+
+            uint8_t flags = ([message isRetained] ? 1 : 0) | ([message getQos] == GUARANTEED ? 2 : 0);
+            [buffer appendBytes: &flags length: 1];
+            AppendVarint(buffer, [message getMessageType]);
+            AppendVarint(buffer, (uint32_t)[message getSeq]);
+            AppendVarint(buffer, (uint32_t)[message getEpoch]);
+            AppendString(buffer, [message getContent]);
+            AppendString(buffer, [message getClosure]);
+            AppendString(buffer, [message getReplySubject]);
+
+            [self endRecord];
+        });
+    }
+
+    [listener onMessage: message];
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+    if (IsRecording(&recording)) {
+        NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+        dispatch_async(queue, ^{
+            if (!IsRecording(&recording)) {
+                return;
+            }
+            [self appendHeader: RECORD_STATUS time: now];
+            AppendString(buffer, status);
+            AppendString(buffer, info);
+            [self endRecord];
+        });
+    }
+
+    [listener onStatus: status info: info];
+}
+
+- (void) dealloc {
+    [self stopRecording];
+    dispatch_release(queue);
+
+    [subjectIndexes release];
+    [buffer release];
+    [path release];
+    [listener release];
+
+    [super dealloc];
+}
+
+@end
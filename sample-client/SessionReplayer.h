@@ -0,0 +1,37 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataListener.h"
+#import "SessionRecorder.h"
+
+typedef NS_ENUM(NSInteger, ReplaySpeed) {
+    REPLAY_RECORDED,
+    REPLAY_MAXIMUM
+};
+
+typedef void (^ReplayCompletion)(NSUInteger records, NSTimeInterval elapsed);
+
+/**
+ * Play back a trace written by SessionRecorder into a listener, as if the messages and statuses came from the client.
+ *
+ * At REPLAY_RECORDED speed the records are delivered with their recorded spacing, which reproduces the traffic shape
+ * of the recorded session; at REPLAY_MAXIMUM speed they are delivered back to back, to measure the cost of the
+ * listener pipeline. The records are delivered on a private queue, one at a time.
+ */
+@interface SessionReplayer : NSObject {
+    NSObject<MigratoryDataListener> *listener;
+
+    BOOL cancelled;
+    dispatch_queue_t queue;
+}
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener;
+
+/**
+ * Replay the given trace files in order, then call the completion on the main queue with the number of records
+ * delivered and the replay time. A truncated or unknown file ends the replay of that file.
+ */
+- (void) replayFiles: (NSArray *)files speed: (ReplaySpeed)speed completion: (ReplayCompletion)completion;
+
+- (void) cancel;
+
+@end
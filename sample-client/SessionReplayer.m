@@ -0,0 +1,185 @@
+#import "SessionReplayer.h"
+
+// Read a trace file, returning NO at its end or on a malformed record.
+typedef struct {
+    const uint8_t *bytes;
+    NSUInteger length;
+    NSUInteger offset;
+} TraceReader;
+
+static BOOL ReadVarint(TraceReader *reader, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && reader->offset < reader->length; shift += 7) {
+        uint8_t byte = reader->bytes[reader->offset++];
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return YES;
+        }
+    }
+    return NO;
+}
+
+static BOOL ReadString(TraceReader *reader, NSString **string) {
+    uint64_t length;
+    if (!ReadVarint(reader, &length)) {
+        return NO;
+    }
+    if (length == 0) {
+        *string = nil;
+        return YES;
+    }
+    length--;
+    if (length > reader->length - reader->offset) {
+        return NO;
+    }
+    *string = [[[NSString alloc] initWithBytes: reader->bytes + reader->offset length: (NSUInteger)length encoding: NSUTF8StringEncoding] autorelease];
+    reader->offset += (NSUInteger)length;
+    return *string != nil;
+}
+
+@interface SessionReplayer ()
+- (NSUInteger) replayFile: (NSString *)name speed: (ReplaySpeed)speed;
+@end
+
+@implementation SessionReplayer
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener {
+
+    self = [super init];
+    if (self != nil) {
+        listener = [aListener retain];
+        queue = dispatch_queue_create("com.migratorydata.samples.chat.replayer", DISPATCH_QUEUE_SERIAL);
+    }
+
+    return self;
+}
+
+- (void) replayFiles: (NSArray *)files speed: (ReplaySpeed)speed completion: (ReplayCompletion)completion {
+    @synchronized (self) {
+        cancelled = NO;
+    }
+
+    [self retain];
+    dispatch_async(queue, ^{
+        NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+        NSUInteger records = 0;
+        for (NSString *name in files) {
+            records += [self replayFile: name speed: speed];
+        }
+        NSTimeInterval elapsed = [NSDate timeIntervalSinceReferenceDate] - start;
+
+        if (completion != nil) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(records, elapsed);
+            });
+        }
+        [self release];
+    });
+}
+
+- (NSUInteger) replayFile: (NSString *)name speed: (ReplaySpeed)speed {
+    NSData *data = [NSData dataWithContentsOfFile: name options: NSDataReadingMappedIfSafe error: nil];
+    NSUInteger magicLength = strlen(SESSION_TRACE_MAGIC);
+    if ([data length] < magicLength + 1 || memcmp([data bytes], SESSION_TRACE_MAGIC, magicLength) != 0
+            || ((const uint8_t *)[data bytes])[magicLength] != SESSION_TRACE_VERSION) {
+        NSLog(@"Not a session trace: %@", name);
+        return 0;
+    }
+
+    TraceReader reader = { [data bytes], [data length], magicLength + 1 };
+    NSMutableArray *subjects = [NSMutableArray array];
+    NSUInteger records = 0;
+    // Deliver each record at its recorded offset from the start, so the sleeps do not accumulate drift
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    NSTimeInterval offset = 0;
+
+    while (reader.offset < reader.length) {
+        BOOL stop;
+        @synchronized (self) {
+            stop = cancelled;
+        }
+        if (stop) {
+            break;
+        }
+
+        @autoreleasepool {
+            SessionRecordKind kind = reader.bytes[reader.offset++];
+            uint64_t micros;
+            BOOL valid = ReadVarint(&reader, &micros);
+            MigratoryDataMessage *message = nil;
+            NSString *status = nil;
+            NSString *info = nil;
+
+            if (valid && kind == RECORD_MESSAGE) {
+                uint64_t index, type, seq, epoch;
+                NSString *subject = nil, *content = nil, *closure = nil, *replySubject = nil;
+                valid = ReadVarint(&reader, &index);
+                if (valid && index == [subjects count]) {
+                    valid = ReadString(&reader, &subject) && subject != nil;
+                    if (valid) {
+                        [subjects addObject: subject];
+                    }
+                } else if (valid) {
+                    valid = index < [subjects count];
+                    subject = valid ? [subjects objectAtIndex: (NSUInteger)index] : nil;
+                }
+                uint8_t flags = 0;
+                if (valid && reader.offset < reader.length) {
+                    flags = reader.bytes[reader.offset++];
+                } else {
+                    valid = NO;
+                }
+                valid = valid && ReadVarint(&reader, &type) && ReadVarint(&reader, &seq) && ReadVarint(&reader, &epoch)
+                    && ReadString(&reader, &content) && ReadString(&reader, &closure) && ReadString(&reader, &replySubject);
+                if (valid) {
+                    message = [[[MigratoryDataMessage alloc] init: subject content: content closure: closure
+                        retained: (flags & 1) != 0 qos: (flags & 2) != 0 ? GUARANTEED : STANDARD replySubject: replySubject
+                        messageType: (MigratoryDataMessageType)type seq: (int)(uint32_t)seq epoch: (int)(uint32_t)epoch] autorelease];
+                }
+            } else if (valid && kind == RECORD_STATUS) {
+                valid = ReadString(&reader, &status) && ReadString(&reader, &info) && status != nil;
+            } else {
+                valid = NO;
+            }
+
+            if (!valid) {
+                NSLog(@"Truncated session trace: %@", name);
+                break;
+            }
+
+            if (speed == REPLAY_RECORDED) {
+                offset += micros / 1000000.0;
+                NSTimeInterval wait = start + offset - [NSDate timeIntervalSinceReferenceDate];
+                if (wait > 0) {
+                    [NSThread sleepForTimeInterval: wait];
+                }
+            }
+
+            if (message != nil) {
+                [listener onMessage: message];
+            } else {
+                [listener onStatus: status info: info];
+            }
+            records++;
+        }
+    }
+
+    return records;
+}
+
+- (void) cancel {
+    @synchronized (self) {
+        cancelled = YES;
+    }
+}
+
+- (void) dealloc {
+    dispatch_release(queue);
+
+    [listener release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,65 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataClient.h"
+#import "MigratoryDataListener.h"
+#import "SubjectSubscriber.h"
+
+/**
+ * Create the connection of one shard; the default creates a MigratoryDataClient.
+ */
+typedef MigratoryDataClient *(^ShardClientFactory)(NSUInteger shard);
+
+/**
+ * Spread the subjects of a high-volume consumer over several connections.
+ *
+ * Each subject is mapped with rendezvous hashing onto one of K MigratoryDataClient connections, each with its own
+ * network and decoding thread, and each connection prefers a different server of the cluster. The mapping is stable
+ * as long as K does not change, and changing K only moves the subjects of the shards added or removed. Since a subject
+ * always goes through the same connection, its messages are delivered in order; messages of different subjects are
+ * delivered concurrently, so the listener must be thread-safe.
+ */
+@interface ShardedClient : NSObject <SubjectSubscriber> {
+    NSArray *shards;
+}
+
+- (id) initWithShards: (NSUInteger)count;
+
+/**
+ * Create the connections with the given factory, e.g. LoopbackClient connections to benchmark without a cluster.
+ */
+- (id) initWithShards: (NSUInteger)count clientFactory: (ShardClientFactory)factory;
+
+- (void) setListener: (NSObject<MigratoryDataListener> *)listener;
+
+- (void) setLogLevel: (MigratoryDataLogLevel)logLevel;
+
+/**
+ * Set the cluster servers, given without weights. Each connection prefers one server and fails over to the others.
+ */
+- (void) setServers: (NSArray *)servers;
+
+- (void) setEncryption: (BOOL)encryption;
+
+- (void) setEntitlementToken: (NSString *)token;
+
+- (void) subscribe: (NSArray *)subjects;
+
+- (void) subscribeWithHistory: (NSArray *)subjects history: (int)history;
+
+- (void) unsubscribe: (NSArray *)subjects;
+
+- (void) publish: (MigratoryDataMessage *)message;
+
+- (NSArray *) getSubjects;
+
+- (void) connect;
+
+- (void) pause;
+
+- (void) resume;
+
+- (void) disconnect;
+
+- (NSUInteger) shardForSubject: (NSString *)subject;
+
+@end
@@ -0,0 +1,173 @@
+#import "ShardedClient.h"
+
+// 64-bit FNV-1a of the subject followed by the shard index.
+static uint64_t ShardWeight(const char *subject, uint32_t shard) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)subject; *p != 0; p++) {
+        hash = (hash ^ *p) * 1099511628211ULL;
+    }
+    for (int i = 0; i < 4; i++) {
+        hash = (hash ^ ((shard >> (8 * i)) & 0xff)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+@interface ShardedClient ()
+- (NSArray *) subjectsByShard: (NSArray *)subjects;
+@end
+
+@implementation ShardedClient
+
+- (id) initWithShards: (NSUInteger)count {
+    return [self initWithShards: count clientFactory: ^MigratoryDataClient *(NSUInteger shard) {
+        return [[MigratoryDataClient new] autorelease];
+    }];
+}
+
+- (id) initWithShards: (NSUInteger)count clientFactory: (ShardClientFactory)factory {
+
+    self = [super init];
+    if (self != nil) {
+        NSMutableArray *clients = [NSMutableArray arrayWithCapacity: count];
+        for (NSUInteger i = 0; i < MAX(count, (NSUInteger)1); i++) {
+            [clients addObject: factory(i)];
+        }
+        shards = [clients copy];
+    }
+
+    return self;
+}
+
+- (NSUInteger) shardForSubject: (NSString *)subject {
+    const char *bytes = [subject UTF8String];
+    NSUInteger best = 0;
+    uint64_t bestWeight = 0;
+
+    // Rendezvous hashing: the shard with the highest weight for the subject wins
+    for (NSUInteger i = 0; i < [shards count]; i++) {
+        uint64_t weight = ShardWeight(bytes, (uint32_t)i);
+        if (i == 0 || weight > bestWeight) {
+            best = i;
+            bestWeight = weight;
+        }
+    }
+
+    return best;
+}
+
+- (NSArray *) subjectsByShard: (NSArray *)subjects {
+    NSMutableArray *groups = [NSMutableArray arrayWithCapacity: [shards count]];
+    for (NSUInteger i = 0; i < [shards count]; i++) {
+        [groups addObject: [NSMutableArray array]];
+    }
+    for (NSString *subject in subjects) {
+        [[groups objectAtIndex: [self shardForSubject: subject]] addObject: subject];
+    }
+    return groups;
+}
+
+- (void) setListener: (NSObject<MigratoryDataListener> *)listener {
+    for (MigratoryDataClient *client in shards) {
+        [client setListener: listener];
+    }
+}
+
+- (void) setLogLevel: (MigratoryDataLogLevel)logLevel {
+    for (MigratoryDataClient *client in shards) {
+        [client setLogLevel: logLevel];
+    }
+}
+
+- (void) setServers: (NSArray *)servers {
+    NSUInteger count = [servers count];
+
+    [shards enumerateObjectsUsingBlock: ^(MigratoryDataClient *client, NSUInteger index, BOOL *stop) {
+        // Use the load-balancing weights so that each shard prefers a different server
+        NSMutableArray *weighted = [NSMutableArray arrayWithCapacity: count];
+        for (NSUInteger i = 0; i < count; i++) {
+            int weight = (count > 1 && i != index % count) ? 10 : 100;
+            [weighted addObject: [NSString stringWithFormat: @"%d %@", weight, [servers objectAtIndex: i]]];
+        }
+        [client setServers: weighted];
+    }];
+}
+
+- (void) setEncryption: (BOOL)encryption {
+    for (MigratoryDataClient *client in shards) {
+        [client setEncryption: encryption];
+    }
+}
+
+- (void) setEntitlementToken: (NSString *)token {
+    for (MigratoryDataClient *client in shards) {
+        [client setEntitlementToken: token];
+    }
+}
+
+- (void) subscribe: (NSArray *)subjects {
+    [[self subjectsByShard: subjects] enumerateObjectsUsingBlock: ^(NSArray *group, NSUInteger index, BOOL *stop) {
+        if ([group count] > 0) {
+            [[shards objectAtIndex: index] subscribe: group];
+        }
+    }];
+}
+
+- (void) subscribeWithHistory: (NSArray *)subjects history: (int)history {
+    [[self subjectsByShard: subjects] enumerateObjectsUsingBlock: ^(NSArray *group, NSUInteger index, BOOL *stop) {
+        if ([group count] > 0) {
+            [[shards objectAtIndex: index] subscribeWithHistory: group history: history];
+        }
+    }];
+}
+
+- (void) unsubscribe: (NSArray *)subjects {
+    [[self subjectsByShard: subjects] enumerateObjectsUsingBlock: ^(NSArray *group, NSUInteger index, BOOL *stop) {
+        if ([group count] > 0) {
+            [[shards objectAtIndex: index] unsubscribe: group];
+        }
+    }];
+}
+
+- (void) publish: (MigratoryDataMessage *)message {
+    [[shards objectAtIndex: [self shardForSubject: [message getSubject]]] publish: message];
+}
+
+- (NSArray *) getSubjects {
+    NSMutableArray *subjects = [NSMutableArray array];
+    for (MigratoryDataClient *client in shards) {
+        [subjects addObjectsFromArray: [client getSubjects]];
+    }
+    return subjects;
+}
+
+- (void) connect {
+    for (MigratoryDataClient *client in shards) {
+        [client connect];
+    }
+}
+
+- (void) pause {
+    for (MigratoryDataClient *client in shards) {
+        [client pause];
+    }
+}
+
+- (void) resume {
+    for (MigratoryDataClient *client in shards) {
+        [client resume];
+    }
+}
+
+- (void) disconnect {
+    for (MigratoryDataClient *client in shards) {
+        [client disconnect];
+    }
+}
+
+- (void) dealloc {
+    [shards release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,66 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataClient.h"
+#import "MigratoryDataListener.h"
+#import "SubscriptionCache.h"
+
+@class SharedConnection;
+
+typedef MigratoryDataClient *(^PoolClientFactory)(void);
+
+/**
+ * A logical client multiplexed with other logical clients over one MigratoryDataClient connection.
+ *
+ * Subscriptions are reference-counted on the shared connection: a subject is subscribed on the network by the first
+ * logical client which subscribes it and unsubscribed by the last one. The logical client forwards to its listener the
+ * messages of its subjects, the statuses of the connection, e.g. NOTIFY_SERVER_UP and NOTIFY_SERVER_DOWN, the statuses
+ * of its subjects, e.g. NOTIFY_SUBSCRIBE_DENY, and the publish statuses of the messages it published. Call dispose when
+ * the logical client is no longer needed; the connection retains it until then, and is disconnected with its last
+ * logical client.
+ */
+@interface PooledClient : NSObject <MigratoryDataListener> {
+    SharedConnection *connection;
+    NSObject<MigratoryDataListener> *listener;
+    NSMutableArray *subjects;
+}
+
+- (void) setListener: (NSObject<MigratoryDataListener> *)aListener;
+
+- (void) subscribe: (NSArray *)subjectsToAdd;
+
+- (void) unsubscribe: (NSArray *)subjectsToRemove;
+
+- (void) publish: (MigratoryDataMessage *)message;
+
+- (NSArray *) getSubjects;
+
+- (void) dispose;
+
+@end
+
+/**
+ * Share one connection among the modules of an app, e.g. chat, presence and notifications, instead of opening one
+ * connection per module.
+ *
+ * Logical clients created for the same servers, encryption and entitlement token share a connection, which saves
+ * sockets, TLS handshakes, heartbeats and radio wakeups.
+ */
+@interface SharedClientPool : NSObject {
+    NSMutableDictionary *connections;
+    PoolClientFactory clientFactory;
+}
+
++ (SharedClientPool *) sharedPool;
+
+/**
+ * Create the connections with the given factory, e.g. LoopbackClient connections to test without a cluster.
+ */
+- (id) initWithClientFactory: (PoolClientFactory)factory;
+
+/**
+ * Return a new logical client, connecting the shared connection if this is its first logical client. The token may
+ * be nil.
+ */
+- (PooledClient *) clientForServers: (NSArray *)servers encryption: (BOOL)encryption token: (NSString *)token;
+
+@end
@@ -0,0 +1,349 @@
+#import "SharedClientPool.h"
+
+@interface MigratoryDataClient (SubjectSubscriber) <SubjectSubscriber>
+@end
+
+@implementation MigratoryDataClient (SubjectSubscriber)
+@end
+
+static BOOL IsPublishStatus(NSString *status) {
+    return [status isEqualToString: NOTIFY_PUBLISH_OK] || [status isEqualToString: NOTIFY_PUBLISH_FAILED]
+        || [status isEqualToString: NOTIFY_PUBLISH_DENIED] || [status isEqualToString: NOTIFY_MESSAGE_SIZE_LIMIT_EXCEEDED];
+}
+
+// The statuses whose info is a subject
+static BOOL IsSubjectStatus(NSString *status) {
+    return [status isEqualToString: NOTIFY_DATA_SYNC] || [status isEqualToString: NOTIFY_DATA_RESYNC]
+        || [status isEqualToString: NOTIFY_SUBSCRIBE_ALLOW] || [status isEqualToString: NOTIFY_SUBSCRIBE_DENY];
+}
+
+@interface PooledClient ()
+- (id) initWithConnection: (SharedConnection *)aConnection;
+- (BOOL) isSubscribedTo: (NSString *)subject;
+@end
+
+// The listener of a shared connection: messages go through the subscriptions, statuses to the logical clients they
+// concern. It does not refer to the connection, so the client which retains it does not retain itself.
+@interface SharedConnectionListener : NSObject <MigratoryDataListener> {
+@public
+    SubscriptionCache *subscriptions;
+    NSMutableArray *clients;
+    NSMutableDictionary *publishers;
+}
+@end
+
+@implementation SharedConnectionListener
+
+- (id) init {
+
+    self = [super init];
+    if (self != nil) {
+        subscriptions = [SubscriptionCache new];
+        clients = [NSMutableArray new];
+        publishers = [NSMutableDictionary new];
+    }
+
+    return self;
+}
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    [subscriptions onMessage: message];
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+    NSMutableArray *targets = [NSMutableArray array];
+
+    @synchronized (self) {
+        if (IsPublishStatus(status)) {
+            // The closure is that of the last logical client which published it
+            PooledClient *publisher = info != nil ? [publishers objectForKey: info] : nil;
+            if (publisher != nil) {
+                [targets addObject: publisher];
+                [publishers removeObjectForKey: info];
+            }
+        } else if (IsSubjectStatus(status)) {
+            for (PooledClient *pooled in clients) {
+                if ([pooled isSubscribedTo: info]) {
+                    [targets addObject: pooled];
+                }
+            }
+        } else {
+            [targets addObjectsFromArray: clients];
+        }
+    }
+
+    for (PooledClient *pooled in targets) {
+        [pooled onStatus: status info: info];
+    }
+}
+
+- (void) dealloc {
+    [publishers release];
+    [clients release];
+    [subscriptions release];
+
+    [super dealloc];
+}
+
+@end
+
+// One connection of the pool and the logical clients using it.
+@interface SharedConnection : NSObject {
+@public
+    NSString *key;
+    SharedClientPool *pool;
+    MigratoryDataClient *client;
+    SharedConnectionListener *listener;
+    NSUInteger references;
+}
+@end
+
+@implementation SharedConnection
+
+- (void) dealloc {
+    [listener release];
+    [client release];
+    [pool release];
+    [key release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface SharedClientPool ()
+- (void) releaseConnection: (SharedConnection *)connection;
+@end
+
+@implementation PooledClient
+
+- (id) initWithConnection: (SharedConnection *)aConnection {
+
+    self = [super init];
+    if (self != nil) {
+        connection = [aConnection retain];
+        subjects = [NSMutableArray new];
+
+        SharedConnectionListener *connectionListener = connection->listener;
+        @synchronized (connectionListener) {
+            [connectionListener->clients addObject: self];
+        }
+    }
+
+    return self;
+}
+
+- (void) setListener: (NSObject<MigratoryDataListener> *)aListener {
+    @synchronized (self) {
+        [listener autorelease];
+        listener = [aListener retain];
+    }
+}
+
+- (void) subscribe: (NSArray *)subjectsToAdd {
+    NSMutableArray *added = [NSMutableArray array];
+
+    @synchronized (self) {
+        if (connection == nil) {
+            return;
+        }
+        for (NSString *subject in subjectsToAdd) {
+            if (![subjects containsObject: subject]) {
+                [subjects addObject: subject];
+                [added addObject: subject];
+            }
+        }
+    }
+
+    if ([added count] > 0) {
+        [connection->listener->subscriptions addSubscriber: self forSubjects: added];
+    }
+}
+
+- (void) unsubscribe: (NSArray *)subjectsToRemove {
+    NSMutableArray *removed = [NSMutableArray array];
+
+    @synchronized (self) {
+        if (connection == nil) {
+            return;
+        }
+        for (NSString *subject in subjectsToRemove) {
+            if ([subjects containsObject: subject]) {
+                [subjects removeObject: subject];
+                [removed addObject: subject];
+            }
+        }
+    }
+
+    if ([removed count] > 0) {
+        [connection->listener->subscriptions removeSubscriber: self forSubjects: removed];
+    }
+}
+
+- (void) publish: (MigratoryDataMessage *)message {
+    SharedConnection *current;
+    @synchronized (self) {
+        if (connection == nil) {
+            return;
+        }
+        current = [[connection retain] autorelease];
+    }
+
+    NSString *closure = [message getClosure];
+    if (closure != nil) {
+        SharedConnectionListener *connectionListener = current->listener;
+        @synchronized (connectionListener) {
+            [connectionListener->publishers setObject: self forKey: closure];
+        }
+    }
+    [current->client publish: message];
+}
+
+- (NSArray *) getSubjects {
+    @synchronized (self) {
+        return [[subjects copy] autorelease];
+    }
+}
+
+- (BOOL) isSubscribedTo: (NSString *)subject {
+    @synchronized (self) {
+        return [subjects containsObject: subject];
+    }
+}
+
+- (void) dispose {
+    SharedConnection *disposed;
+
+    [self unsubscribe: [self getSubjects]];
+
+    @synchronized (self) {
+        disposed = [connection autorelease];
+        connection = nil;
+    }
+
+    if (disposed != nil) {
+        SharedConnectionListener *connectionListener = disposed->listener;
+        @synchronized (connectionListener) {
+            [connectionListener->clients removeObjectIdenticalTo: self];
+            for (NSString *closure in [connectionListener->publishers allKeysForObject: self]) {
+                [connectionListener->publishers removeObjectForKey: closure];
+            }
+        }
+        [disposed->pool releaseConnection: disposed];
+    }
+}
+
+- (void)onMessage:(MigratoryDataMessage *)message {
+    NSObject<MigratoryDataListener> *current;
+    @synchronized (self) {
+        current = [[listener retain] autorelease];
+    }
+    [current onMessage: message];
+}
+
+- (void) onStatus: (NSString *)status info:(NSString *)info {
+    NSObject<MigratoryDataListener> *current;
+    @synchronized (self) {
+        current = [[listener retain] autorelease];
+    }
+    [current onStatus: status info: info];
+}
+
+// The listener of the connection retains this object, so it is deallocated once disposed
+- (void) dealloc {
+    [self dispose];
+
+    [subjects release];
+    [listener release];
+
+    [super dealloc];
+}
+
+@end
+
+@implementation SharedClientPool
+
++ (SharedClientPool *) sharedPool {
+    static SharedClientPool *pool;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        pool = [SharedClientPool new];
+    });
+    return pool;
+}
+
+- (id) init {
+    return [self initWithClientFactory: ^MigratoryDataClient *(void) {
+        return [[MigratoryDataClient new] autorelease];
+    }];
+}
+
+- (id) initWithClientFactory: (PoolClientFactory)factory {
+
+    self = [super init];
+    if (self != nil) {
+        connections = [NSMutableDictionary new];
+        clientFactory = [factory copy];
+    }
+
+    return self;
+}
+
+- (PooledClient *) clientForServers: (NSArray *)servers encryption: (BOOL)encryption token: (NSString *)token {
+    NSString *key = [NSString stringWithFormat: @"%@|%d|%@", [servers componentsJoinedByString: @","], encryption, token != nil ? token : @""];
+    SharedConnection *connection;
+    BOOL connect = NO;
+
+    @synchronized (self) {
+        connection = [connections objectForKey: key];
+        if (connection == nil) {
+            connection = [[SharedConnection new] autorelease];
+            connection->key = [key copy];
+            connection->pool = [self retain];
+            connection->client = [clientFactory() retain];
+            connection->listener = [SharedConnectionListener new];
+            [connection->listener->subscriptions setSubscriber: connection->client];
+
+            [connection->client setServers: servers];
+            [connection->client setEncryption: encryption];
+            if (token != nil) {
+                [connection->client setEntitlementToken: token];
+            }
+            [connection->client setListener: connection->listener];
+
+            [connections setObject: connection forKey: key];
+            connect = YES;
+        }
+        connection->references++;
+    }
+
+    if (connect) {
+        [connection->client connect];
+    }
+
+    return [[[PooledClient alloc] initWithConnection: connection] autorelease];
+}
+
+- (void) releaseConnection: (SharedConnection *)connection {
+    BOOL disconnect = NO;
+
+    @synchronized (self) {
+        if (--connection->references == 0) {
+            [connections removeObjectForKey: connection->key];
+            disconnect = YES;
+        }
+    }
+
+    if (disconnect) {
+        [connection->client disconnect];
+    }
+}
+
+- (void) dealloc {
+    [clientFactory release];
+    [connections release];
+
+    [super dealloc];
+}
+
+@end
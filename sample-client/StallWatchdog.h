@@ -0,0 +1,67 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataListener.h"
+#import "InboundBuffer.h"
+
+/**
+ * A status notification which indicates that the listener took too long to handle a message. The detail information
+ * gives the subject and the duration of the callback.
+ */
+extern NSString *NOTIFY_SLOW_CONSUMER;
+
+/**
+ * Measure how long the downstream listener takes in each callback, to surface blocking work done on the delivery path.
+ *
+ * A callback longer than the slow threshold is reported with a NOTIFY_SLOW_CONSUMER status once it returns, at most
+ * once per report interval. A callback still running after the stall threshold is logged while it is stalled, as the
+ * listener cannot be notified before it returns; the timer which checks for stalls is suspended while nothing is
+ * delivered. Optionally, a slow consumer switches an inbound buffer placed before the watchdog to another overflow
+ * policy, e.g. OVERFLOW_CONFLATE; the previous policy is restored when the buffer drains below its low-water mark, or
+ * by the first fast callback after one second without slow ones.
+ */
+@interface StallWatchdog : NSObject <MigratoryDataListener> {
+    NSObject<MigratoryDataListener> *listener;
+
+    NSTimeInterval slowThreshold;
+    NSTimeInterval stallThreshold;
+    NSTimeInterval lastReport;
+    NSTimeInterval lastSlow;
+    NSTimeInterval lastCallback;
+
+    InboundBuffer *overflowBuffer;
+    InboundOverflowPolicy slowPolicy;
+    InboundOverflowPolicy normalPolicy;
+    BOOL degraded;
+
+    NSString *currentSubject;
+    NSTimeInterval callbackStart;
+    BOOL stallLogged;
+    unsigned long long slowCount;
+
+    dispatch_queue_t queue;
+    dispatch_source_t timer;
+    BOOL timerSuspended;
+}
+
+/**
+ * @param aListener The listener which receives the messages and statuses
+ * @param slow The callback duration above which the listener is reported as a slow consumer
+ * @param stall The callback duration above which a running callback is logged as stalled
+ */
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener slowThreshold: (NSTimeInterval)slow stallThreshold: (NSTimeInterval)stall;
+
+/**
+ * Switch the given inbound buffer to the given policy while the listener is a slow consumer.
+ *
+ * The policy applies to every subject of the buffer: do not use a lossy policy when the buffer delivers subjects whose
+ * every message must be shown, such as chat rooms. The buffer must deliver to this watchdog, directly or through other
+ * listeners; it is not retained.
+ */
+- (void) setOverflowBuffer: (InboundBuffer *)buffer policy: (InboundOverflowPolicy)policy;
+
+/**
+ * The number of callbacks longer than the slow threshold.
+ */
+- (unsigned long long) slowCount;
+
+@end
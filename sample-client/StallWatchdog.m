@@ -0,0 +1,169 @@
+#import "StallWatchdog.h"
+
+NSString *NOTIFY_SLOW_CONSUMER = @"NOTIFY_SLOW_CONSUMER";
+
+// Minimum time between two NOTIFY_SLOW_CONSUMER statuses
+#define SLOW_REPORT_INTERVAL 1.0
+
+// Time without a slow callback after which a fast callback restores the overflow policy
+#define SLOW_RESTORE_PERIOD 1.0
+
+// Time without callbacks after which the stall timer is suspended, until the next callback
+#define STALL_IDLE_PERIOD 5.0
+
+@interface StallWatchdog ()
+- (void) begin: (NSString *)subject;
+- (void) end;
+- (void) checkStall;
+@end
+
+@implementation StallWatchdog
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener slowThreshold: (NSTimeInterval)slow stallThreshold: (NSTimeInterval)stall {
+
+    self = [super init];
+    if (self != nil) {
+        listener = [aListener retain];
+        slowThreshold = slow;
+        stallThreshold = MAX(stall, slow);
+        queue = dispatch_queue_create("com.migratorydata.samples.chat.watchdog", DISPATCH_QUEUE_SERIAL);
+
+        // Not retained by the timer, the timer is cancelled in dealloc
+        __block StallWatchdog *blockSelf = self;
+        uint64_t nanos = (uint64_t)(stallThreshold / 2 * NSEC_PER_SEC);
+        timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+        dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, nanos), nanos, nanos / 2);
+        dispatch_source_set_event_handler(timer, ^{
+            [blockSelf checkStall];
+        });
+        dispatch_resume(timer);
+    }
+
+    return self;
+}
+
+- (void) setOverflowBuffer: (InboundBuffer *)buffer policy: (InboundOverflowPolicy)policy {
+    @synchronized (self) {
+        overflowBuffer = buffer;
+        slowPolicy = policy;
+    }
+}
+
+- (unsigned long long) slowCount {
+    @synchronized (self) {
+        return slowCount;
+    }
+}
+
+- (void) begin: (NSString *)subject {
+    @synchronized (self) {
+        [currentSubject release];
+        currentSubject = [subject retain];
+        callbackStart = [NSDate timeIntervalSinceReferenceDate];
+        stallLogged = NO;
+        if (timerSuspended) {
+            timerSuspended = NO;
+            dispatch_resume(timer);
+        }
+    }
+}
+
+- (void) end {
+    NSString *slowInfo = nil;
+    InboundBuffer *degrade = nil;
+    InboundBuffer *restore = nil;
+    InboundOverflowPolicy policy;
+
+    @synchronized (self) {
+        NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+        NSTimeInterval duration = now - callbackStart;
+        if (duration > slowThreshold) {
+            slowCount++;
+            if (now - lastReport >= SLOW_REPORT_INTERVAL) {
+                lastReport = now;
+                slowInfo = [NSString stringWithFormat: @"%@, %.0f ms", currentSubject, duration * 1000];
+            }
+            if (overflowBuffer != nil && !degraded) {
+                degraded = YES;
+                degrade = overflowBuffer;
+            }
+            lastSlow = now;
+        } else if (degraded && now - lastSlow >= SLOW_RESTORE_PERIOD) {
+            // The listener keeps up again, the low-water mark may never come if the buffer did not fill
+            degraded = NO;
+            restore = overflowBuffer;
+        }
+        policy = normalPolicy;
+        [currentSubject release];
+        currentSubject = nil;
+        callbackStart = 0;
+        lastCallback = now;
+    }
+
+    if (degrade != nil) {
+        @synchronized (self) {
+            normalPolicy = [degrade policy];
+        }
+        [degrade setPolicy: slowPolicy];
+    }
+    [restore setPolicy: policy];
+    if (slowInfo != nil) {
+        [listener onStatus: NOTIFY_SLOW_CONSUMER info: slowInfo];
+    }
+}
+
+- (void) checkStall {
+    @synchronized (self) {
+        NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+        if (callbackStart > 0 && !stallLogged && now - callbackStart > stallThreshold) {
+            stallLogged = YES;
+            NSLog(@"Listener stalled for more than %.0f ms on %@", stallThreshold * 1000, currentSubject);
+        } else if (callbackStart == 0 && now - lastCallback > STALL_IDLE_PERIOD) {
+            // Nothing is delivered, e.g. in background; the next callback resumes the timer
+            timerSuspended = YES;
+            dispatch_suspend(timer);
+        }
+    }
+}
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    [self begin: [message getSubject]];
+    [listener onMessage: message];
+    [self end];
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+    if ([status isEqualToString: NOTIFY_INBOUND_LOW_WATER]) {
+        InboundBuffer *restore = nil;
+        InboundOverflowPolicy policy;
+        @synchronized (self) {
+            if (degraded) {
+                degraded = NO;
+                restore = overflowBuffer;
+            }
+            policy = normalPolicy;
+        }
+        [restore setPolicy: policy];
+    }
+
+    [self begin: status];
+    [listener onStatus: status info: info];
+    [self end];
+}
+
+- (void) dealloc {
+    // A suspended source must be resumed before it is released
+    if (timerSuspended) {
+        dispatch_resume(timer);
+    }
+    dispatch_source_cancel(timer);
+    dispatch_release(timer);
+    dispatch_release(queue);
+
+    [currentSubject release];
+    [listener release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,12 @@
+#import <Foundation/Foundation.h>
+
+/**
+ * An object which subscribes subjects on the network, such as MigratoryDataClient or HistoryPager.
+ */
+@protocol SubjectSubscriber
+
+- (void) subscribe: (NSArray *)subjects;
+
+- (void) unsubscribe: (NSArray *)subjects;
+
+@end
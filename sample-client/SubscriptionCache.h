@@ -0,0 +1,40 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataListener.h"
+#import "SubjectSubscriber.h"
+
+/**
+ * Share subscriptions among several local subscribers, e.g. the screens of a multi-room UI.
+ *
+ * Only the first local subscriber of a subject subscribes it on the network, and only the last one to leave
+ * unsubscribes it. The latest retained message of each subscribed subject is cached, so a new local subscriber of a
+ * subject already held gets it synchronously, without a network round trip. Status notifications are forwarded to
+ * every local subscriber.
+ */
+@interface SubscriptionCache : NSObject <MigratoryDataListener> {
+    NSObject<SubjectSubscriber> *subscriber;
+
+    NSMutableDictionary *subscribers;
+    NSMutableDictionary *retained;
+}
+
+/**
+ * Set the object which subscribes the subjects on the network. It is not retained, as it is expected to be upstream
+ * of this listener.
+ */
+- (void) setSubscriber: (NSObject<SubjectSubscriber> *)aSubscriber;
+
+/**
+ * Deliver the messages of the subjects to the listener, replaying on the calling thread the cached retained message
+ * of the subjects already held.
+ */
+- (void) addSubscriber: (NSObject<MigratoryDataListener> *)listener forSubjects: (NSArray *)subjects;
+
+- (void) removeSubscriber: (NSObject<MigratoryDataListener> *)listener forSubjects: (NSArray *)subjects;
+
+/**
+ * Return the latest retained message received for the subject, or nil.
+ */
+- (MigratoryDataMessage *) retainedMessageForSubject: (NSString *)subject;
+
+@end
@@ -0,0 +1,127 @@
+#import "SubscriptionCache.h"
+
+@implementation SubscriptionCache
+
+- (id) init {
+
+    self = [super init];
+    if (self != nil) {
+        subscribers = [NSMutableDictionary new];
+        retained = [NSMutableDictionary new];
+    }
+
+    return self;
+}
+
+- (void) setSubscriber: (NSObject<SubjectSubscriber> *)aSubscriber {
+    @synchronized (self) {
+        subscriber = aSubscriber;
+    }
+}
+
+- (void) addSubscriber: (NSObject<MigratoryDataListener> *)listener forSubjects: (NSArray *)subjects {
+    NSMutableArray *newSubjects = [NSMutableArray array];
+    NSMutableArray *replay = [NSMutableArray array];
+
+    @synchronized (self) {
+        for (NSString *subject in subjects) {
+            NSMutableArray *listeners = [subscribers objectForKey: subject];
+            if (listeners == nil) {
+                listeners = [NSMutableArray array];
+                [subscribers setObject: listeners forKey: subject];
+                [newSubjects addObject: subject];
+            }
+            if ([listeners indexOfObjectIdenticalTo: listener] != NSNotFound) {
+                continue;
+            }
+            [listeners addObject: listener];
+
+            MigratoryDataMessage *message = [retained objectForKey: subject];
+            if (message != nil) {
+                [replay addObject: message];
+            }
+        }
+    }
+
+    for (MigratoryDataMessage *message in replay) {
+        [listener onMessage: message];
+    }
+
+    if ([newSubjects count] > 0) {
+        [subscriber subscribe: newSubjects];
+    }
+}
+
+- (void) removeSubscriber: (NSObject<MigratoryDataListener> *)listener forSubjects: (NSArray *)subjects {
+    NSMutableArray *oldSubjects = [NSMutableArray array];
+
+    @synchronized (self) {
+        for (NSString *subject in subjects) {
+            NSMutableArray *listeners = [subscribers objectForKey: subject];
+            NSUInteger index = [listeners indexOfObjectIdenticalTo: listener];
+            if (index == NSNotFound) {
+                continue;
+            }
+            [listeners removeObjectAtIndex: index];
+
+            if ([listeners count] == 0) {
+                [subscribers removeObjectForKey: subject];
+                [retained removeObjectForKey: subject];
+                [oldSubjects addObject: subject];
+            }
+        }
+    }
+
+    if ([oldSubjects count] > 0) {
+        [subscriber unsubscribe: oldSubjects];
+    }
+}
+
+- (MigratoryDataMessage *) retainedMessageForSubject: (NSString *)subject {
+    @synchronized (self) {
+        return [[[retained objectForKey: subject] retain] autorelease];
+    }
+}
+
+- (void)onMessage:(MigratoryDataMessage *)message {
+    NSArray *listeners;
+
+    @synchronized (self) {
+        NSString *subject = [message getSubject];
+        listeners = [[[subscribers objectForKey: subject] copy] autorelease];
+        if (listeners != nil && [message isRetained] && [message getMessageType] != HISTORICAL) {
+            [retained setObject: message forKey: subject];
+        }
+    }
+
+    for (NSObject<MigratoryDataListener> *listener in listeners) {
+        [listener onMessage: message];
+    }
+}
+
+- (void) onStatus: (NSString *)status info:(NSString *)info {
+    NSMutableArray *listeners = [NSMutableArray array];
+
+    @synchronized (self) {
+        for (NSArray *subjectListeners in [subscribers allValues]) {
+            for (NSObject<MigratoryDataListener> *listener in subjectListeners) {
+                if ([listeners indexOfObjectIdenticalTo: listener] == NSNotFound) {
+                    [listeners addObject: listener];
+                }
+            }
+        }
+    }
+
+    for (NSObject<MigratoryDataListener> *listener in listeners) {
+        [listener onStatus: status info: info];
+    }
+}
+
+- (void) dealloc {
+    [retained release];
+    [subscribers release];
+
+    [super dealloc];
+}
+
+@end
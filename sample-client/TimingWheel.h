@@ -0,0 +1,35 @@
+#import <Foundation/Foundation.h>
+
+/**
+ * A hierarchical timing wheel for a large number of timeouts.
+ *
+ * Scheduling an item and expiring it cost O(1). The first level has one slot per tick for the next 256 ticks; the
+ * second level has one slot per 256 ticks and is cascaded into the first as time advances. Timeouts longer than the
+ * wheel span expire at the end of the span. Not thread-safe.
+ */
+@interface TimingWheel : NSObject {
+    NSTimeInterval tick;
+    uint64_t now;
+    NSUInteger count;
+
+    NSMutableArray *inner;
+    NSMutableArray *outer;
+}
+
+- (id) initWithTick: (NSTimeInterval)seconds;
+
+/**
+ * Schedule the item to expire after the given delay, rounded up to a whole number of ticks.
+ */
+- (void) schedule: (id)item after: (NSTimeInterval)delay;
+
+/**
+ * Advance the wheel by one tick and return the items which expired.
+ */
+- (NSArray *) advance;
+
+- (NSUInteger) count;
+
+- (NSTimeInterval) tick;
+
+@end
@@ -0,0 +1,114 @@
+#import "TimingWheel.h"
+
+#define INNER_SLOTS 256
+#define OUTER_SLOTS 64
+
+// An item with the tick at which it expires.
+@interface TimingWheelEntry : NSObject {
+@public
+    id item;
+    uint64_t expiry;
+}
+@end
+
+@implementation TimingWheelEntry
+
+- (void) dealloc {
+    [item release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface TimingWheel ()
+- (void) insert: (TimingWheelEntry *)entry;
+@end
+
+@implementation TimingWheel
+
+- (id) initWithTick: (NSTimeInterval)seconds {
+
+    self = [super init];
+    if (self != nil) {
+        tick = seconds;
+        inner = [[NSMutableArray alloc] initWithCapacity: INNER_SLOTS];
+        outer = [[NSMutableArray alloc] initWithCapacity: OUTER_SLOTS];
+        for (int i = 0; i < INNER_SLOTS; i++) {
+            [inner addObject: [NSMutableArray array]];
+        }
+        for (int i = 0; i < OUTER_SLOTS; i++) {
+            [outer addObject: [NSMutableArray array]];
+        }
+    }
+
+    return self;
+}
+
+- (void) insert: (TimingWheelEntry *)entry {
+    uint64_t delta = entry->expiry - now;
+
+    if (delta < INNER_SLOTS) {
+        [[inner objectAtIndex: entry->expiry % INNER_SLOTS] addObject: entry];
+    } else {
+        uint64_t limit = now + (uint64_t)INNER_SLOTS * OUTER_SLOTS - 1;
+        if (entry->expiry > limit) {
+            entry->expiry = limit;
+        }
+        [[outer objectAtIndex: (entry->expiry / INNER_SLOTS) % OUTER_SLOTS] addObject: entry];
+    }
+}
+
+- (void) schedule: (id)item after: (NSTimeInterval)delay {
+    TimingWheelEntry *entry = [[TimingWheelEntry new] autorelease];
+    entry->item = [item retain];
+    entry->expiry = now + MAX((uint64_t)1, (uint64_t)ceil(delay / tick));
+
+    [self insert: entry];
+    count++;
+}
+
+- (NSArray *) advance {
+    now++;
+
+    // Entering a new round of the inner wheel, spread the matching outer slot over it
+    if (now % INNER_SLOTS == 0) {
+        NSMutableArray *slot = [outer objectAtIndex: (now / INNER_SLOTS) % OUTER_SLOTS];
+        NSArray *entries = [[slot copy] autorelease];
+        [slot removeAllObjects];
+        for (TimingWheelEntry *entry in entries) {
+            [self insert: entry];
+        }
+    }
+
+    NSMutableArray *slot = [inner objectAtIndex: now % INNER_SLOTS];
+    if ([slot count] == 0) {
+        return [NSArray array];
+    }
+
+    NSMutableArray *expired = [NSMutableArray arrayWithCapacity: [slot count]];
+    for (TimingWheelEntry *entry in slot) {
+        [expired addObject: entry->item];
+    }
+    count -= [slot count];
+    [slot removeAllObjects];
+
+    return expired;
+}
+
+- (NSUInteger) count {
+    return count;
+}
+
+- (NSTimeInterval) tick {
+    return tick;
+}
+
+- (void) dealloc {
+    [outer release];
+    [inner release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,178 @@
+#import <XCTest/XCTest.h>
+
+#import "ConnectionProbe.h"
+#import "LoopbackClient.h"
+
+// The heartbeat simulated, and the probe interval and timeout it is scaled down to
+#define HEARTBEAT 30.0
+#define INTERVAL 0.1
+#define TIMEOUT 0.05
+
+// Record when the first NOTIFY_CONNECTION_STALE arrives.
+@interface StaleRecorder : NSObject <MigratoryDataListener> {
+@public
+    NSTimeInterval staleTime;
+    NSUInteger messages;
+}
+@end
+
+@implementation StaleRecorder
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    @synchronized (self) {
+        messages++;
+    }
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+    @synchronized (self) {
+        if ([status isEqualToString: NOTIFY_CONNECTION_STALE] && staleTime == 0) {
+            staleTime = [NSDate timeIntervalSinceReferenceDate];
+        }
+    }
+}
+
+- (NSTimeInterval) staleTime {
+    @synchronized (self) {
+        return staleTime;
+    }
+}
+
+@end
+
+@interface ConnectionProbeTests : XCTestCase {
+    LoopbackServer *server;
+    LoopbackClient *client;
+    StaleRecorder *recorder;
+    ConnectionProbe *probe;
+}
+@end
+
+@implementation ConnectionProbeTests
+
+static BOOL WaitUntil(BOOL (^condition)(void), NSTimeInterval timeout) {
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate] + timeout;
+    while (!condition()) {
+        if ([NSDate timeIntervalSinceReferenceDate] > end) {
+            return NO;
+        }
+        [NSThread sleepForTimeInterval: 0.001];
+    }
+    return YES;
+}
+
+- (void) setUp {
+    [super setUp];
+
+    server = [[LoopbackServer alloc] initWithMaxCachedMessages: 100];
+    client = [[LoopbackClient alloc] initWithServer: server];
+    recorder = [StaleRecorder new];
+    probe = [[ConnectionProbe alloc] initWithClient: client listener: recorder subject: @"/probe" interval: INTERVAL timeout: TIMEOUT];
+    [client setListener: probe];
+    [client subscribe: @[@"/chat/a"]];
+
+    [client connect];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [client isConnected]; }, 10));
+    [probe start];
+    // The probe learns of the connection from the status delivered after it is up
+    [NSThread sleepForTimeInterval: INTERVAL / 10];
+}
+
+- (void) tearDown {
+    [probe stop];
+    [client disconnect];
+
+    [probe release];
+    [recorder release];
+    [client release];
+    [server release];
+
+    [super tearDown];
+}
+
+// Report the wakeups of a run as if the probe interval was the simulated heartbeat.
+- (double) wakeupsPerHour: (NSTimeInterval)elapsed name: (NSString *)name {
+    double simulated = elapsed * HEARTBEAT / INTERVAL;
+    double perHour = [probe wakeupCount] * 3600 / simulated;
+    NSLog(@"%@: %llu wakeups and %llu probes in %.0f simulated seconds, %.0f wakeups per hour at a %.0f s heartbeat",
+        name, [probe wakeupCount], [probe probeCount], simulated, perHour, HEARTBEAT);
+    return perHour;
+}
+
+- (void) testIdleWakeupsPerHour {
+    [NSThread sleepForTimeInterval: 20 * INTERVAL];
+
+    // One wakeup per heartbeat, the answer to a probe moves the timer to the end of the next interval
+    double perHour = [self wakeupsPerHour: 20 * INTERVAL name: @"idle"];
+    XCTAssertLessThanOrEqual(perHour, 1.25 * 3600 / HEARTBEAT);
+    XCTAssertGreaterThan([probe probeCount], 10ull);
+    XCTAssertEqual([recorder staleTime], 0);
+}
+
+- (void) testTrafficSendsNoProbes {
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate] + 20 * INTERVAL;
+    while ([NSDate timeIntervalSinceReferenceDate] < end) {
+        MigratoryDataMessage *message = [[MigratoryDataMessage alloc] init: @"/chat/a" content: @"{}" closure: nil qos: STANDARD retained: NO];
+        [server publish: message from: nil];
+        [message release];
+        [NSThread sleepForTimeInterval: INTERVAL / 4];
+    }
+
+    // The timer is armed from the last message, so it may fire up to a quarter of an interval early
+    double perHour = [self wakeupsPerHour: 20 * INTERVAL name: @"busy"];
+    XCTAssertLessThanOrEqual(perHour, 1.5 * 3600 / HEARTBEAT);
+    XCTAssertEqual([probe probeCount], 0ull);
+}
+
+- (void) testPublishesSendNoProbes {
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate] + 20 * INTERVAL;
+    for (int i = 0; [NSDate timeIntervalSinceReferenceDate] < end; i++) {
+        MigratoryDataMessage *message = [[MigratoryDataMessage alloc] init: @"/chat/b" content: @"{}"
+            closure: [NSString stringWithFormat: @"m-%d", i] qos: STANDARD retained: NO];
+        [probe publish: message];
+        [message release];
+        [NSThread sleepForTimeInterval: INTERVAL / 2];
+    }
+
+    [self wakeupsPerHour: 20 * INTERVAL name: @"publishing"];
+    XCTAssertEqual([probe probeCount], 0ull);
+    XCTAssertEqual([recorder staleTime], 0);
+}
+
+// The server stops answering without closing the connection, an idle connection is found stale by the next probe.
+- (void) testIdleDetectionLatency {
+    [NSThread sleepForTimeInterval: INTERVAL / 2];
+
+    NSTimeInterval failure = [NSDate timeIntervalSinceReferenceDate];
+    [server setLatency: 60];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [recorder staleTime] > 0; }, 10 * INTERVAL));
+
+    NSTimeInterval latency = [recorder staleTime] - failure;
+    NSLog(@"idle connection found stale after %.1f s at a %.0f s heartbeat", latency * HEARTBEAT / INTERVAL, HEARTBEAT);
+    XCTAssertLessThan(latency, 1.5 * INTERVAL + TIMEOUT);
+}
+
+// A message published on the dead connection is the probe, the failure is found within the timeout.
+- (void) testPiggybackedDetectionLatency {
+    [server setLatency: 60];
+
+    NSTimeInterval failure = [NSDate timeIntervalSinceReferenceDate];
+    MigratoryDataMessage *message = [[MigratoryDataMessage alloc] init: @"/chat/b" content: @"{}" closure: @"m-1" qos: STANDARD retained: NO];
+    [probe publish: message];
+    [message release];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [recorder staleTime] > 0; }, 10 * INTERVAL));
+
+    NSTimeInterval latency = [recorder staleTime] - failure;
+    NSLog(@"publishing connection found stale after %.1f s at a %.0f s heartbeat", latency * HEARTBEAT / INTERVAL, HEARTBEAT);
+    XCTAssertLessThan(latency, INTERVAL);
+}
+
+- (void) testHeartbeatChanged {
+    [probe setInterval: 4 * INTERVAL timeout: TIMEOUT];
+    [NSThread sleepForTimeInterval: 20 * INTERVAL];
+
+    XCTAssertLessThanOrEqual([probe probeCount], 6ull);
+    XCTAssertLessThanOrEqual([probe wakeupCount], 7ull);
+}
+
+@end
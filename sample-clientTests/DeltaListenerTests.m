@@ -0,0 +1,201 @@
+#import <XCTest/XCTest.h>
+
+#import "DeltaListener.h"
+#import "ReorderBuffer.h"
+#import "LoopbackClient.h"
+
+#define SUBJECT @"/rooms/state"
+
+// Record the contents delivered and the invalidations reported.
+@interface StateRecorder : NSObject <MigratoryDataListener> {
+    NSMutableArray *contents;
+    NSMutableArray *invalidations;
+}
+- (NSArray *) contents;
+- (NSArray *) invalidations;
+@end
+
+@implementation StateRecorder
+
+- (id) init {
+
+    self = [super init];
+    if (self != nil) {
+        contents = [NSMutableArray new];
+        invalidations = [NSMutableArray new];
+    }
+
+    return self;
+}
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    @synchronized (self) {
+        [contents addObject: [message getContent]];
+    }
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+    if ([status isEqualToString: NOTIFY_DELTA_INVALIDATED]) {
+        @synchronized (self) {
+            [invalidations addObject: info];
+        }
+    }
+}
+
+- (NSArray *) contents {
+    @synchronized (self) {
+        return [[contents copy] autorelease];
+    }
+}
+
+- (NSArray *) invalidations {
+    @synchronized (self) {
+        return [[invalidations copy] autorelease];
+    }
+}
+
+- (void) dealloc {
+    [invalidations release];
+    [contents release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface DeltaListenerTests : XCTestCase {
+    LoopbackServer *server;
+    LoopbackClient *client;
+    StateRecorder *recorder;
+    DeltaListener *delta;
+    ReorderBuffer *reorder;
+}
+@end
+
+@implementation DeltaListenerTests
+
+static BOOL WaitUntil(BOOL (^condition)(void), NSTimeInterval timeout) {
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate] + timeout;
+    while (!condition()) {
+        if ([NSDate timeIntervalSinceReferenceDate] > end) {
+            return NO;
+        }
+        [NSThread sleepForTimeInterval: 0.001];
+    }
+    return YES;
+}
+
+static id JSON(NSString *content) {
+    return [NSJSONSerialization JSONObjectWithData: [content dataUsingEncoding: NSUTF8StringEncoding] options: 0 error: nil];
+}
+
+// The state subject is reordered before its patches are applied, as in the app.
+- (void) setUpWithDelivery: (DeltaDelivery)delivery {
+    server = [[LoopbackServer alloc] initWithMaxCachedMessages: 100];
+    client = [[LoopbackClient alloc] initWithServer: server];
+    recorder = [StateRecorder new];
+    delta = [[DeltaListener alloc] initWithListener: recorder];
+    [delta setDelta: delivery forSubjects: @[SUBJECT]];
+    reorder = [[ReorderBuffer alloc] initWithListener: delta gapTimeout: 0.1 maxHeld: 100];
+    [reorder setReorderingForSubjects: @[SUBJECT]];
+    [client setListener: reorder];
+    [client subscribe: @[SUBJECT]];
+
+    [client connect];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [client isConnected]; }, 10));
+}
+
+- (void) tearDown {
+    [client disconnect];
+
+    [reorder release];
+    [delta release];
+    [recorder release];
+    [client release];
+    [server release];
+
+    [super tearDown];
+}
+
+// Deliver a message through the client as if received from the server.
+- (void) deliver: (NSString *)content type: (MigratoryDataMessageType)type seq: (int)seq {
+    MigratoryDataMessage *message = [[MigratoryDataMessage alloc] init: SUBJECT content: content closure: nil retained: NO
+        qos: GUARANTEED replySubject: nil messageType: type seq: seq epoch: 1];
+    [client deliver: message after: 0];
+    [message release];
+}
+
+- (void) testMergePatch {
+    [self setUpWithDelivery: DELTA_DELIVER_STATE];
+
+    [self deliver: @"{\"name\":\"room\",\"topic\":\"x\",\"members\":{\"alice\":{\"role\":\"admin\"},\"bob\":{\"role\":\"user\"}},\"pinned\":[1]}"
+        type: SNAPSHOT seq: 1];
+    // null removes a member, objects merge recursively, other values replace the member
+    [self deliver: @"{\"topic\":\"y\",\"members\":{\"bob\":null,\"carol\":{\"role\":\"user\"}}}" type: UPDATE seq: 2];
+    [self deliver: @"{\"members\":{\"alice\":{\"role\":\"owner\",\"muted\":null}},\"pinned\":[2,3],\"name\":null}" type: RECOVERED seq: 3];
+
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[recorder contents] count] == 3; }, 1));
+    NSDictionary *expected = JSON(@"{\"topic\":\"y\",\"members\":{\"alice\":{\"role\":\"owner\"},\"carol\":{\"role\":\"user\"}},\"pinned\":[2,3]}");
+    XCTAssertEqualObjects(JSON([[recorder contents] lastObject]), expected);
+    XCTAssertEqualObjects([delta stateForSubject: SUBJECT], expected);
+    XCTAssertEqual([[recorder invalidations] count], 0u);
+}
+
+- (void) testPatchDelivery {
+    [self setUpWithDelivery: DELTA_DELIVER_PATCH];
+
+    [self deliver: @"{\"topic\":\"x\"}" type: SNAPSHOT seq: 1];
+    [self deliver: @"{\"count\":1}" type: UPDATE seq: 2];
+
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[recorder contents] count] == 2; }, 1));
+    XCTAssertEqualObjects([[recorder contents] lastObject], @"{\"count\":1}");
+    XCTAssertEqualObjects([delta stateForSubject: SUBJECT], (@{@"topic": @"x", @"count": @1}));
+}
+
+// A patch lost for good is reported by the reorder buffer as a gap, the state is discarded until the next snapshot.
+- (void) testInvalidatedOnGap {
+    [self setUpWithDelivery: DELTA_DELIVER_STATE];
+
+    [self deliver: @"{\"topic\":\"x\"}" type: SNAPSHOT seq: 1];
+    [self deliver: @"{\"count\":3}" type: UPDATE seq: 3];
+
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[recorder invalidations] count] == 1; }, 1));
+    XCTAssertEqualObjects([[recorder invalidations] firstObject], ([NSString stringWithFormat: @"%@ %@", SUBJECT, NOTIFY_SEQUENCE_GAP]));
+    XCTAssertNil([delta stateForSubject: SUBJECT]);
+
+    // The patch after the gap is not applied, the next snapshot restores the state
+    [self deliver: @"{\"count\":4}" type: UPDATE seq: 4];
+    [self deliver: @"{\"topic\":\"z\"}" type: SNAPSHOT seq: 5];
+    [self deliver: @"{\"count\":6}" type: UPDATE seq: 6];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[recorder contents] count] == 3; }, 1));
+    XCTAssertEqualObjects(JSON([[recorder contents] lastObject]), (@{@"topic": @"z", @"count": @6}));
+}
+
+// A patch which does not follow the last one applied, e.g. with an unordered subject, discards the state.
+- (void) testInvalidatedOnSeqDiscontinuity {
+    [self setUpWithDelivery: DELTA_DELIVER_STATE];
+    [reorder removeReorderingForSubjects: @[SUBJECT]];
+
+    [self deliver: @"{\"topic\":\"x\"}" type: SNAPSHOT seq: 1];
+    [self deliver: @"{\"count\":3}" type: UPDATE seq: 3];
+
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[recorder invalidations] count] == 1; }, 1));
+    XCTAssertEqualObjects([[recorder invalidations] firstObject], SUBJECT @" seq discontinuity");
+    XCTAssertEqualObjects([recorder contents], @[@"{\"topic\":\"x\"}"]);
+    XCTAssertNil([delta stateForSubject: SUBJECT]);
+}
+
+- (void) testInvalidatedOnResync {
+    [self setUpWithDelivery: DELTA_DELIVER_STATE];
+
+    [self deliver: @"{\"topic\":\"x\"}" type: SNAPSHOT seq: 1];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [delta stateForSubject: SUBJECT] != nil; }, 1));
+
+    [client deliverStatus: NOTIFY_DATA_RESYNC info: SUBJECT after: 0];
+
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[recorder invalidations] count] == 1; }, 1));
+    XCTAssertEqualObjects([[recorder invalidations] firstObject], ([NSString stringWithFormat: @"%@ %@", SUBJECT, NOTIFY_DATA_RESYNC]));
+    XCTAssertNil([delta stateForSubject: SUBJECT]);
+}
+
+@end
@@ -0,0 +1,84 @@
+#import <XCTest/XCTest.h>
+
+#import "DuplicateFilter.h"
+
+// Count the messages which reach the listener.
+@interface CountingListener : NSObject <MigratoryDataListener> {
+@public
+    NSUInteger messages;
+}
+@end
+
+@implementation CountingListener
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    messages++;
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+}
+
+@end
+
+@interface DuplicateFilterTests : XCTestCase {
+    CountingListener *listener;
+    DuplicateFilter *filter;
+}
+@end
+
+@implementation DuplicateFilterTests
+
+- (void) setUp {
+    [super setUp];
+
+    listener = [CountingListener new];
+    filter = [[DuplicateFilter alloc] initWithListener: listener];
+}
+
+- (void) tearDown {
+    [filter release];
+    [listener release];
+
+    [super tearDown];
+}
+
+- (void) receive: (int)seq epoch: (int)epoch {
+    MigratoryDataMessage *message = [[MigratoryDataMessage alloc] init: @"/rooms/a" content: @"{}" closure: nil retained: NO
+        qos: GUARANTEED replySubject: nil messageType: UPDATE seq: seq epoch: epoch];
+    [filter onMessage: message];
+    [message release];
+}
+
+- (void) testLiveDuplicatesDropped {
+    [self receive: 1 epoch: 7];
+    [self receive: 2 epoch: 7];
+    [self receive: 1 epoch: 7];
+
+    XCTAssertEqual(listener->messages, 2u);
+    XCTAssertEqual([filter duplicateCount], 1u);
+}
+
+- (void) testOlderEpochDropped {
+    [self receive: 5 epoch: 8];
+    [self receive: 6 epoch: 7];
+
+    XCTAssertEqual(listener->messages, 1u);
+}
+
+- (void) testLiveCopyOfPushedMessageDelivered {
+    XCTAssertFalse([filter checkDuplicatePushSubject: @"/rooms/a" seq: 3 epoch: 7]);
+    [self receive: 3 epoch: 7];
+
+    XCTAssertEqual(listener->messages, 1u);
+    XCTAssertTrue([filter checkDuplicatePushSubject: @"/rooms/a" seq: 3 epoch: 7], @"pushed twice");
+}
+
+- (void) testPushOfReceivedMessageIgnored {
+    [self receive: 3 epoch: 7];
+
+    XCTAssertTrue([filter checkDuplicatePushSubject: @"/rooms/a" seq: 3 epoch: 7]);
+    XCTAssertFalse([filter checkDuplicatePushSubject: @"/rooms/a" seq: 4 epoch: 7]);
+    XCTAssertEqual(listener->messages, 1u);
+}
+
+@end
@@ -0,0 +1,196 @@
+#import <XCTest/XCTest.h>
+
+#import "HistoryPager.h"
+#import "LoopbackClient.h"
+
+#define SUBJECT @"/chat/history"
+#define PAGE_SIZE 20
+#define PUBLISHED 200
+
+// Record the seqs of the messages reaching a listener, and count the historical ones.
+@interface SeqRecorder : NSObject <MigratoryDataListener> {
+    NSObject<MigratoryDataListener> *next;
+    NSMutableArray *seqs;
+    NSUInteger historical;
+}
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener;
+- (NSArray *) seqs;
+- (NSUInteger) historical;
+@end
+
+@implementation SeqRecorder
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener {
+
+    self = [super init];
+    if (self != nil) {
+        next = [aListener retain];
+        seqs = [NSMutableArray new];
+    }
+
+    return self;
+}
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    @synchronized (self) {
+        [seqs addObject: [NSNumber numberWithInt: [message getSeq]]];
+        if ([message getMessageType] == HISTORICAL) {
+            historical++;
+        }
+    }
+    [next onMessage: message];
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+    [next onStatus: status info: info];
+}
+
+- (NSArray *) seqs {
+    @synchronized (self) {
+        return [[seqs copy] autorelease];
+    }
+}
+
+- (NSUInteger) historical {
+    @synchronized (self) {
+        return historical;
+    }
+}
+
+- (void) dealloc {
+    [seqs release];
+    [next release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface HistoryPagerTests : XCTestCase {
+    LoopbackServer *server;
+    LoopbackClient *client;
+    SeqRecorder *delivered;
+    HistoryPager *pager;
+    SeqRecorder *received;
+}
+@end
+
+@implementation HistoryPagerTests
+
+static BOOL WaitUntil(BOOL (^condition)(void), NSTimeInterval timeout) {
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate] + timeout;
+    while (!condition()) {
+        if ([NSDate timeIntervalSinceReferenceDate] > end) {
+            return NO;
+        }
+        [NSThread sleepForTimeInterval: 0.001];
+    }
+    return YES;
+}
+
+// The app sees what the pager delivers, what the server sends is counted before it.
+- (void) setUpWithPageTimeout: (NSTimeInterval)timeout {
+    server = [[LoopbackServer alloc] initWithMaxCachedMessages: 1000];
+    client = [[LoopbackClient alloc] initWithServer: server];
+    delivered = [[SeqRecorder alloc] initWithListener: nil];
+    pager = [[HistoryPager alloc] initWithClient: client listener: delivered pageSize: PAGE_SIZE maxHistory: 1000 pageTimeout: timeout];
+    received = [[SeqRecorder alloc] initWithListener: pager];
+    [client setListener: received];
+
+    for (int i = 0; i < PUBLISHED; i++) {
+        MigratoryDataMessage *message = [[MigratoryDataMessage alloc] init: SUBJECT content: [NSString stringWithFormat: @"%d", i]
+            closure: nil qos: GUARANTEED retained: NO];
+        [server publish: message from: nil];
+        [message release];
+    }
+
+    [client connect];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [client isConnected]; }, 10));
+    [pager subscribe: @[SUBJECT]];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[delivered seqs] count] == PAGE_SIZE; }, 10));
+}
+
+- (void) tearDown {
+    [client disconnect];
+
+    [received release];
+    [pager release];
+    [delivered release];
+    [client release];
+    [server release];
+
+    [super tearDown];
+}
+
+// Load the page preceding the oldest message held, waiting on the main run loop where the completion is called.
+- (NSArray *) loadOlderPage {
+    __block NSArray *page = nil;
+    XCTestExpectation *loaded = [self expectationWithDescription: @"page loaded"];
+    [pager loadOlderPage: SUBJECT completion: ^(NSArray *messages, BOOL hasMore) {
+        page = [messages retain];
+        [loaded fulfill];
+    }];
+    [self waitForExpectations: @[loaded] timeout: 10];
+    return [page autorelease];
+}
+
+- (void) testResentMessagesDroppedBySeq {
+    [self setUpWithPageTimeout: 5.0];
+    NSArray *latest = [delivered seqs];
+    XCTAssertEqualObjects([latest firstObject], @(PUBLISHED - PAGE_SIZE + 1));
+
+    int oldest = [[latest firstObject] intValue];
+    for (int p = 0; p < 3; p++) {
+        NSArray *page = [self loadOlderPage];
+        XCTAssertEqual([page count], (NSUInteger)PAGE_SIZE);
+        for (NSUInteger i = 0; i < [page count]; i++) {
+            XCTAssertEqual([[page objectAtIndex: i] getSeq], oldest - PAGE_SIZE + (int)i);
+        }
+        oldest -= PAGE_SIZE;
+    }
+
+    // The server re-sent the latest page with each request, none of it reached the listener again
+    XCTAssertGreaterThan([received historical], (NSUInteger)(4 * PAGE_SIZE));
+    XCTAssertEqualObjects([delivered seqs], latest);
+
+    // Live messages are still delivered once the re-sent range is over
+    MigratoryDataMessage *live = [[MigratoryDataMessage alloc] init: SUBJECT content: @"live" closure: nil qos: GUARANTEED retained: NO];
+    [server publish: live from: nil];
+    [live release];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[delivered seqs] count] == PAGE_SIZE + 1; }, 10));
+    XCTAssertEqualObjects([[delivered seqs] lastObject], @(PUBLISHED + 1));
+}
+
+- (void) testMessagesReceivedLinearInHistory {
+    [self setUpWithPageTimeout: 5.0];
+
+    NSMutableSet *loaded = [NSMutableSet setWithArray: [delivered seqs]];
+    int pages = 0;
+    while ([pager hasMoreHistory: SUBJECT]) {
+        for (MigratoryDataMessage *message in [self loadOlderPage]) {
+            [loaded addObject: @([message getSeq])];
+        }
+        pages++;
+        XCTAssertLessThan(pages, 2 * PUBLISHED / PAGE_SIZE);
+    }
+
+    NSLog(@"%lu messages loaded in %d pages, %lu historical messages received", (unsigned long)[loaded count], pages + 1,
+        (unsigned long)[received historical]);
+    XCTAssertEqual([loaded count], (NSUInteger)PUBLISHED);
+    // Growing the history one page at a time would receive PAGE_SIZE * (1 + 2 + ... + pages) messages
+    XCTAssertLessThanOrEqual([received historical], (NSUInteger)(3 * PUBLISHED));
+}
+
+- (void) testPageTimeout {
+    [self setUpWithPageTimeout: 0.2];
+    [server setLatency: 2.0];
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    NSArray *page = [self loadOlderPage];
+
+    XCTAssertEqual([page count], 0u);
+    XCTAssertLessThan([NSDate timeIntervalSinceReferenceDate] - start, 1.0);
+    XCTAssertFalse([pager hasMoreHistory: SUBJECT]);
+}
+
+@end
@@ -0,0 +1,94 @@
+#import <XCTest/XCTest.h>
+
+#import "JSONFieldExtractor.h"
+
+#define ITERATIONS 100000
+
+@interface JSONFieldExtractorTests : XCTestCase
+@end
+
+@implementation JSONFieldExtractorTests
+
+static NSString *ChatMessage(void) {
+    return @"{\"id\":\"8c1f2e\",\"room\":\"/chat/general\",\"meta\":{\"client\":\"ios\",\"text\":\"nested\"},"
+        @"\"user\":\"Zoë\",\"text\":\"See you at the \\\"usual\\\" place, around 7 — don't be late!\",\"ts\":1729281748}";
+}
+
+// A message with a long history of edits before the fields shown.
+static NSString *LargeMessage(void) {
+    NSMutableString *json = [NSMutableString stringWithString: @"{\"edits\":["];
+    for (int i = 0; i < 50; i++) {
+        [json appendFormat: @"%@{\"at\":%d,\"text\":\"revision %d of a rather long message body\"}", i > 0 ? @"," : @"", i, i];
+    }
+    [json appendString: @"],\"user\":\"alice\",\"text\":\"final text\"}"];
+    return json;
+}
+
+- (void) testExtractFields {
+    const char *keys[] = { "user", "text", "ts", "missing" };
+    NSString *fields[4];
+
+    JSONStringFields(ChatMessage(), keys, fields, 4);
+
+    XCTAssertEqualObjects(fields[0], @"Zoë");
+    XCTAssertEqualObjects(fields[1], @"See you at the \"usual\" place, around 7 — don't be late!");
+    XCTAssertNil(fields[2], @"not a string");
+    XCTAssertNil(fields[3]);
+    XCTAssertEqualObjects(JSONStringField(LargeMessage(), "text"), @"final text");
+}
+
+- (void) testExtractFromInvalidContent {
+    const char *keys[] = { "user", "text" };
+    NSString *fields[2] = { @"stale", @"stale" };
+
+    JSONStringFields(@"plain text", keys, fields, 2);
+    XCTAssertNil(fields[0]);
+    XCTAssertNil(fields[1]);
+
+    XCTAssertNil(JSONStringField(@"{\"user\":\"bob", "user"));
+    XCTAssertNil(JSONStringField(@"[\"user\",\"bob\"]", "user"));
+}
+
+// Compare picking the user and text of a message with parsing the whole message into a dictionary.
+- (void) benchmarkContent: (NSString *)content name: (NSString *)name {
+    const char *keys[] = { "user", "text" };
+    NSUInteger matches = 0;
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    for (int i = 0; i < ITERATIONS; i++) {
+        @autoreleasepool {
+            NSData *data = [content dataUsingEncoding: NSUTF8StringEncoding];
+            NSDictionary *object = [NSJSONSerialization JSONObjectWithData: data options: 0 error: nil];
+            if ([object objectForKey: @"user"] != nil && [object objectForKey: @"text"] != nil) {
+                matches++;
+            }
+        }
+    }
+    NSTimeInterval parse = ([NSDate timeIntervalSinceReferenceDate] - start) / ITERATIONS;
+
+    start = [NSDate timeIntervalSinceReferenceDate];
+    for (int i = 0; i < ITERATIONS; i++) {
+        @autoreleasepool {
+            NSString *fields[2];
+            JSONStringFields(content, keys, fields, 2);
+            if (fields[0] != nil && fields[1] != nil) {
+                matches++;
+            }
+        }
+    }
+    NSTimeInterval extract = ([NSDate timeIntervalSinceReferenceDate] - start) / ITERATIONS;
+
+    NSLog(@"%@ message of %lu bytes: full parse %.2fus, field extraction %.2fus, %.1fx", name,
+        (unsigned long)[content lengthOfBytesUsingEncoding: NSUTF8StringEncoding], parse * 1e6, extract * 1e6, parse / extract);
+    XCTAssertEqual(matches, 2u * ITERATIONS);
+}
+
+- (void) testChatMessageBenchmark {
+    [self benchmarkContent: ChatMessage() name: @"chat"];
+}
+
+- (void) testLargeMessageBenchmark {
+    [self benchmarkContent: LargeMessage() name: @"large"];
+}
+
+@end
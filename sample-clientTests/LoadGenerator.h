@@ -0,0 +1,98 @@
+#import <Foundation/Foundation.h>
+
+#import "MigratoryDataClient.h"
+
+@class LoadReport;
+
+/**
+ * Create one simulated client; the default creates a LoopbackClient connected to an in-process LoopbackServer.
+ */
+typedef MigratoryDataClient *(^LoadClientFactory)(NSUInteger index);
+
+typedef void (^LoadReportHandler)(LoadReport *report);
+
+/**
+ * The results of a load run.
+ */
+@interface LoadReport : NSObject {
+    NSUInteger clients;
+    NSUInteger connected;
+    NSTimeInterval connectTime;
+    NSTimeInterval duration;
+    unsigned long long published;
+    unsigned long long received;
+    NSData *latencies;
+}
+
+/**
+ * The number of clients which connected, and the time from the start of the run until the last of them connected.
+ */
+- (NSUInteger) connectedCount;
+- (NSTimeInterval) connectTime;
+
+- (unsigned long long) publishedCount;
+- (unsigned long long) receivedCount;
+
+/**
+ * The number of messages received by all clients per second of publishing.
+ */
+- (double) throughput;
+
+/**
+ * The publish-to-delivery latency, in seconds, under which the given percent of the sampled messages were delivered.
+ */
+- (NSTimeInterval) latencyPercentile: (double)percent;
+
+@end
+
+/**
+ * Drive many simulated chat clients from one process to measure how the client stack behaves at scale.
+ *
+ * Each client subscribes to a few chat rooms and publishes to them at its own rate; all clients are driven by a single
+ * timer, so thousands of them do not need thousands of threads. Every message carries its publish time, which gives
+ * the delivery latency when it is received by any client subscribed to its room. It is part of the test target and
+ * run by LoadGeneratorTests, not by the app.
+ */
+@interface LoadGenerator : NSObject {
+    LoadClientFactory factory;
+
+    NSMutableArray *clients;
+    NSMutableArray *listeners;
+    double *rates;
+    double *credits;
+    NSUInteger roomCount;
+    NSUInteger roomsPerClient;
+
+    NSTimeInterval startTime;
+    NSTimeInterval lastConnectTime;
+    NSMutableIndexSet *connectedClients;
+    unsigned long long published;
+    unsigned long long received;
+    NSMutableData *latencies;
+
+    dispatch_queue_t queue;
+    dispatch_source_t timer;
+}
+
+- (id) init;
+- (id) initWithClientFactory: (LoadClientFactory)clientFactory;
+
+/**
+ * Connect the given number of clients at once, let each of them publish at a rate drawn around the given mean for the
+ * given duration, then disconnect them and report.
+ *
+ * @param count The number of clients
+ * @param rooms The number of chat rooms shared by the clients
+ * @param perClient The number of rooms each client subscribes to
+ * @param rate The mean number of messages per second published by one client
+ * @param duration The publishing time
+ * @param completion Called on the main queue with the results
+ */
+- (void) runWithClients: (NSUInteger)count rooms: (NSUInteger)rooms roomsPerClient: (NSUInteger)perClient publishRate: (double)rate duration: (NSTimeInterval)duration completion: (LoadReportHandler)completion;
+
+/// @cond
+- (void) client: (NSUInteger)index didReceiveStatus: (NSString *)status;
+- (void) client: (NSUInteger)index didReceiveMessage: (MigratoryDataMessage *)message;
+/// @endcond
+
+@end
@@ -0,0 +1,300 @@
+#import "LoadGenerator.h"
+#import "LoopbackClient.h"
+
+// Latency samples kept for the percentiles
+#define MAX_LATENCY_SAMPLES 1000000
+
+// Publish tick of the event loop
+#define LOAD_TICK 0.01
+
+// Forward the callbacks of one client to the generator.
+@interface LoadClientListener : NSObject <MigratoryDataListener> {
+    LoadGenerator *generator;
+    NSUInteger index;
+}
+- (id) initWithGenerator: (LoadGenerator *)aGenerator index: (NSUInteger)anIndex;
+@end
+
+@implementation LoadClientListener
+
+- (id) initWithGenerator: (LoadGenerator *)aGenerator index: (NSUInteger)anIndex {
+
+    self = [super init];
+    if (self != nil) {
+        // Not retained, the generator retains the listeners
+        generator = aGenerator;
+        index = anIndex;
+    }
+
+    return self;
+}
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    [generator client: index didReceiveMessage: message];
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+    [generator client: index didReceiveStatus: status];
+}
+
+@end
+
+static int CompareLatencies(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+@interface LoadReport ()
+- (id) initWithClients: (NSUInteger)count connected: (NSUInteger)connectedCount connectTime: (NSTimeInterval)connectSeconds duration: (NSTimeInterval)seconds published: (unsigned long long)publishedCount received: (unsigned long long)receivedCount latencies: (NSData *)samples;
+@end
+
+@implementation LoadReport
+
+- (id) initWithClients: (NSUInteger)count connected: (NSUInteger)connectedCount connectTime: (NSTimeInterval)connectSeconds duration: (NSTimeInterval)seconds published: (unsigned long long)publishedCount received: (unsigned long long)receivedCount latencies: (NSData *)samples {
+
+    self = [super init];
+    if (self != nil) {
+        clients = count;
+        connected = connectedCount;
+        connectTime = connectSeconds;
+        duration = seconds;
+        published = publishedCount;
+        received = receivedCount;
+
+        NSMutableData *sorted = [samples mutableCopy];
+        qsort([sorted mutableBytes], [sorted length] / sizeof(double), sizeof(double), CompareLatencies);
+        latencies = sorted;
+    }
+
+    return self;
+}
+
+- (NSUInteger) connectedCount {
+    return connected;
+}
+
+- (NSTimeInterval) connectTime {
+    return connectTime;
+}
+
+- (unsigned long long) publishedCount {
+    return published;
+}
+
+- (unsigned long long) receivedCount {
+    return received;
+}
+
+- (double) throughput {
+    return duration > 0 ? received / duration : 0;
+}
+
+- (NSTimeInterval) latencyPercentile: (double)percent {
+    NSUInteger count = [latencies length] / sizeof(double);
+    if (count == 0) {
+        return 0;
+    }
+    NSUInteger rank = (NSUInteger)(percent / 100 * (count - 1) + 0.5);
+    return ((const double *)[latencies bytes])[MIN(rank, count - 1)];
+}
+
+- (NSString *) description {
+    return [NSString stringWithFormat: @"%lu/%lu clients connected in %.3fs, %llu published, %llu received, %.0f msg/s, latency p50 %.1fms p90 %.1fms p99 %.1fms p99.9 %.1fms",
+        (unsigned long)connected, (unsigned long)clients, connectTime, published, received, [self throughput],
+        [self latencyPercentile: 50] * 1000, [self latencyPercentile: 90] * 1000,
+        [self latencyPercentile: 99] * 1000, [self latencyPercentile: 99.9] * 1000];
+}
+
+- (void) dealloc {
+    [latencies release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface LoadGenerator ()
+- (void) tick;
+- (void) finish: (NSUInteger)count duration: (NSTimeInterval)duration completion: (LoadReportHandler)completion;
+- (NSString *) room: (NSUInteger)room;
+@end
+
+@implementation LoadGenerator
+
+- (id) init {
+    LoopbackServer *server = [[[LoopbackServer alloc] initWithMaxCachedMessages: 1000] autorelease];
+    return [self initWithClientFactory: ^MigratoryDataClient *(NSUInteger index) {
+        return [[[LoopbackClient alloc] initWithServer: server] autorelease];
+    }];
+}
+
+- (id) initWithClientFactory: (LoadClientFactory)clientFactory {
+
+    self = [super init];
+    if (self != nil) {
+        factory = [clientFactory copy];
+        clients = [NSMutableArray new];
+        listeners = [NSMutableArray new];
+        latencies = [NSMutableData new];
+        connectedClients = [NSMutableIndexSet new];
+        queue = dispatch_queue_create("com.migratorydata.samples.chat.load", DISPATCH_QUEUE_SERIAL);
+    }
+
+    return self;
+}
+
+- (NSString *) room: (NSUInteger)room {
+    return [NSString stringWithFormat: @"/load/room-%lu", (unsigned long)room];
+}
+
+- (void) runWithClients: (NSUInteger)count rooms: (NSUInteger)rooms roomsPerClient: (NSUInteger)perClient publishRate: (double)rate duration: (NSTimeInterval)duration completion: (LoadReportHandler)completion {
+    dispatch_async(queue, ^{
+        if (timer != NULL || count == 0) {
+            return;
+        }
+
+        roomCount = MAX(rooms, 1);
+        roomsPerClient = MAX(MIN(perClient, roomCount), 1);
+        free(rates);
+        free(credits);
+        rates = malloc(count * sizeof(double));
+        credits = calloc(count, sizeof(double));
+        [connectedClients removeAllIndexes];
+        published = 0;
+        received = 0;
+        [latencies setLength: 0];
+
+        for (NSUInteger i = 0; i < count; i++) {
+            // Spread the rates between half and one and a half of the mean
+            rates[i] = rate * (0.5 + arc4random_uniform(1001) / 1000.0);
+
+            MigratoryDataClient *client = factory(i);
+            LoadClientListener *listener = [[[LoadClientListener alloc] initWithGenerator: self index: i] autorelease];
+            [client setListener: listener];
+
+            NSMutableArray *subjects = [NSMutableArray arrayWithCapacity: roomsPerClient];
+            for (NSUInteger k = 0; k < roomsPerClient; k++) {
+                [subjects addObject: [self room: (i * roomsPerClient + k) % roomCount]];
+            }
+            [client subscribe: subjects];
+
+            [clients addObject: client];
+            [listeners addObject: listener];
+        }
+
+        // The connect storm: all clients at once, each connection completes asynchronously
+        startTime = [NSDate timeIntervalSinceReferenceDate];
+        lastConnectTime = startTime;
+        for (MigratoryDataClient *client in clients) {
+            [client connect];
+        }
+
+        __block LoadGenerator *blockSelf = self;
+        uint64_t nanos = (uint64_t)(LOAD_TICK * NSEC_PER_SEC);
+        timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+        dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, nanos), nanos, nanos / 10);
+        dispatch_source_set_event_handler(timer, ^{
+            [blockSelf tick];
+        });
+        dispatch_resume(timer);
+
+        LoadReportHandler handler = [[completion copy] autorelease];
+        [self retain];
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(duration * NSEC_PER_SEC)), queue, ^{
+            dispatch_source_cancel(timer);
+            dispatch_release(timer);
+            timer = NULL;
+
+            // Let the messages in flight arrive before disconnecting
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(1 * NSEC_PER_SEC)), queue, ^{
+                [self finish: count duration: duration completion: handler];
+                [self release];
+            });
+        });
+    });
+}
+
+- (void) tick {
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    NSString *content = [NSString stringWithFormat: @"%.6f", now];
+    NSUInteger count = [clients count];
+
+    for (NSUInteger i = 0; i < count; i++) {
+        credits[i] += rates[i] * LOAD_TICK;
+        while (credits[i] >= 1) {
+            credits[i] -= 1;
+            NSUInteger room = (i * roomsPerClient + arc4random_uniform((uint32_t)roomsPerClient)) % roomCount;
+            MigratoryDataMessage *message = [[MigratoryDataMessage alloc] init: [self room: room] content: content];
+            [[clients objectAtIndex: i] publish: message];
+            [message release];
+            published++;
+        }
+    }
+}
+
+- (void) client: (NSUInteger)index didReceiveStatus: (NSString *)status {
+    if ([status isEqualToString: NOTIFY_SERVER_UP]) {
+        NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+        dispatch_async(queue, ^{
+            // Count the first connection of each client, not its reconnections
+            if (![connectedClients containsIndex: index]) {
+                [connectedClients addIndex: index];
+                lastConnectTime = MAX(lastConnectTime, now);
+            }
+        });
+    }
+}
+
+- (void) client: (NSUInteger)index didReceiveMessage: (MigratoryDataMessage *)message {
+    if ([message getMessageType] != UPDATE) {
+        return;
+    }
+    NSTimeInterval latency = [NSDate timeIntervalSinceReferenceDate] - [[message getContent] doubleValue];
+    dispatch_async(queue, ^{
+        received++;
+        if ([latencies length] < MAX_LATENCY_SAMPLES * sizeof(double)) {
+            [latencies appendBytes: &latency length: sizeof(double)];
+        }
+    });
+}
+
+- (void) finish: (NSUInteger)count duration: (NSTimeInterval)duration completion: (LoadReportHandler)completion {
+    for (MigratoryDataClient *client in clients) {
+        [client disconnect];
+    }
+
+    LoadReport *report = [[[LoadReport alloc] initWithClients: count connected: [connectedClients count]
+        connectTime: lastConnectTime - startTime duration: duration published: published received: received
+        latencies: latencies] autorelease];
+
+    [clients removeAllObjects];
+    [listeners removeAllObjects];
+
+    if (completion != nil) {
+        [report retain];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completion(report);
+            [report release];
+        });
+    }
+}
+
+- (void) dealloc {
+    if (timer != NULL) {
+        dispatch_source_cancel(timer);
+        dispatch_release(timer);
+    }
+    dispatch_release(queue);
+
+    free(credits);
+    free(rates);
+    [latencies release];
+    [connectedClients release];
+    [listeners release];
+    [clients release];
+    [factory release];
+
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,40 @@
+#import <XCTest/XCTest.h>
+
+#import "LoadGenerator.h"
+
+@interface LoadGeneratorTests : XCTestCase
+@end
+
+@implementation LoadGeneratorTests
+
+// Run the generator against an in-process server and wait for its report.
+- (LoadReport *) runWithClients: (NSUInteger)count rooms: (NSUInteger)rooms roomsPerClient: (NSUInteger)perClient publishRate: (double)rate duration: (NSTimeInterval)duration {
+    LoadGenerator *generator = [[[LoadGenerator alloc] init] autorelease];
+    XCTestExpectation *done = [self expectationWithDescription: @"load report"];
+    __block LoadReport *result = nil;
+
+    [generator runWithClients: count rooms: rooms roomsPerClient: perClient publishRate: rate duration: duration completion: ^(LoadReport *report) {
+        result = [report retain];
+        [done fulfill];
+    }];
+    [self waitForExpectations: @[done] timeout: duration + 30];
+
+    NSLog(@"%@", result);
+    return [result autorelease];
+}
+
+- (void) testConnectStorm {
+    LoadReport *report = [self runWithClients: 1000 rooms: 10 roomsPerClient: 1 publishRate: 0 duration: 1];
+
+    XCTAssertEqual([report connectedCount], 1000u);
+}
+
+- (void) testChatRooms {
+    LoadReport *report = [self runWithClients: 200 rooms: 20 roomsPerClient: 2 publishRate: 1 duration: 10];
+
+    XCTAssertEqual([report connectedCount], 200u);
+    XCTAssertGreaterThan([report publishedCount], 0u);
+    XCTAssertGreaterThanOrEqual([report receivedCount], [report publishedCount]);
+}
+
+@end
@@ -0,0 +1,89 @@
+#import <XCTest/XCTest.h>
+
+#import "LoopbackClient.h"
+
+// Unsubscribe from the subject of the first message received, from within the callback.
+@interface UnsubscribingListener : NSObject <MigratoryDataListener> {
+@public
+    MigratoryDataClient *client;
+    XCTestExpectation *unsubscribed;
+    NSUInteger messages;
+}
+@end
+
+@implementation UnsubscribingListener
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    @synchronized (self) {
+        messages++;
+    }
+    if ([[client getSubjects] containsObject: [message getSubject]]) {
+        [client unsubscribe: @[[message getSubject]]];
+        [client subscribe: @[@"/other"]];
+        [unsubscribed fulfill];
+    }
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+}
+
+@end
+
+@interface LoopbackClientTests : XCTestCase
+@end
+
+@implementation LoopbackClientTests
+
+static BOOL WaitUntil(BOOL (^condition)(void), NSTimeInterval timeout) {
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate] + timeout;
+    while (!condition()) {
+        if ([NSDate timeIntervalSinceReferenceDate] > end) {
+            return NO;
+        }
+        [NSThread sleepForTimeInterval: 0.001];
+    }
+    return YES;
+}
+
+- (void) testListenerCallsClientFromCallback {
+    LoopbackServer *server = [[[LoopbackServer alloc] initWithMaxCachedMessages: 10] autorelease];
+    LoopbackClient *client = [[[LoopbackClient alloc] initWithServer: server] autorelease];
+    UnsubscribingListener *listener = [[UnsubscribingListener new] autorelease];
+    listener->client = client;
+    listener->unsubscribed = [self expectationWithDescription: @"unsubscribed from the callback"];
+
+    [client setListener: listener];
+    [client subscribe: @[@"/room"]];
+    [client connect];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [client isConnected]; }, 10));
+    [NSThread sleepForTimeInterval: 0.1];
+
+    MigratoryDataMessage *message = [[[MigratoryDataMessage alloc] init: @"/room" content: @"first"] autorelease];
+    [client publish: message];
+    [self waitForExpectations: @[listener->unsubscribed] timeout: 5];
+
+    // Not delivered any more once unsubscribed
+    [client publish: message];
+    [NSThread sleepForTimeInterval: 0.1];
+    XCTAssertEqual(listener->messages, 1u);
+    XCTAssertEqualObjects([client getSubjects], @[@"/other"]);
+
+    [client disconnect];
+}
+
+- (void) testUnsubscribeUnknownSubject {
+    LoopbackServer *server = [[[LoopbackServer alloc] initWithMaxCachedMessages: 10] autorelease];
+    LoopbackClient *client = [[[LoopbackClient alloc] initWithServer: server] autorelease];
+
+    [client connect];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [client isConnected]; }, 10));
+
+    // Never seen by the server
+    [server unsubscribe: client subjects: @[@"/unknown"]];
+    [client unsubscribe: @[@"/unknown"]];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[client getSubjects] count] == 0; }, 1));
+
+    [client disconnect];
+}
+
+@end
@@ -0,0 +1,127 @@
+#import <XCTest/XCTest.h>
+
+#import "MessageStore.h"
+#import "ChatPush.h"
+
+static NSString *ROOM = @"/rooms/a";
+
+@interface MessageStoreTests : XCTestCase {
+    NSString *directory;
+    MessageStore *store;
+}
+@end
+
+@implementation MessageStoreTests
+
+- (void) setUp {
+    [super setUp];
+
+    directory = [[NSTemporaryDirectory() stringByAppendingPathComponent: [[NSUUID UUID] UUIDString]] retain];
+    store = [[MessageStore alloc] initWithDirectory: directory];
+}
+
+- (void) tearDown {
+    [store release];
+    [[NSFileManager defaultManager] removeItemAtPath: directory error: nil];
+    [directory release];
+
+    [super tearDown];
+}
+
+// The seq of the stored messages, as "epoch:seq", in the order of the store.
+- (NSArray *) storedKeys {
+    NSMutableArray *keys = [NSMutableArray array];
+    for (StoredMessage *message in [store messagesForSubject: ROOM range: NSMakeRange(0, [store countForSubject: ROOM])]) {
+        [keys addObject: [NSString stringWithFormat: @"%d:%d", [message epoch], [message seq]]];
+    }
+    return keys;
+}
+
+- (void) testInsertedInOrder {
+    for (NSNumber *seq in @[@1, @2, @5, @3, @6, @4]) {
+        XCTAssertTrue([store appendContent: [seq stringValue] subject: ROOM seq: [seq intValue] epoch: 1]);
+    }
+    // A new epoch comes after every seq of the previous one
+    XCTAssertTrue([store appendContent: @"restart" subject: ROOM seq: 1 epoch: 2]);
+    XCTAssertTrue([store appendContent: @"late" subject: ROOM seq: 7 epoch: 1]);
+
+    NSArray *expected = @[@"1:1", @"1:2", @"1:3", @"1:4", @"1:5", @"1:6", @"1:7", @"2:1"];
+    XCTAssertEqualObjects([self storedKeys], expected);
+    XCTAssertEqual([store countForSubject: ROOM], 8u);
+
+    int seq, epoch;
+    XCTAssertTrue([store lastSeq: &seq epoch: &epoch forSubject: ROOM]);
+    XCTAssertEqual(seq, 1);
+    XCTAssertEqual(epoch, 2);
+    XCTAssertFalse([store lastSeq: &seq epoch: &epoch forSubject: @"/rooms/empty"]);
+
+    NSArray *middle = [store messagesForSubject: ROOM range: NSMakeRange(2, 2)];
+    XCTAssertEqualObjects([[middle objectAtIndex: 0] content], @"3");
+    XCTAssertEqualObjects([[middle objectAtIndex: 1] content], @"4");
+}
+
+- (void) testDuplicateSkipped {
+    XCTAssertTrue([store appendContent: @"first" subject: ROOM seq: 1 epoch: 1]);
+    XCTAssertTrue([store appendContent: @"second" subject: ROOM seq: 2 epoch: 1]);
+    XCTAssertFalse([store appendContent: @"again" subject: ROOM seq: 1 epoch: 1]);
+    XCTAssertFalse([store appendContent: @"again" subject: ROOM seq: 2 epoch: 1]);
+
+    NSArray *batch = @[
+        [[[StoredMessage alloc] initWithContent: @"third" seq: 3 epoch: 1 time: 0] autorelease],
+        [[[StoredMessage alloc] initWithContent: @"again" seq: 2 epoch: 1 time: 0] autorelease],
+        [[[StoredMessage alloc] initWithContent: @"third again" seq: 3 epoch: 1 time: 0] autorelease]
+    ];
+    NSUInteger firstIndex;
+    XCTAssertEqual([store appendMessages: batch subject: ROOM firstIndex: &firstIndex], 1u);
+    XCTAssertEqual(firstIndex, 2u);
+
+    XCTAssertEqualObjects([self storedKeys], (@[@"1:1", @"1:2", @"1:3"]));
+    XCTAssertEqualObjects([[[store messagesForSubject: ROOM range: NSMakeRange(0, 1)] firstObject] content], @"first");
+}
+
+- (void) testCrashWhileWritingTruncated {
+    XCTAssertTrue([store appendContent: @"first" subject: ROOM seq: 1 epoch: 1]);
+    XCTAssertTrue([store appendContent: @"second" subject: ROOM seq: 2 epoch: 1]);
+
+    // A record written without its offset, then half of an offset, as a crash in the middle of an append leaves them
+    NSFileHandle *log = [NSFileHandle fileHandleForWritingAtPath: [store pathForSubject: ROOM extension: @"log"]];
+    [log seekToEndOfFile];
+    [log writeData: [@"a record never indexed" dataUsingEncoding: NSUTF8StringEncoding]];
+    [log closeFile];
+    NSFileHandle *index = [NSFileHandle fileHandleForWritingAtPath: [store pathForSubject: ROOM extension: @"idx"]];
+    [index seekToEndOfFile];
+    uint32_t half = 0x1234;
+    [index writeData: [NSData dataWithBytes: &half length: sizeof(half)]];
+    [index closeFile];
+
+    // The next append drops the partial offset, the unindexed record is never read
+    XCTAssertTrue([store appendContent: @"third" subject: ROOM seq: 3 epoch: 1]);
+    XCTAssertEqualObjects([self storedKeys], (@[@"1:1", @"1:2", @"1:3"]));
+    XCTAssertEqualObjects([[[store messagesForSubject: ROOM range: NSMakeRange(2, 1)] firstObject] content], @"third");
+}
+
+- (void) testPushStoredOffTheCallingThread {
+    ChatPush *push = [[[ChatPush alloc] initWithPayload: @{@"subject": ROOM, @"content": @"{\"text\":\"hi\"}", @"seq": @"4", @"epoch": @"1"}] autorelease];
+    XCTestExpectation *appended = [self expectationForNotification: MESSAGE_STORE_DID_APPEND object: store handler: ^BOOL(NSNotification *notification) {
+        return [[[notification userInfo] objectForKey: MESSAGE_STORE_SUBJECT] isEqualToString: ROOM];
+    }];
+    XCTestExpectation *done = [self expectationWithDescription: @"stored"];
+
+    [push storeIn: store completion: ^(BOOL stored) {
+        XCTAssertTrue(stored);
+        XCTAssertTrue([NSThread isMainThread]);
+        [done fulfill];
+    }];
+    [self waitForExpectations: @[appended, done] timeout: 5];
+    XCTAssertEqualObjects([self storedKeys], @[@"1:4"]);
+
+    // Already stored, e.g. by the extension
+    XCTestExpectation *skipped = [self expectationWithDescription: @"skipped"];
+    [push storeIn: store completion: ^(BOOL stored) {
+        XCTAssertFalse(stored);
+        [skipped fulfill];
+    }];
+    [self waitForExpectations: @[skipped] timeout: 5];
+}
+
+@end
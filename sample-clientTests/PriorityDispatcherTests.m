@@ -0,0 +1,178 @@
+#import <XCTest/XCTest.h>
+#import <stdatomic.h>
+
+#import "PriorityDispatcher.h"
+#import "LoopbackClient.h"
+
+// Simulated render time of one message
+#define RENDER_TIME_USEC 100
+
+// Publish tick, and the messages published per tick to the visible room and to each busy room
+#define PUBLISH_TICK 0.01
+#define BUSY_ROOMS 10
+#define BUSY_PER_TICK 20
+
+static NSString *VISIBLE_ROOM = @"/room/visible";
+
+// Render the messages received and keep the latency of those of the visible room.
+@interface RenderListener : NSObject <MigratoryDataListener> {
+    NSMutableData *latencies;
+    XCTestExpectation *connected;
+    atomic_int inside;
+    atomic_int maxInside;
+}
+- (id) initWithConnectedExpectation: (XCTestExpectation *)expectation;
+- (NSData *) sortedLatencies;
+- (int) maxConcurrentCalls;
+@end
+
+@implementation RenderListener
+
+- (id) initWithConnectedExpectation: (XCTestExpectation *)expectation {
+
+    self = [super init];
+    if (self != nil) {
+        latencies = [NSMutableData new];
+        connected = [expectation retain];
+    }
+
+    return self;
+}
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    int now = atomic_fetch_add(&inside, 1) + 1;
+    int max = atomic_load(&maxInside);
+    while (now > max && !atomic_compare_exchange_weak(&maxInside, &max, now)) {
+    }
+
+    if ([[message getSubject] isEqualToString: VISIBLE_ROOM] && [message getMessageType] == UPDATE) {
+        NSTimeInterval latency = [NSDate timeIntervalSinceReferenceDate] - [[message getContent] doubleValue];
+        @synchronized (self) {
+            [latencies appendBytes: &latency length: sizeof(double)];
+        }
+    }
+    usleep(RENDER_TIME_USEC);
+
+    atomic_fetch_sub(&inside, 1);
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+    if ([status isEqualToString: NOTIFY_SERVER_UP]) {
+        @synchronized (self) {
+            [connected fulfill];
+            [connected release];
+            connected = nil;
+        }
+    }
+}
+
+static int CompareLatencies(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+- (NSData *) sortedLatencies {
+    @synchronized (self) {
+        NSMutableData *sorted = [[latencies mutableCopy] autorelease];
+        qsort([sorted mutableBytes], [sorted length] / sizeof(double), sizeof(double), CompareLatencies);
+        return sorted;
+    }
+}
+
+- (int) maxConcurrentCalls {
+    return atomic_load(&maxInside);
+}
+
+- (void) dealloc {
+    [connected release];
+    [latencies release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface PriorityDispatcherTests : XCTestCase
+@end
+
+@implementation PriorityDispatcherTests
+
+static NSTimeInterval Percentile(NSData *sorted, double percent) {
+    NSUInteger count = [sorted length] / sizeof(double);
+    if (count == 0) {
+        return 0;
+    }
+    NSUInteger rank = (NSUInteger)(percent / 100 * (count - 1) + 0.5);
+    return ((const double *)[sorted bytes])[MIN(rank, count - 1)];
+}
+
+// Publish to the visible room and to busy rooms for the given time, and return the render latencies of the visible
+// room; the busy rooms are held in the background when requested.
+- (NSData *) renderLatenciesWithBackgroundRooms: (BOOL)background duration: (NSTimeInterval)duration maxConcurrentCalls: (int *)maxCalls {
+    LoopbackServer *server = [[[LoopbackServer alloc] initWithMaxCachedMessages: 1000] autorelease];
+    LoopbackClient *client = [[[LoopbackClient alloc] initWithServer: server] autorelease];
+    XCTestExpectation *connected = [self expectationWithDescription: @"connected"];
+    RenderListener *renderer = [[[RenderListener alloc] initWithConnectedExpectation: connected] autorelease];
+    PriorityDispatcher *dispatcher = [[[PriorityDispatcher alloc] initWithListener: renderer flushInterval: 0.5] autorelease];
+
+    NSMutableArray *busyRooms = [NSMutableArray arrayWithCapacity: BUSY_ROOMS];
+    for (int i = 0; i < BUSY_ROOMS; i++) {
+        [busyRooms addObject: [NSString stringWithFormat: @"/room/busy-%d", i]];
+    }
+    if (background) {
+        [dispatcher setPriority: PRIORITY_BACKGROUND forSubjects: busyRooms];
+    }
+
+    [client setListener: dispatcher];
+    [client subscribe: [busyRooms arrayByAddingObject: VISIBLE_ROOM]];
+    [client connect];
+    [self waitForExpectations: @[connected] timeout: 10];
+
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate] + duration;
+    while ([NSDate timeIntervalSinceReferenceDate] < end) {
+        @autoreleasepool {
+            for (int i = 0; i < BUSY_PER_TICK; i++) {
+                NSString *room = [busyRooms objectAtIndex: arc4random_uniform(BUSY_ROOMS)];
+                MigratoryDataMessage *message = [[MigratoryDataMessage alloc] init: room content: @"{\"text\":\"busy\"}"];
+                [client publish: message];
+                [message release];
+            }
+            NSString *content = [NSString stringWithFormat: @"%.6f", [NSDate timeIntervalSinceReferenceDate]];
+            MigratoryDataMessage *message = [[MigratoryDataMessage alloc] init: VISIBLE_ROOM content: content];
+            [client publish: message];
+            [message release];
+        }
+        usleep(PUBLISH_TICK * USEC_PER_SEC);
+    }
+
+    // Let the messages in flight and the last background batch arrive
+    [NSThread sleepForTimeInterval: 1];
+    [client disconnect];
+
+    *maxCalls = [renderer maxConcurrentCalls];
+    return [renderer sortedLatencies];
+}
+
+// Return the 90th percentile of the render latency of the visible room.
+- (NSTimeInterval) renderLatencyWithBackgroundRooms: (BOOL)background {
+    int maxCalls = 0;
+    NSData *latencies = [self renderLatenciesWithBackgroundRooms: background duration: 5 maxConcurrentCalls: &maxCalls];
+
+    NSLog(@"%@ busy rooms: %lu visible messages rendered, latency p50 %.1fms p90 %.1fms p99 %.1fms",
+        background ? @"background" : @"foreground", (unsigned long)([latencies length] / sizeof(double)),
+        Percentile(latencies, 50) * 1000, Percentile(latencies, 90) * 1000, Percentile(latencies, 99) * 1000);
+
+    XCTAssertGreaterThan([latencies length], 0u);
+    XCTAssertEqual(maxCalls, 1);
+    return Percentile(latencies, 90);
+}
+
+- (void) testBackgroundRoomsLowerRenderLatency {
+    NSTimeInterval foreground = [self renderLatencyWithBackgroundRooms: NO];
+    NSTimeInterval background = [self renderLatencyWithBackgroundRooms: YES];
+
+    // Held in the background, the busy rooms no longer delay the messages of the visible room
+    XCTAssertLessThan(background, foreground);
+}
+
+@end
@@ -0,0 +1,218 @@
+#import <XCTest/XCTest.h>
+
+#import "PublishCoalescer.h"
+#import "LoopbackClient.h"
+
+static BOOL IsPublishStatus(NSString *status) {
+    return [status isEqualToString: NOTIFY_PUBLISH_OK] || [status isEqualToString: NOTIFY_PUBLISH_FAILED]
+        || [status isEqualToString: NOTIFY_PUBLISH_DENIED] || [status isEqualToString: NOTIFY_MESSAGE_SIZE_LIMIT_EXCEEDED];
+}
+
+// Record what reaches a listener: the contents of the messages, and the publish statuses keyed by closure.
+@interface PublishRecorder : NSObject <MigratoryDataListener> {
+    NSObject<MigratoryDataListener> *next;
+    NSMutableArray *contents;
+    NSMutableDictionary *statuses;
+    NSMutableArray *closures;
+}
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener;
+- (NSArray *) contents;
+- (NSDictionary *) statuses;
+- (NSArray *) closures;
+@end
+
+@implementation PublishRecorder
+
+- (id) initWithListener: (NSObject<MigratoryDataListener> *)aListener {
+
+    self = [super init];
+    if (self != nil) {
+        next = [aListener retain];
+        contents = [NSMutableArray new];
+        statuses = [NSMutableDictionary new];
+        closures = [NSMutableArray new];
+    }
+
+    return self;
+}
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    @synchronized (self) {
+        [contents addObject: [message getContent]];
+    }
+    [next onMessage: message];
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+    if (IsPublishStatus(status)) {
+        @synchronized (self) {
+            [statuses setObject: status forKey: info];
+            [closures addObject: info];
+        }
+    }
+    [next onStatus: status info: info];
+}
+
+- (NSArray *) contents {
+    @synchronized (self) {
+        return [[contents copy] autorelease];
+    }
+}
+
+- (NSDictionary *) statuses {
+    @synchronized (self) {
+        return [[statuses copy] autorelease];
+    }
+}
+
+- (NSArray *) closures {
+    @synchronized (self) {
+        return [[closures copy] autorelease];
+    }
+}
+
+- (void) dealloc {
+    [closures release];
+    [statuses release];
+    [contents release];
+    [next release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface PublishCoalescerTests : XCTestCase {
+    LoopbackServer *server;
+    LoopbackClient *client;
+    PublishRecorder *delivered;
+    PublishCoalescer *coalescer;
+    PublishRecorder *acks;
+}
+@end
+
+@implementation PublishCoalescerTests
+
+static BOOL WaitUntil(BOOL (^condition)(void), NSTimeInterval timeout) {
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate] + timeout;
+    while (!condition()) {
+        if ([NSDate timeIntervalSinceReferenceDate] > end) {
+            return NO;
+        }
+        [NSThread sleepForTimeInterval: 0.001];
+    }
+    return YES;
+}
+
+// The app sees what the coalescer delivers, the acknowledgments sent by the server are counted before it. The flush
+// delay is long, so that batches are only sent when the acknowledgment they wait for arrives.
+- (void) setUp {
+    [super setUp];
+
+    server = [[LoopbackServer alloc] initWithMaxCachedMessages: 1000];
+    client = [[LoopbackClient alloc] initWithServer: server];
+    delivered = [[PublishRecorder alloc] initWithListener: nil];
+    coalescer = [[PublishCoalescer alloc] initWithClient: client listener: delivered maxMessages: 32 maxDelay: 1.0];
+    acks = [[PublishRecorder alloc] initWithListener: coalescer];
+    [client setListener: acks];
+}
+
+- (void) tearDown {
+    [client disconnect];
+
+    [acks release];
+    [coalescer release];
+    [delivered release];
+    [client release];
+    [server release];
+
+    [super tearDown];
+}
+
+- (void) connect {
+    [client connect];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [client isConnected]; }, 10));
+}
+
+- (void) publish: (NSString *)content subject: (NSString *)subject qos: (MigratoryDataQoS)qos closure: (NSString *)closure {
+    MigratoryDataMessage *message = [[MigratoryDataMessage alloc] init: subject content: content closure: closure qos: qos retained: NO];
+    [coalescer publish: message];
+    [message release];
+}
+
+- (void) testAcknowledgmentsCoalesced {
+    const int count = 1000;
+    [self connect];
+
+    for (int i = 0; i < count; i++) {
+        [self publish: @"{\"text\":\"hello\"}" subject: @"/chat/a" qos: GUARANTEED closure: [NSString stringWithFormat: @"m-%d", i]];
+    }
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[delivered statuses] count] == count; }, 10));
+
+    NSUInteger frames = [[acks closures] count];
+    NSLog(@"%d publishes acknowledged with %lu status notifications", count, (unsigned long)frames);
+    XCTAssertLessThan(frames, (NSUInteger)count);
+    XCTAssertEqual(frames + [coalescer coalescedAckCount], (unsigned long long)count);
+
+    NSDictionary *statuses = [delivered statuses];
+    XCTAssertEqual([[delivered closures] count], (NSUInteger)count, @"each closure is reported once");
+    for (int i = 0; i < count; i++) {
+        XCTAssertEqualObjects([statuses objectForKey: [NSString stringWithFormat: @"m-%d", i]], NOTIFY_PUBLISH_OK);
+    }
+}
+
+- (void) testFirstMessagePublishedAtOnce {
+    [self connect];
+
+    [self publish: @"{\"text\":\"hello\"}" subject: @"/chat/a" qos: GUARANTEED closure: @"first"];
+
+    // Well before the flush delay, as no acknowledgment was pending
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[delivered statuses] objectForKey: @"first"] != nil; }, 0.5));
+    XCTAssertEqualObjects([[acks closures] lastObject], @"batch-1");
+}
+
+- (void) testOrderKeptWithStandardMessages {
+    [client subscribe: @[@"/chat/b"]];
+    [self connect];
+    // The subscription is sent to the server right after the connection is up
+    [NSThread sleepForTimeInterval: 0.1];
+
+    NSMutableArray *expected = [NSMutableArray array];
+    for (int i = 0; i < 200; i++) {
+        NSString *content = [NSString stringWithFormat: @"%d", i];
+        BOOL guaranteed = i % 3 != 0;
+        [self publish: content subject: @"/chat/b" qos: (guaranteed ? GUARANTEED : STANDARD)
+            closure: (guaranteed ? [NSString stringWithFormat: @"m-%d", i] : nil)];
+        [expected addObject: content];
+    }
+
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[delivered contents] count] == [expected count]; }, 10));
+    XCTAssertEqualObjects([delivered contents], expected);
+}
+
+- (void) testFailedBatchReportedForEachMessage {
+    // Not connected: the client fails the publish of each message with a closure
+    for (int i = 0; i < 100; i++) {
+        [self publish: @"{\"text\":\"hello\"}" subject: @"/chat/a" qos: GUARANTEED closure: [NSString stringWithFormat: @"m-%d", i]];
+    }
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[delivered statuses] count] == 100; }, 10));
+
+    for (NSString *status in [[delivered statuses] allValues]) {
+        XCTAssertEqualObjects(status, NOTIFY_PUBLISH_FAILED);
+    }
+}
+
+- (void) testLargeMessagePublishedAlone {
+    [self connect];
+    NSString *large = [@"" stringByPaddingToLength: 5000 withString: @"x" startingAtIndex: 0];
+
+    [self publish: @"{\"text\":\"hello\"}" subject: @"/chat/a" qos: GUARANTEED closure: @"small"];
+    [self publish: large subject: @"/chat/a" qos: GUARANTEED closure: @"large"];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[delivered statuses] count] == 2; }, 10));
+
+    // The large message is acknowledged under its own closure, not as part of a batch
+    XCTAssertTrue([[acks closures] containsObject: @"large"]);
+    XCTAssertEqualObjects([[delivered statuses] objectForKey: @"large"], NOTIFY_PUBLISH_OK);
+}
+
+@end
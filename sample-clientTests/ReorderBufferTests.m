@@ -0,0 +1,177 @@
+#import <XCTest/XCTest.h>
+
+#import "ReorderBuffer.h"
+#import "LoopbackClient.h"
+
+#define SUBJECT @"/chat/ordered"
+
+// Record the seqs delivered and the gaps reported.
+@interface OrderRecorder : NSObject <MigratoryDataListener> {
+    NSMutableArray *seqs;
+    NSMutableArray *gaps;
+}
+- (NSArray *) seqs;
+- (NSArray *) gaps;
+@end
+
+@implementation OrderRecorder
+
+- (id) init {
+
+    self = [super init];
+    if (self != nil) {
+        seqs = [NSMutableArray new];
+        gaps = [NSMutableArray new];
+    }
+
+    return self;
+}
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    @synchronized (self) {
+        [seqs addObject: [NSNumber numberWithInt: [message getSeq]]];
+    }
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+    if ([status isEqualToString: NOTIFY_SEQUENCE_GAP]) {
+        @synchronized (self) {
+            [gaps addObject: info];
+        }
+    }
+}
+
+- (NSArray *) seqs {
+    @synchronized (self) {
+        return [[seqs copy] autorelease];
+    }
+}
+
+- (NSArray *) gaps {
+    @synchronized (self) {
+        return [[gaps copy] autorelease];
+    }
+}
+
+- (void) dealloc {
+    [gaps release];
+    [seqs release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface ReorderBufferTests : XCTestCase {
+    LoopbackServer *server;
+    LoopbackClient *client;
+    OrderRecorder *recorder;
+    ReorderBuffer *reorder;
+}
+@end
+
+@implementation ReorderBufferTests
+
+static BOOL WaitUntil(BOOL (^condition)(void), NSTimeInterval timeout) {
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate] + timeout;
+    while (!condition()) {
+        if ([NSDate timeIntervalSinceReferenceDate] > end) {
+            return NO;
+        }
+        [NSThread sleepForTimeInterval: 0.001];
+    }
+    return YES;
+}
+
+static MigratoryDataMessage *Message(int seq, int epoch) {
+    return [[[MigratoryDataMessage alloc] init: SUBJECT content: [NSString stringWithFormat: @"%d", seq] closure: nil
+        retained: NO qos: GUARANTEED replySubject: nil messageType: UPDATE seq: seq epoch: epoch] autorelease];
+}
+
+// The messages are delivered by the client as if received from the server, in the order given.
+- (void) setUpWithGapTimeout: (NSTimeInterval)timeout maxHeld: (NSUInteger)held {
+    server = [[LoopbackServer alloc] initWithMaxCachedMessages: 100];
+    client = [[LoopbackClient alloc] initWithServer: server];
+    recorder = [OrderRecorder new];
+    reorder = [[ReorderBuffer alloc] initWithListener: recorder gapTimeout: timeout maxHeld: held];
+    [reorder setReorderingForSubjects: @[SUBJECT]];
+    [client setListener: reorder];
+    [client subscribe: @[SUBJECT]];
+
+    [client connect];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [client isConnected]; }, 10));
+}
+
+- (void) tearDown {
+    [client disconnect];
+
+    [reorder release];
+    [recorder release];
+    [client release];
+    [server release];
+
+    [super tearDown];
+}
+
+- (void) deliver: (NSArray *)seqs epoch: (int)epoch {
+    for (NSNumber *seq in seqs) {
+        [client deliver: Message([seq intValue], epoch) after: 0];
+    }
+}
+
+- (void) testDeliveredInSeqOrder {
+    [self setUpWithGapTimeout: 10 maxHeld: 100];
+
+    // Recovered and live messages interleaved
+    [self deliver: @[@1, @4, @2, @6, @3, @5] epoch: 1];
+
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[recorder seqs] count] == 6; }, 1));
+    XCTAssertEqualObjects([recorder seqs], (@[@1, @2, @3, @4, @5, @6]));
+    XCTAssertEqual([[recorder gaps] count], 0u);
+}
+
+- (void) testGapTimeout {
+    const NSTimeInterval timeout = 0.2;
+    [self setUpWithGapTimeout: timeout maxHeld: 100];
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    [self deliver: @[@1, @3, @4] epoch: 1];
+
+    // The messages after the gap are held until the timeout
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[recorder seqs] count] == 3; }, 10 * timeout));
+    XCTAssertGreaterThanOrEqual([NSDate timeIntervalSinceReferenceDate] - start, timeout * 0.9);
+    XCTAssertEqualObjects([recorder seqs], (@[@1, @3, @4]));
+    XCTAssertEqualObjects([recorder gaps], @[SUBJECT @" 2-2"]);
+
+    // The missing message arrives after its gap was reported
+    [self deliver: @[@2, @5] epoch: 1];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[recorder seqs] count] == 4; }, 1));
+    XCTAssertEqualObjects([[recorder seqs] lastObject], @5);
+    XCTAssertEqual([reorder lateDroppedCount], 1ull);
+}
+
+- (void) testMaxHeld {
+    [self setUpWithGapTimeout: 10 maxHeld: 5];
+
+    // Six messages held after the gap exceed the bound, the gap is skipped without waiting for the timeout
+    [self deliver: @[@1, @3, @4, @5, @6, @7, @8] epoch: 1];
+
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[recorder seqs] count] == 7; }, 1));
+    XCTAssertEqualObjects([recorder seqs], (@[@1, @3, @4, @5, @6, @7, @8]));
+    XCTAssertEqualObjects([recorder gaps], @[SUBJECT @" 2-2"]);
+}
+
+- (void) testOlderEpochDropped {
+    [self setUpWithGapTimeout: 10 maxHeld: 100];
+
+    [self deliver: @[@7, @8] epoch: 2];
+    [self deliver: @[@9] epoch: 1];
+    // A new epoch restarts the seqs, what is held of the previous one is handed over first
+    [self deliver: @[@1] epoch: 3];
+
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[recorder seqs] count] == 3; }, 1));
+    XCTAssertEqualObjects([recorder seqs], (@[@7, @8, @1]));
+    XCTAssertEqual([reorder lateDroppedCount], 1ull);
+}
+
+@end
@@ -0,0 +1,169 @@
+#import <XCTest/XCTest.h>
+
+#import "RequestReply.h"
+#import "LoopbackClient.h"
+
+static NSString *ECHO_SUBJECT = @"/echo";
+
+// Publish back the content of each request on its reply subject, as a responder which copies the request id.
+@interface EchoResponder : NSObject <MigratoryDataListener> {
+    MigratoryDataClient *client;
+}
+- (id) initWithClient: (MigratoryDataClient *)aClient;
+@end
+
+@implementation EchoResponder
+
+- (id) initWithClient: (MigratoryDataClient *)aClient {
+
+    self = [super init];
+    if (self != nil) {
+        // Not retained, the client retains its listener
+        client = aClient;
+    }
+
+    return self;
+}
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    NSString *replySubject = [message getReplySubject];
+    if ([message getMessageType] != UPDATE || replySubject == nil) {
+        return;
+    }
+
+    MigratoryDataMessage *reply = [[MigratoryDataMessage alloc] init: replySubject content: [message getContent]];
+    [client publish: reply];
+    [reply release];
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+}
+
+@end
+
+@interface RequestReplyTests : XCTestCase {
+    LoopbackServer *server;
+    LoopbackClient *echoClient;
+    EchoResponder *responder;
+    LoopbackClient *client;
+    SubscriptionCache *subscriptions;
+    RequestReply *requestReply;
+}
+@end
+
+@implementation RequestReplyTests
+
+static void WaitForConnection(LoopbackClient *client) {
+    NSTimeInterval timeout = [NSDate timeIntervalSinceReferenceDate] + 10;
+    while (![client isConnected] && [NSDate timeIntervalSinceReferenceDate] < timeout) {
+        [NSThread sleepForTimeInterval: 0.01];
+    }
+}
+
+- (void) setUp {
+    [super setUp];
+
+    server = [[LoopbackServer alloc] initWithMaxCachedMessages: 1000];
+
+    echoClient = [[LoopbackClient alloc] initWithServer: server];
+    responder = [[EchoResponder alloc] initWithClient: echoClient];
+    [echoClient setListener: responder];
+    [echoClient subscribe: [NSArray arrayWithObject: ECHO_SUBJECT]];
+    [echoClient connect];
+
+    client = [[LoopbackClient alloc] initWithServer: server];
+    subscriptions = [SubscriptionCache new];
+    [subscriptions setSubscriber: (NSObject<SubjectSubscriber> *)client];
+    [client setListener: subscriptions];
+    requestReply = [[RequestReply alloc] initWithClient: client subscriptions: subscriptions];
+    [client connect];
+
+    WaitForConnection(echoClient);
+    WaitForConnection(client);
+    // The subscription of the responder is sent to the server right after its connection is up
+    [NSThread sleepForTimeInterval: 0.1];
+}
+
+- (void) tearDown {
+    [requestReply close];
+    [client disconnect];
+    [echoClient disconnect];
+
+    [requestReply release];
+    [subscriptions release];
+    [client release];
+    [responder release];
+    [echoClient release];
+    [server release];
+
+    [super tearDown];
+}
+
+// Send the given number of requests at once, count their replies and errors, and return the time until all completed.
+- (NSTimeInterval) sendRequests: (NSUInteger)count subject: (NSString *)subject timeout: (NSTimeInterval)timeout replies: (NSUInteger *)replies errors: (NSUInteger *)errors {
+    XCTestExpectation *done = [self expectationWithDescription: @"requests completed"];
+    [done setExpectedFulfillmentCount: count];
+    __block NSUInteger replyCount = 0;
+    __block NSUInteger errorCount = 0;
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger i = 0; i < count; i++) {
+        @autoreleasepool {
+            MigratoryDataMessage *message = [[MigratoryDataMessage alloc] init: subject content: @"{\"text\":\"ping\"}"];
+            // Completions are called on the main queue, one at a time
+            [requestReply request: message timeout: timeout completion: ^(MigratoryDataMessage *reply, NSError *error) {
+                if (error == nil) {
+                    replyCount++;
+                } else {
+                    errorCount++;
+                }
+                [done fulfill];
+            }];
+            [message release];
+        }
+    }
+    [self waitForExpectations: @[done] timeout: timeout + 30];
+    NSTimeInterval elapsed = [NSDate timeIntervalSinceReferenceDate] - start;
+
+    *replies = replyCount;
+    *errors = errorCount;
+    return elapsed;
+}
+
+- (void) testEchoThroughput {
+    const NSUInteger count = 20000;
+    NSUInteger replies, errors;
+    NSTimeInterval elapsed = [self sendRequests: count subject: ECHO_SUBJECT timeout: 30 replies: &replies errors: &errors];
+
+    NSLog(@"%lu requests answered in %.3fs, %.0f requests/s", (unsigned long)replies, elapsed, replies / elapsed);
+    XCTAssertEqual(replies, count);
+    XCTAssertEqual(errors, 0u);
+    XCTAssertEqual([requestReply pendingCount], 0u);
+}
+
+- (void) testOutstandingRequestsTimeOut {
+    const NSUInteger count = 10000;
+    const NSTimeInterval timeout = 0.5;
+    NSUInteger replies, errors;
+    NSTimeInterval elapsed = [self sendRequests: count subject: @"/nobody" timeout: timeout replies: &replies errors: &errors];
+
+    NSLog(@"%lu outstanding requests expired in %.3fs for a %.1fs timeout", (unsigned long)errors, elapsed, timeout);
+    XCTAssertEqual(replies, 0u);
+    XCTAssertEqual(errors, count);
+    XCTAssertGreaterThanOrEqual(elapsed, timeout);
+    XCTAssertEqual([requestReply pendingCount], 0u);
+}
+
+- (void) testInvalidContent {
+    XCTestExpectation *done = [self expectationWithDescription: @"request completed"];
+    MigratoryDataMessage *message = [[[MigratoryDataMessage alloc] init: ECHO_SUBJECT content: @"ping"] autorelease];
+
+    [requestReply request: message timeout: 1 completion: ^(MigratoryDataMessage *reply, NSError *error) {
+        XCTAssertNil(reply);
+        XCTAssertEqual([error code], REQUEST_INVALID_CONTENT);
+        [done fulfill];
+    }];
+    [self waitForExpectations: @[done] timeout: 5];
+}
+
+@end
@@ -0,0 +1,151 @@
+#import <XCTest/XCTest.h>
+
+#import "RoomSummaryIndex.h"
+
+static NSString *ROOM = @"/rooms/a";
+
+@interface RoomSummaryIndexTests : XCTestCase {
+    NSString *directory;
+    MessageStore *store;
+    MessageStoreListener *storeListener;
+    RoomSummaryIndex *index;
+}
+@end
+
+@implementation RoomSummaryIndexTests
+
+static BOOL WaitUntil(BOOL (^condition)(void), NSTimeInterval timeout) {
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate] + timeout;
+    while (!condition()) {
+        if ([NSDate timeIntervalSinceReferenceDate] > end) {
+            return NO;
+        }
+        [NSThread sleepForTimeInterval: 0.001];
+    }
+    return YES;
+}
+
+static MigratoryDataMessage *Message(NSString *subject, int seq, MigratoryDataMessageType type) {
+    NSString *content = [NSString stringWithFormat: @"{\"user\":\"alice\",\"text\":\"message %d\"}", seq];
+    return [[[MigratoryDataMessage alloc] init: subject content: content closure: nil retained: NO qos: GUARANTEED
+        replySubject: nil messageType: type seq: seq epoch: 1] autorelease];
+}
+
+- (void) setUp {
+    [super setUp];
+
+    directory = [[NSTemporaryDirectory() stringByAppendingPathComponent: [[NSUUID UUID] UUIDString]] retain];
+    store = [[MessageStore alloc] initWithDirectory: directory];
+    storeListener = [[MessageStoreListener alloc] initWithListener: nil store: store];
+    [storeListener setStoredSubjects: @[ROOM]];
+    index = [[RoomSummaryIndex alloc] initWithStore: store];
+    [index setSummarizedSubjects: @[ROOM]];
+}
+
+- (void) tearDown {
+    [index release];
+    [storeListener release];
+    [store release];
+    [[NSFileManager defaultManager] removeItemAtPath: directory error: nil];
+    [directory release];
+
+    [super tearDown];
+}
+
+- (NSUInteger) unread {
+    return [[index summaryForSubject: ROOM] unreadCount];
+}
+
+// Wait until the room has the given unread count, and for longer to see it does not change.
+- (void) assertUnread: (NSUInteger)expected {
+    XCTAssertTrue(WaitUntil(^BOOL{ return [self unread] == expected; }, 5));
+    [NSThread sleepForTimeInterval: 0.2];
+    XCTAssertEqual([self unread], expected);
+}
+
+- (void) testUnreadCounts {
+    for (int seq = 1; seq <= 5; seq++) {
+        [storeListener onMessage: Message(ROOM, seq, UPDATE)];
+    }
+    [self assertUnread: 5];
+    XCTAssertEqualObjects([[index summaryForSubject: ROOM] preview], @"alice: message 5");
+    XCTAssertEqual([[index summaryForSubject: ROOM] lastSeq], 5);
+
+    [index markReadSubject: ROOM];
+    [self assertUnread: 0];
+
+    // Historical messages are not stored, nor counted
+    [storeListener onMessage: Message(ROOM, 6, UPDATE)];
+    [storeListener onMessage: Message(ROOM, 7, HISTORICAL)];
+    [self assertUnread: 1];
+}
+
+- (void) testOnlySummarizedSubjects {
+    [storeListener setStoredSubjects: @[@"/rooms/b"]];
+    [storeListener onMessage: Message(@"/rooms/b", 1, UPDATE)];
+    [storeListener onMessage: Message(ROOM, 1, UPDATE)];
+    [self assertUnread: 1];
+
+    XCTAssertNil([index summaryForSubject: @"/rooms/b"]);
+    XCTAssertEqual([[index summaries] count], 1u);
+}
+
+- (void) testSnapshotOfKnownRoomNotCounted {
+    [storeListener onMessage: Message(ROOM, 1, SNAPSHOT)];
+    [storeListener onMessage: Message(ROOM, 2, UPDATE)];
+    [self assertUnread: 2];
+
+    // The snapshot sent again on a resubscribe is already stored
+    [storeListener onMessage: Message(ROOM, 2, SNAPSHOT)];
+    [storeListener onMessage: Message(ROOM, 2, RECOVERED)];
+    [self assertUnread: 2];
+}
+
+- (void) testMessagesStoredElsewhereCounted {
+    // Pushes stored by the app while it runs, in order and before a message already counted
+    [storeListener onMessage: Message(ROOM, 2, UPDATE)];
+    [self assertUnread: 1];
+    [index markReadSubject: ROOM];
+    [self assertUnread: 0];
+
+    XCTAssertTrue([store appendContent: @"{\"text\":\"pushed\"}" subject: ROOM seq: 3 epoch: 1]);
+    [[NSNotificationCenter defaultCenter] postNotificationName: MESSAGE_STORE_DID_APPEND object: store
+        userInfo: @{MESSAGE_STORE_SUBJECT: ROOM, MESSAGE_STORE_FIRST_INDEX: @1}];
+    [self assertUnread: 1];
+
+    // Read before the last message read, not unread
+    XCTAssertTrue([store appendContent: @"{\"text\":\"late\"}" subject: ROOM seq: 1 epoch: 1]);
+    [[NSNotificationCenter defaultCenter] postNotificationName: MESSAGE_STORE_DID_APPEND object: store
+        userInfo: @{MESSAGE_STORE_SUBJECT: ROOM, MESSAGE_STORE_FIRST_INDEX: @0}];
+    [self assertUnread: 1];
+
+    // Stored by the extension while the app was suspended, without a notification, then a live message
+    XCTAssertTrue([store appendContent: @"{\"text\":\"extension\"}" subject: ROOM seq: 4 epoch: 1]);
+    XCTAssertTrue([store appendContent: @"{\"text\":\"extension\"}" subject: ROOM seq: 5 epoch: 1]);
+    [storeListener onMessage: Message(ROOM, 6, UPDATE)];
+    [self assertUnread: 4];
+
+    [index refresh];
+    [self assertUnread: 4];
+    XCTAssertEqual([[index summaryForSubject: ROOM] lastSeq], 6);
+}
+
+- (void) testSummariesSavedAndReconciled {
+    for (int seq = 1; seq <= 3; seq++) {
+        [storeListener onMessage: Message(ROOM, seq, UPDATE)];
+    }
+    [self assertUnread: 3];
+    [index markReadSubject: ROOM];
+    [self assertUnread: 0];
+    [index save];
+
+    // Stored while no index was running
+    XCTAssertTrue([store appendContent: @"{\"text\":\"extension\"}" subject: ROOM seq: 4 epoch: 1]);
+
+    RoomSummaryIndex *loaded = [[[RoomSummaryIndex alloc] initWithStore: store] autorelease];
+    [loaded setSummarizedSubjects: @[ROOM]];
+    XCTAssertEqual([[loaded summaryForSubject: ROOM] unreadCount], 1u);
+    XCTAssertEqual([[loaded summaryForSubject: ROOM] lastSeq], 4);
+}
+
+@end
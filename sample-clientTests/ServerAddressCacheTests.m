@@ -0,0 +1,138 @@
+#import <XCTest/XCTest.h>
+
+#import "ServerAddressCache.h"
+
+// Latency injected by the stub resolver
+#define STUB_LATENCY 0.2
+
+@interface ServerAddressCacheTests : XCTestCase {
+    NSMutableDictionary *records;
+    NSUInteger lookups;
+}
+@end
+
+@implementation ServerAddressCacheTests
+
+- (void) setUp {
+    [super setUp];
+
+    records = [[NSMutableDictionary alloc] initWithDictionary: @{
+        @"a.example.com": @[@"192.0.2.1"],
+        @"b.example.com": @[@"192.0.2.2"],
+        @"c.example.com": @[@"192.0.2.3", @"2001:db8::3"],
+        @"d.example.com": @[@"192.0.2.4"],
+        @"e.example.com": @[@"192.0.2.5"]
+    }];
+    lookups = 0;
+}
+
+- (void) tearDown {
+    [records release];
+    records = nil;
+
+    [super tearDown];
+}
+
+// A resolver which answers from the records after the stub latency, or fails for an unknown host.
+- (HostResolver) stubResolver {
+    return [[^NSArray *(NSString *host) {
+        [NSThread sleepForTimeInterval: STUB_LATENCY];
+        @synchronized (self) {
+            lookups++;
+            return [[[records objectForKey: host] retain] autorelease];
+        }
+    } copy] autorelease];
+}
+
+// Poll the cache until every host has addresses, and return the time it took.
+- (NSTimeInterval) waitForHosts: (NSArray *)hosts inCache: (ServerAddressCache *)cache {
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    NSTimeInterval timeout = start + 10 * STUB_LATENCY * [hosts count];
+
+    while ([NSDate timeIntervalSinceReferenceDate] < timeout) {
+        BOOL resolved = YES;
+        for (NSString *host in hosts) {
+            resolved = resolved && [cache addressesForHost: host] != nil;
+        }
+        if (resolved) {
+            break;
+        }
+        [NSThread sleepForTimeInterval: 0.005];
+    }
+
+    return [NSDate timeIntervalSinceReferenceDate] - start;
+}
+
+- (void) testPrefetchResolvesInParallel {
+    ServerAddressCache *cache = [[[ServerAddressCache alloc] initWithTTL: 60 resolver: [self stubResolver]] autorelease];
+    NSArray *servers = @[@"a.example.com:8800", @"b.example.com:8800", @"c.example.com:8800", @"d.example.com:8800", @"e.example.com:8800"];
+    NSArray *hosts = @[@"a.example.com", @"b.example.com", @"c.example.com", @"d.example.com", @"e.example.com"];
+
+    [cache prefetchServers: servers];
+    NSTimeInterval elapsed = [self waitForHosts: hosts inCache: cache];
+
+    NSLog(@"%lu hosts prefetched in %.1fms, %.1fms per lookup", (unsigned long)[hosts count], elapsed * 1000, STUB_LATENCY * 1000);
+    XCTAssertLessThan(elapsed, 2 * STUB_LATENCY);
+    XCTAssertEqual(lookups, [hosts count]);
+}
+
+- (void) testCachedLookupLatency {
+    ServerAddressCache *cache = [[[ServerAddressCache alloc] initWithTTL: 60 resolver: [self stubResolver]] autorelease];
+    [cache prefetchServers: @[@"a.example.com:443"]];
+    [self waitForHosts: @[@"a.example.com"] inCache: cache];
+
+    // What a reconnect pays for the name resolution once the cache is warm
+    const int count = 100000;
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    for (int i = 0; i < count; i++) {
+        @autoreleasepool {
+            [cache resolvedServers: @[@"a.example.com:443"]];
+        }
+    }
+    NSTimeInterval perLookup = ([NSDate timeIntervalSinceReferenceDate] - start) / count;
+
+    NSLog(@"cached lookup %.2fus, stub resolver %.1fms", perLookup * 1e6, STUB_LATENCY * 1000);
+    XCTAssertLessThan(perLookup, STUB_LATENCY / 100);
+    XCTAssertEqual(lookups, 1u);
+}
+
+- (void) testStaleAddressesKeptWhileRefreshFails {
+    ServerAddressCache *cache = [[[ServerAddressCache alloc] initWithTTL: 0.1 resolver: [self stubResolver]] autorelease];
+    [cache prefetchServers: @[@"a.example.com"]];
+    [self waitForHosts: @[@"a.example.com"] inCache: cache];
+
+    // The host can no longer be resolved, as during a failover
+    @synchronized (self) {
+        [records removeObjectForKey: @"a.example.com"];
+    }
+    [NSThread sleepForTimeInterval: 0.2];
+
+    XCTAssertEqualObjects([cache addressesForHost: @"a.example.com"], @[@"192.0.2.1"]);
+    [NSThread sleepForTimeInterval: 2 * STUB_LATENCY];
+    XCTAssertEqualObjects([cache addressesForHost: @"a.example.com"], @[@"192.0.2.1"]);
+    XCTAssertGreaterThanOrEqual(lookups, 2u);
+}
+
+- (void) testHostNeverResolved {
+    ServerAddressCache *cache = [[[ServerAddressCache alloc] initWithTTL: 60 resolver: [self stubResolver]] autorelease];
+
+    XCTAssertNil([cache addressesForHost: @"a.example.com"]);
+    XCTAssertEqualObjects([cache resolvedServers: @[@"a.example.com:8800"]], @[@"a.example.com:8800"]);
+
+    // The lookup started by the miss fills the cache
+    [self waitForHosts: @[@"a.example.com"] inCache: cache];
+    XCTAssertEqualObjects([cache addressesForHost: @"a.example.com"], @[@"192.0.2.1"]);
+}
+
+- (void) testResolvedServersKeepPortsAndShareWeights {
+    ServerAddressCache *cache = [[[ServerAddressCache alloc] initWithTTL: 60 resolver: [self stubResolver]] autorelease];
+    [cache prefetchServers: @[@"80 c.example.com:8800"]];
+    [self waitForHosts: @[@"c.example.com"] inCache: cache];
+
+    NSArray *resolved = [cache resolvedServers: @[@"80 c.example.com:8800", @"unknown.example.com:8800"]];
+
+    NSArray *expected = @[@"40 192.0.2.3:8800", @"40 [2001:db8::3]:8800", @"unknown.example.com:8800"];
+    XCTAssertEqualObjects(resolved, expected);
+}
+
+@end
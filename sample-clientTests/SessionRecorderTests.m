@@ -0,0 +1,165 @@
+#import <XCTest/XCTest.h>
+
+#import "SessionRecorder.h"
+#import "SessionReplayer.h"
+
+// Keep the messages and statuses received, in order.
+@interface TraceCollector : NSObject <MigratoryDataListener> {
+@public
+    NSMutableArray *messages;
+    NSMutableArray *statuses;
+    NSMutableArray *times;
+}
+@end
+
+@implementation TraceCollector
+
+- (id) init {
+
+    self = [super init];
+    if (self != nil) {
+        messages = [NSMutableArray new];
+        statuses = [NSMutableArray new];
+        times = [NSMutableArray new];
+    }
+
+    return self;
+}
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    [messages addObject: message];
+    [times addObject: [NSNumber numberWithDouble: [NSDate timeIntervalSinceReferenceDate]]];
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+    [statuses addObject: @[status, info != nil ? info : @""]];
+}
+
+- (void) dealloc {
+    [times release];
+    [statuses release];
+    [messages release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface SessionRecorderTests : XCTestCase {
+    NSString *path;
+}
+@end
+
+@implementation SessionRecorderTests
+
+- (void) setUp {
+    [super setUp];
+
+    NSString *directory = [NSTemporaryDirectory() stringByAppendingPathComponent: [[NSUUID UUID] UUIDString]];
+    [[NSFileManager defaultManager] createDirectoryAtPath: directory withIntermediateDirectories: YES attributes: nil error: nil];
+    path = [[directory stringByAppendingPathComponent: @"session"] retain];
+}
+
+- (void) tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath: [path stringByDeletingLastPathComponent] error: nil];
+    [path release];
+
+    [super tearDown];
+}
+
+static MigratoryDataMessage *Message(NSString *subject, NSString *content, int seq, NSString *closure) {
+    return [[[MigratoryDataMessage alloc] init: subject content: content closure: closure retained: (seq % 2 == 0)
+        qos: GUARANTEED replySubject: nil messageType: UPDATE seq: seq epoch: 7] autorelease];
+}
+
+// Play the trace back into a new collector, waiting for the replay to complete.
+- (TraceCollector *) replay: (NSArray *)files speed: (ReplaySpeed)speed records: (NSUInteger *)records {
+    TraceCollector *collector = [[TraceCollector new] autorelease];
+    SessionReplayer *replayer = [[[SessionReplayer alloc] initWithListener: collector] autorelease];
+    XCTestExpectation *done = [self expectationWithDescription: @"replayed"];
+    __block NSUInteger replayed = 0;
+
+    [replayer replayFiles: files speed: speed completion: ^(NSUInteger count, NSTimeInterval elapsed) {
+        replayed = count;
+        [done fulfill];
+    }];
+    [self waitForExpectations: @[done] timeout: 10];
+
+    *records = replayed;
+    return collector;
+}
+
+- (void) testRecordAndReplay {
+    TraceCollector *live = [[TraceCollector new] autorelease];
+    SessionRecorder *recorder = [[[SessionRecorder alloc] initWithListener: live path: path maxFileSize: 0 maxFiles: 4] autorelease];
+
+    // Not recorded, but still forwarded
+    [recorder onMessage: Message(@"/chat/a", @"before", 1, nil)];
+
+    [recorder startRecording];
+    [recorder onStatus: NOTIFY_SERVER_UP info: @"192.0.2.1:8800"];
+    for (int i = 0; i < 100; i++) {
+        [recorder onMessage: Message(i % 3 == 0 ? @"/chat/b" : @"/chat/a", [NSString stringWithFormat: @"{\"n\":%d,\"text\":\"Zoë\"}", i],
+            i, i % 5 == 0 ? @"c" : nil)];
+    }
+    [recorder onStatus: NOTIFY_SERVER_DOWN info: nil];
+    [recorder stopRecording];
+
+    XCTAssertEqual([live->messages count], 101u);
+    XCTAssertEqual([[recorder traceFiles] count], 1u);
+
+    NSUInteger records;
+    TraceCollector *replayed = [self replay: [recorder traceFiles] speed: REPLAY_MAXIMUM records: &records];
+    XCTAssertEqual(records, 102u);
+    XCTAssertEqualObjects(replayed->statuses, (@[@[NOTIFY_SERVER_UP, @"192.0.2.1:8800"], @[NOTIFY_SERVER_DOWN, @""]]));
+    XCTAssertEqual([replayed->messages count], 100u);
+
+    for (NSUInteger i = 0; i < [replayed->messages count]; i++) {
+        MigratoryDataMessage *expected = [live->messages objectAtIndex: i + 1];
+        MigratoryDataMessage *message = [replayed->messages objectAtIndex: i];
+        XCTAssertEqualObjects([message getSubject], [expected getSubject]);
+        XCTAssertEqualObjects([message getContent], [expected getContent]);
+        XCTAssertEqualObjects([message getClosure], [expected getClosure]);
+        XCTAssertEqual([message getSeq], [expected getSeq]);
+        XCTAssertEqual([message getEpoch], [expected getEpoch]);
+        XCTAssertEqual([message isRetained], [expected isRetained]);
+        XCTAssertEqual([message getQos], [expected getQos]);
+        XCTAssertEqual([message getMessageType], [expected getMessageType]);
+    }
+}
+
+- (void) testReplayKeepsRecordedSpacing {
+    SessionRecorder *recorder = [[[SessionRecorder alloc] initWithListener: nil path: path maxFileSize: 0 maxFiles: 4] autorelease];
+    [recorder startRecording];
+    [recorder onMessage: Message(@"/chat/a", @"first", 1, nil)];
+    [NSThread sleepForTimeInterval: 0.3];
+    [recorder onMessage: Message(@"/chat/a", @"second", 2, nil)];
+    [recorder stopRecording];
+
+    NSUInteger records;
+    TraceCollector *replayed = [self replay: [recorder traceFiles] speed: REPLAY_RECORDED records: &records];
+    XCTAssertEqual(records, 2u);
+    NSTimeInterval gap = [[replayed->times objectAtIndex: 1] doubleValue] - [[replayed->times objectAtIndex: 0] doubleValue];
+    XCTAssertEqualWithAccuracy(gap, 0.3, 0.1);
+}
+
+- (void) testTruncatedTraceReplaysCompleteRecords {
+    SessionRecorder *recorder = [[[SessionRecorder alloc] initWithListener: nil path: path maxFileSize: 0 maxFiles: 4] autorelease];
+    [recorder startRecording];
+    for (int i = 0; i < 10; i++) {
+        [recorder onMessage: Message(@"/chat/a", @"{\"text\":\"hello\"}", i, nil)];
+    }
+    [recorder stopRecording];
+
+    // Cut the last record short, as a crash while writing would
+    NSString *file = [[recorder traceFiles] lastObject];
+    NSData *data = [NSData dataWithContentsOfFile: file];
+    [[data subdataWithRange: NSMakeRange(0, [data length] - 3)] writeToFile: file atomically: YES];
+
+    NSUInteger records;
+    TraceCollector *replayed = [self replay: @[file] speed: REPLAY_MAXIMUM records: &records];
+    XCTAssertEqual(records, 9u);
+    XCTAssertEqual([replayed->messages count], 9u);
+}
+
+@end
@@ -0,0 +1,178 @@
+#import <XCTest/XCTest.h>
+#import <stdatomic.h>
+
+#import "ShardedClient.h"
+#import "LoopbackClient.h"
+
+#define SUBJECT_COUNT 1000
+#define ROUNDS 100
+#define PUBLISHERS 8
+
+// Decode the messages received, and check that the messages of each subject are delivered in order.
+@interface DecodeListener : NSObject <MigratoryDataListener> {
+    int lastSent[SUBJECT_COUNT];
+    atomic_long received;
+    atomic_long outOfOrder;
+    atomic_long connected;
+}
+- (long) receivedCount;
+- (long) outOfOrderCount;
+- (long) connectedCount;
+@end
+
+@implementation DecodeListener
+
+- (id) init {
+
+    self = [super init];
+    if (self != nil) {
+        for (int i = 0; i < SUBJECT_COUNT; i++) {
+            lastSent[i] = -1;
+        }
+    }
+
+    return self;
+}
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+    if ([message getMessageType] != UPDATE) {
+        return;
+    }
+
+    @autoreleasepool {
+        NSData *data = [[message getContent] dataUsingEncoding: NSUTF8StringEncoding];
+        NSDictionary *fields = [NSJSONSerialization JSONObjectWithData: data options: 0 error: nil];
+        int subject = [[fields objectForKey: @"subject"] intValue];
+        int sent = [[fields objectForKey: @"n"] intValue];
+
+        // A subject is always delivered by the same connection, so its entry is only touched by one thread
+        if (sent <= lastSent[subject]) {
+            atomic_fetch_add(&outOfOrder, 1);
+        }
+        lastSent[subject] = sent;
+    }
+    atomic_fetch_add(&received, 1);
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+    if ([status isEqualToString: NOTIFY_SERVER_UP]) {
+        atomic_fetch_add(&connected, 1);
+    }
+}
+
+- (long) receivedCount {
+    return atomic_load(&received);
+}
+
+- (long) outOfOrderCount {
+    return atomic_load(&outOfOrder);
+}
+
+- (long) connectedCount {
+    return atomic_load(&connected);
+}
+
+@end
+
+@interface ShardedClientTests : XCTestCase
+@end
+
+@implementation ShardedClientTests
+
+static BOOL WaitUntil(BOOL (^condition)(void), NSTimeInterval timeout) {
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate] + timeout;
+    while (!condition()) {
+        if ([NSDate timeIntervalSinceReferenceDate] > end) {
+            return NO;
+        }
+        [NSThread sleepForTimeInterval: 0.001];
+    }
+    return YES;
+}
+
+// Publish ROUNDS messages to each subject over the given number of shards, each connected to its own loopback server,
+// and return the number of messages decoded per second.
+- (double) throughputWithShards: (NSUInteger)count {
+    NSMutableArray *servers = [NSMutableArray arrayWithCapacity: count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [servers addObject: [[[LoopbackServer alloc] initWithMaxCachedMessages: 1] autorelease]];
+    }
+    ShardedClient *client = [[[ShardedClient alloc] initWithShards: count clientFactory: ^MigratoryDataClient *(NSUInteger shard) {
+        return [[[LoopbackClient alloc] initWithServer: [servers objectAtIndex: shard]] autorelease];
+    }] autorelease];
+    DecodeListener *listener = [[DecodeListener new] autorelease];
+
+    NSMutableArray *subjects = [NSMutableArray arrayWithCapacity: SUBJECT_COUNT];
+    for (int i = 0; i < SUBJECT_COUNT; i++) {
+        [subjects addObject: [NSString stringWithFormat: @"/dashboard/%d", i]];
+    }
+
+    [client setListener: listener];
+    [client subscribe: subjects];
+    [client connect];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [listener connectedCount] == (long)count; }, 10));
+    // The subscriptions are sent to the servers right after the connections are up
+    [NSThread sleepForTimeInterval: 0.1];
+
+    // Each subject is published by one publisher, so its messages are sent in order
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    dispatch_apply(PUBLISHERS, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t publisher) {
+        for (int n = 0; n < ROUNDS; n++) {
+            @autoreleasepool {
+                for (int i = (int)publisher; i < SUBJECT_COUNT; i += PUBLISHERS) {
+                    NSString *content = [NSString stringWithFormat: @"{\"subject\":%d,\"n\":%d,\"value\":%f,\"unit\":\"ms\",\"status\":\"ok\"}",
+                        i, n, n * 0.5];
+                    MigratoryDataMessage *message = [[MigratoryDataMessage alloc] init: [subjects objectAtIndex: i] content: content];
+                    [client publish: message];
+                    [message release];
+                }
+            }
+        }
+    });
+    long expected = (long)SUBJECT_COUNT * ROUNDS;
+    XCTAssertTrue(WaitUntil(^BOOL{ return [listener receivedCount] >= expected; }, 60));
+    NSTimeInterval elapsed = [NSDate timeIntervalSinceReferenceDate] - start;
+
+    [client disconnect];
+
+    XCTAssertEqual([listener receivedCount], expected);
+    XCTAssertEqual([listener outOfOrderCount], 0);
+    return [listener receivedCount] / elapsed;
+}
+
+- (void) testThroughputScaling {
+    double base = 0;
+
+    for (NSUInteger shards = 1; shards <= 8; shards *= 2) {
+        double throughput = [self throughputWithShards: shards];
+        if (shards == 1) {
+            base = throughput;
+        }
+        NSLog(@"%lu shards: %.0f msg/s, %.2fx, %lu cores", (unsigned long)shards, throughput, throughput / base,
+            (unsigned long)[[NSProcessInfo processInfo] activeProcessorCount]);
+    }
+}
+
+- (void) testShardMappingIsStable {
+    ShardedClient *four = [[[ShardedClient alloc] initWithShards: 4] autorelease];
+    ShardedClient *five = [[[ShardedClient alloc] initWithShards: 5] autorelease];
+    int moved = 0;
+
+    for (int i = 0; i < SUBJECT_COUNT; i++) {
+        NSString *subject = [NSString stringWithFormat: @"/dashboard/%d", i];
+        NSUInteger shard = [four shardForSubject: subject];
+        XCTAssertEqual([four shardForSubject: subject], shard);
+
+        // Adding a shard only moves subjects to the new shard
+        NSUInteger newShard = [five shardForSubject: subject];
+        if (newShard != shard) {
+            XCTAssertEqual(newShard, 4u);
+            moved++;
+        }
+    }
+
+    XCTAssertGreaterThan(moved, 0);
+    XCTAssertLessThan(moved, SUBJECT_COUNT / 2);
+}
+
+@end
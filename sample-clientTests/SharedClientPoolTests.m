@@ -0,0 +1,111 @@
+#import <XCTest/XCTest.h>
+
+#import "SharedClientPool.h"
+#import "LoopbackClient.h"
+
+// Keep the statuses received, as "status info".
+@interface StatusRecorder : NSObject <MigratoryDataListener> {
+    NSMutableArray *statuses;
+}
+- (NSArray *) statuses;
+@end
+
+@implementation StatusRecorder
+
+- (id) init {
+
+    self = [super init];
+    if (self != nil) {
+        statuses = [NSMutableArray new];
+    }
+
+    return self;
+}
+
+- (void) onMessage: (MigratoryDataMessage *)message {
+}
+
+- (void) onStatus: (NSString *)status info: (NSString *)info {
+    @synchronized (self) {
+        [statuses addObject: [NSString stringWithFormat: @"%@ %@", status, info]];
+    }
+}
+
+- (NSArray *) statuses {
+    @synchronized (self) {
+        return [[statuses copy] autorelease];
+    }
+}
+
+- (void) dealloc {
+    [statuses release];
+
+    [super dealloc];
+}
+
+@end
+
+@interface SharedClientPoolTests : XCTestCase
+@end
+
+@implementation SharedClientPoolTests
+
+static BOOL WaitUntil(BOOL (^condition)(void), NSTimeInterval timeout) {
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate] + timeout;
+    while (!condition()) {
+        if ([NSDate timeIntervalSinceReferenceDate] > end) {
+            return NO;
+        }
+        [NSThread sleepForTimeInterval: 0.001];
+    }
+    return YES;
+}
+
+- (void) testStatusesRouted {
+    LoopbackServer *server = [[[LoopbackServer alloc] initWithMaxCachedMessages: 100] autorelease];
+    SharedClientPool *pool = [[[SharedClientPool alloc] initWithClientFactory: ^MigratoryDataClient *(void) {
+        return [[[LoopbackClient alloc] initWithServer: server] autorelease];
+    }] autorelease];
+
+    PooledClient *chat = [pool clientForServers: @[@"loopback"] encryption: NO token: nil];
+    PooledClient *presence = [pool clientForServers: @[@"loopback"] encryption: NO token: nil];
+    StatusRecorder *chatStatuses = [[StatusRecorder new] autorelease];
+    StatusRecorder *presenceStatuses = [[StatusRecorder new] autorelease];
+    [chat setListener: chatStatuses];
+    [presence setListener: presenceStatuses];
+    [chat subscribe: @[@"/chat/a"]];
+    [NSThread sleepForTimeInterval: 0.2];
+
+    // The connection statuses reach the logical client without subscriptions as well
+    [server injectDisconnect: 0.1];
+    NSString *up = [NSString stringWithFormat: @"%@ loopback", NOTIFY_SERVER_UP];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[presenceStatuses statuses] containsObject: up]; }, 5));
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[chatStatuses statuses] containsObject: up]; }, 5));
+    XCTAssertTrue([[presenceStatuses statuses] containsObject: [NSString stringWithFormat: @"%@ loopback", NOTIFY_SERVER_DOWN]]);
+
+    // The statuses of a subject reach its subscribers only
+    NSString *sync = [NSString stringWithFormat: @"%@ /chat/a", NOTIFY_DATA_SYNC];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[chatStatuses statuses] containsObject: sync]; }, 5));
+    XCTAssertFalse([[presenceStatuses statuses] containsObject: sync]);
+
+    // The publish statuses reach the publisher only
+    [chat publish: [[[MigratoryDataMessage alloc] init: @"/chat/a" content: @"hello" closure: @"chat-1"] autorelease]];
+    [presence publish: [[[MigratoryDataMessage alloc] init: @"/presence" content: @"online" closure: @"presence-1"] autorelease]];
+    NSString *chatOk = [NSString stringWithFormat: @"%@ chat-1", NOTIFY_PUBLISH_OK];
+    NSString *presenceOk = [NSString stringWithFormat: @"%@ presence-1", NOTIFY_PUBLISH_OK];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[chatStatuses statuses] containsObject: chatOk]; }, 5));
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[presenceStatuses statuses] containsObject: presenceOk]; }, 5));
+    XCTAssertFalse([[chatStatuses statuses] containsObject: presenceOk]);
+    XCTAssertFalse([[presenceStatuses statuses] containsObject: chatOk]);
+
+    // Disposed, a logical client receives nothing more
+    [presence dispose];
+    NSUInteger count = [[presenceStatuses statuses] count];
+    [server injectDisconnect: 0.1];
+    XCTAssertTrue(WaitUntil(^BOOL{ return [[[chatStatuses statuses] lastObject] isEqualToString: sync]; }, 5));
+    XCTAssertEqual([[presenceStatuses statuses] count], count);
+
+    [chat dispose];
+}
+
+@end
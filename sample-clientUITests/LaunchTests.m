@@ -0,0 +1,59 @@
+#import <XCTest/XCTest.h>
+
+// Time allowed for the first message of the room to be shown
+#define FIRST_MESSAGE_TIMEOUT 30
+
+@interface LaunchTests : XCTestCase
+@end
+
+@implementation LaunchTests
+
+- (void) setUp {
+    [super setUp];
+
+    self.continueAfterFailure = NO;
+}
+
+// Launch the app and wait until the live message field shows a message, instead of its initial "-".
+- (void) launchAndWaitForFirstMessage: (XCUIApplication *)app {
+    [app launch];
+
+    XCUIElement *liveMessage = [[app textFields] elementMatchingType: XCUIElementTypeTextField identifier: @"liveMessage"];
+    NSPredicate *shown = [NSPredicate predicateWithFormat: @"exists == YES AND value != '-'"];
+    XCTestExpectation *firstMessage = [self expectationForPredicate: shown evaluatedWithObject: liveMessage handler: nil];
+    [self waitForExpectations: @[firstMessage] timeout: FIRST_MESSAGE_TIMEOUT];
+}
+
+// The time from the launch of the app until its main thread is responsive.
+- (void) testLaunchTime {
+    [self measureWithMetrics: @[[[XCTApplicationLaunchMetric new] autorelease]] block: ^{
+        [[[[XCUIApplication alloc] init] autorelease] launch];
+    }];
+}
+
+// The time from the launch of the app until the first message of the room is shown, which includes the connection
+// and the subscription.
+- (void) measureTimeToFirstMessage: (NSArray *)launchArguments {
+    XCUIApplication *app = [[[XCUIApplication alloc] init] autorelease];
+    app.launchArguments = launchArguments;
+    XCTMeasureOptions *options = [XCTMeasureOptions defaultOptions];
+    options.invocationOptions = XCTMeasurementInvocationManuallyStop;
+
+    [self measureWithMetrics: @[[[XCTClockMetric new] autorelease]] options: options block: ^{
+        [self launchAndWaitForFirstMessage: app];
+        [self stopMeasuring];
+        [app terminate];
+    }];
+}
+
+// Against the configured servers.
+- (void) testTimeToFirstMessage {
+    [self measureTimeToFirstMessage: @[]];
+}
+
+// Without a network: the app runs against the in-process server, which holds one message of the room.
+- (void) testLoopbackTimeToFirstMessage {
+    [self measureTimeToFirstMessage: @[@"-LoopbackClient", @"YES"]];
+}
+
+@end